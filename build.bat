@@ -9,6 +9,9 @@ REM Build the main program
 pushd build
 
 
-cl -W0 -Zi -FC ..\src\win32_platform.cpp user32.lib libcmt.lib d3d11.lib d3dcompiler.lib dxguid.lib
+cl -W0 -Zi -FC -EHsc ..\src\win32_platform.cpp user32.lib libcmt.lib d3d11.lib d3dcompiler.lib dxguid.lib
+
+REM Build the offline texture baker
+cl -W0 -Zi -FC -EHsc ..\src\texture_baker.cpp
 
 popd
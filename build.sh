@@ -1,10 +1,16 @@
 #!/bin/bash
 
-CL="$HOME/code/msvc-wine/bin/x64/cl.exe" -Zi -FC
-CLANG=clang -target x86_64-pc-windows-gnu
+# Cross-compiles the Windows build from Linux with a MinGW-w64 sysroot, the
+# equivalent of build.bat. For the Linux-native builds see build_headless.sh.
+set -e
 
+CXX="clang++ -target x86_64-pc-windows-gnu"
+CXXFLAGS="-std=c++14 -g -static"
+
+mkdir -p build
 pushd build
 
-$CLANG ../src/win32_platform.c user32.lib libcmt.lib d3d11.lib d3dcompiler.lib dxguid.lib
+$CXX $CXXFLAGS ../src/win32_platform.cpp -o win32_platform.exe -luser32 -ld3d11 -ld3dcompiler -ldxguid -lwinmm
+$CXX $CXXFLAGS ../src/texture_baker.cpp -o texture_baker.exe
 
 popd
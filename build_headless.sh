@@ -0,0 +1,17 @@
+#!/bin/bash
+
+# Headless (GPU-less) build of the software render path, asset tools and
+# benchmarks, for Linux CI boxes.
+set -e
+
+CXX="${CXX:-c++}"
+CXXFLAGS="-std=c++14 -O2 -g -Wall -pthread"
+
+mkdir -p build
+pushd build
+
+$CXX $CXXFLAGS ../src/headless_platform.cpp -o headless
+$CXX $CXXFLAGS ../src/texture_baker.cpp -o texture_baker
+$CXX $CXXFLAGS ../src/bench.cpp -o bench
+
+popd
@@ -0,0 +1,14 @@
+struct PS_INPUT
+{
+    float4 Position : SV_POSITION;
+    float2 UV : TEXCOORD;
+    float4 Color : COLOR;
+};
+
+Texture2D quadTexture : register(t0);
+SamplerState quadSampler : register(s0);
+
+float4 PSMain(PS_INPUT input) : SV_Target
+{
+    return quadTexture.Sample(quadSampler, input.UV) * input.Color;
+}
@@ -0,0 +1,29 @@
+struct VS_INPUT
+{
+    float4 Rect : RECT;         // x, y, width, height
+    float4 UVRect : TEXCOORD;   // u0, v0, u1, v1
+    float4 Color : COLOR;
+    uint VertexId : SV_VertexID;
+};
+
+struct PS_INPUT
+{
+    float4 Position : SV_POSITION;
+    float2 UV : TEXCOORD;
+    float4 Color : COLOR;
+};
+
+// One instance per quad, drawn as a 4 vertex triangle strip. The corners go
+// bottom-left, top-left, bottom-right, top-right so both triangles are
+// clockwise, front facing under the default rasterizer state. Rect.xy is the
+// bottom-left corner in clip space (y up) and UVRect.xy the top-left texel.
+PS_INPUT VSMain(VS_INPUT input)
+{
+    float2 corner = float2(input.VertexId >> 1, input.VertexId & 1);
+
+    PS_INPUT output;
+    output.Position = float4(input.Rect.xy + corner * input.Rect.zw, 0.0f, 1.0f);
+    output.UV = lerp(input.UVRect.xy, input.UVRect.zw, float2(corner.x, 1.0f - corner.y));
+    output.Color = input.Color;
+    return output;
+}
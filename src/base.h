@@ -0,0 +1,67 @@
+#pragma once
+
+// Small set of definitions shared by the platform-independent modules.
+// Nothing in here may pull in windows.h so the same code builds headless on Linux.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+
+#define ArrayCount(array) (sizeof(array) / sizeof((array)[0]))
+
+#if defined(_M_X64) || defined(__x86_64__)
+  #define ARCH_X64 1
+  #include <immintrin.h>
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #endif
+#else
+  #define ARCH_X64 0
+#endif
+
+// Functions using AVX2 intrinsics are tagged with TARGET_AVX2 and only called
+// after CpuSupportsAVX2() returned true. MSVC allows the intrinsics anywhere,
+// GCC/Clang need the per-function target attribute.
+#if ARCH_X64 && !defined(_MSC_VER)
+  #define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+  #define TARGET_AVX2
+#endif
+
+static inline bool CpuSupportsAVX2()
+{
+#if ARCH_X64 && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if(info[0] < 7)
+    return false;
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  if(!osxsave || (_xgetbv(0) & 6) != 6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#elif ARCH_X64
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+// Monotonic wall clock for coarse timing and reports
+static inline double GetSeconds()
+{
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// FNV-1a, used for content keys and payload checksums
+#define FNV1A64_INITIAL 14695981039346656037ull
+
+static inline uint64_t Fnv1a64(const void* data, size_t size, uint64_t hash = FNV1A64_INITIAL)
+{
+  const uint8_t* bytes = (const uint8_t*)data;
+  for(size_t i = 0; i < size; ++i)
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  return hash;
+}
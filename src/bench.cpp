@@ -0,0 +1,576 @@
+// Benchmark suite for the CPU hot paths: JPEG decode, vertex buffer building,
+// quad batching, a scene-scaling sweep through the software renderer and the
+// golden-image capture/compare path.
+//
+//   bench [--filter substring] [--samples N] [--warmup N] [--min-sample-ms N]
+//         [--threads N] [--no-avx2] [--max-triangles N] [--image path]
+//         [--label text] [--json out.json] [--compare baseline.json]
+//
+// Every benchmark is calibrated so one sample runs at least --min-sample-ms,
+// then runs --warmup discarded samples and --samples measured ones. Reported
+// times are per iteration: the median over samples and the median absolute
+// deviation (MAD) as the noise estimate, both robust against the odd sample
+// hit by a context switch.
+//
+// The JSON output has one benchmark per line in a fixed order, so two runs can
+// be diffed directly or fed back in with --compare. Each benchmark also records
+// a checksum of what it produced (decoded pixels, packed vertices, framebuffer)
+// so a speedup that changes the output is caught too. Inputs are generated
+// from fixed seeds; run from the repo root so res/ resolves.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "profiler.cpp"
+#include "memory.cpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "vendor/stb_image.h"
+
+#include "sw_renderer.cpp"
+#include "mapped_file.cpp"
+#include "quad_batch.cpp"
+#include "vertex_pack.cpp"
+#include "scene_gen.cpp"
+#include "frame_capture.cpp"
+#include "image_diff.cpp"
+
+#define BENCH_FORMAT "bench/1"
+
+struct BenchOptions
+{
+    int numWarmup;
+    int numSamples;
+    double minSampleSeconds;
+    const char* filter;
+};
+
+struct BenchResult
+{
+    std::string name;
+    uint64_t iterations; // per sample
+    int numSamples;
+    double medianNs;     // per iteration
+    double madNs;
+    double minNs;
+    double maxNs;
+    double itemsPerIteration;
+    double bytesPerIteration;
+    uint64_t checksum;
+};
+
+struct BenchSuite
+{
+    BenchOptions options;
+    std::vector<BenchResult> results;
+};
+
+static double Median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n & 1 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+}
+
+static void FormatNanoseconds(double ns, char* buffer, size_t size)
+{
+    if(ns >= 1e9) snprintf(buffer, size, "%.3f s", ns * 1e-9);
+    else if(ns >= 1e6) snprintf(buffer, size, "%.3f ms", ns * 1e-6);
+    else if(ns >= 1e3) snprintf(buffer, size, "%.3f us", ns * 1e-3);
+    else snprintf(buffer, size, "%.1f ns", ns);
+}
+
+// For benchmarks whose inputs are expensive or may be missing: check before
+// setting them up rather than letting Bench_Run skip them afterwards.
+static bool Bench_IsSelected(const BenchSuite* suite, const std::string& name)
+{
+    return !suite->options.filter || strstr(name.c_str(), suite->options.filter);
+}
+
+// Times func, which runs one iteration. items and bytes are what one iteration
+// processes, for the throughput columns. Returns null if the filter skipped it;
+// otherwise the caller may fill in the checksum.
+template<typename Func>
+static BenchResult* Bench_Run(BenchSuite* suite, const std::string& name, double items, double bytes, Func func)
+{
+    const BenchOptions* options = &suite->options;
+    if(!Bench_IsSelected(suite, name))
+        return nullptr;
+
+    // Calibrate on the first (cold) iteration, then once more warm in case the
+    // cold one was dominated by page faults
+    double start = GetSeconds();
+    func();
+    double estimate = GetSeconds() - start;
+    start = GetSeconds();
+    func();
+    estimate = std::max(GetSeconds() - start, 1e-9);
+    uint64_t iterations = (uint64_t)ceil(options->minSampleSeconds / estimate);
+    iterations = std::max<uint64_t>(1, std::min<uint64_t>(iterations, 1ull << 30));
+
+    std::vector<double> samples;
+    for(int sample = -options->numWarmup; sample < options->numSamples; ++sample)
+    {
+        start = GetSeconds();
+        for(uint64_t i = 0; i < iterations; ++i)
+            func();
+        double elapsed = GetSeconds() - start;
+        if(sample >= 0)
+            samples.push_back(elapsed * 1e9 / iterations);
+    }
+
+    BenchResult result = {};
+    result.name = name;
+    result.iterations = iterations;
+    result.numSamples = options->numSamples;
+    result.medianNs = Median(samples);
+    std::vector<double> deviations;
+    for(double sample : samples)
+        deviations.push_back(fabs(sample - result.medianNs));
+    result.madNs = Median(deviations);
+    result.minNs = *std::min_element(samples.begin(), samples.end());
+    result.maxNs = *std::max_element(samples.begin(), samples.end());
+    result.itemsPerIteration = items;
+    result.bytesPerIteration = bytes;
+
+    char median[32], min[32];
+    FormatNanoseconds(result.medianNs, median, sizeof(median));
+    FormatNanoseconds(result.minNs, min, sizeof(min));
+    printf("%-36s %12s +-%5.1f%%  min %12s", name.c_str(), median, result.madNs * 100.0 / result.medianNs, min);
+    if(bytes > 0.0)
+        printf("  %9.1f MB/s", bytes * 1e3 / result.medianNs);
+    if(items > 0.0)
+        printf("  %9.2f M/s", items * 1e3 / result.medianNs);
+    printf("\n");
+    fflush(stdout);
+
+    suite->results.push_back(result);
+    return &suite->results.back();
+}
+
+static uint64_t HashFramebuffer(SoftwareFramebuffer fb)
+{
+    uint64_t hash = FNV1A64_INITIAL;
+    for(int y = 0; y < fb.height; ++y)
+        hash = Fnv1a64(fb.pixels + (size_t)y * fb.pitch, fb.width * sizeof(uint32_t), hash);
+    return hash;
+}
+
+// Decode of the texture the game ships, from memory so disk IO stays out of it.
+// Once with the default allocator and once through a scratch arena, the way
+// the baker and the streamer decode.
+static bool BenchDecode(BenchSuite* suite, const char* imagePath)
+{
+    const char* baseName = strrchr(imagePath, '/') ? strrchr(imagePath, '/') + 1 : imagePath;
+    std::string names[2] = { std::string("decode/jpeg/") + baseName + "/heap", std::string("decode/jpeg/") + baseName + "/arena" };
+    if(!Bench_IsSelected(suite, names[0]) && !Bench_IsSelected(suite, names[1]))
+        return true;
+
+    MappedFile file;
+    if(!MappedFile_Open(&file, imagePath)) {
+        fprintf(stderr, "Could not open %s\n", imagePath);
+        return false;
+    }
+    std::vector<uint8_t> fileData(file.data, file.data + file.size);
+    MappedFile_Close(&file);
+
+    int width = 0, height = 0, channels = 0;
+    if(!stbi_info_from_memory(fileData.data(), (int)fileData.size(), &width, &height, &channels)) {
+        fprintf(stderr, "Could not decode %s: %s\n", imagePath, stbi_failure_reason());
+        return false;
+    }
+
+    MemoryArena scratch;
+    if(!MemoryArena_Init(&scratch, 64 << 20, "Decode Scratch")) {
+        fprintf(stderr, "Could not allocate the scratch arena\n");
+        return false;
+    }
+
+    double pixels = (double)width * height;
+    for(int useArena = 0; useArena < 2; ++useArena)
+    {
+        // The checksum is only taken outside the timed runs, hashing costs
+        // about a tenth of the decode
+        auto decode = [&](uint64_t* checksum) {
+            MemoryArena* previousArena = Memory_BindStbiArena(useArena ? &scratch : nullptr);
+            int w, h, n;
+            uint8_t* rgba = stbi_load_from_memory(fileData.data(), (int)fileData.size(), &w, &h, &n, 4);
+            if(checksum)
+                *checksum = rgba ? Fnv1a64(rgba, (size_t)w * h * 4) : 0;
+            stbi_image_free(rgba);
+            Memory_BindStbiArena(previousArena);
+            if(useArena)
+                MemoryArena_Reset(&scratch);
+        };
+
+        BenchResult* result = Bench_Run(suite, names[useArena], pixels, (double)fileData.size(), [&]() { decode(nullptr); });
+        if(result)
+            decode(&result->checksum);
+    }
+
+    MemoryArena_Release(&scratch);
+    return true;
+}
+
+// Building the triangle vertex buffers: generating the float stream and packing
+// it to PackedVertex with each kernel set, for the single triangle
+// win32_platform.cpp uploads and for a large scene.
+static void BenchVertexBuffers(BenchSuite* suite, uint32_t numTris)
+{
+    std::vector<float> vertexData;
+    BenchResult* result = Bench_Run(suite, "vertex_buffer/generate/" + std::to_string(numTris), numTris * 3.0,
+                                    numTris * 3.0 * sizeof(BasicVertex),
+                                    [&]() { SceneGen_RandomTriangles(&vertexData, numTris, 1234); });
+    if(result)
+        result->checksum = Fnv1a64(vertexData.data(), vertexData.size() * sizeof(float));
+
+    // Same vertices as the Create Vertex Buffer block in win32_platform.cpp
+    const BasicVertex triangle[3] = {
+        { 0.0f,  0.5f, 0.f, 1.f, 0.f, 1.f },
+        { 0.5f, -0.5f, 1.f, 0.f, 0.f, 1.f },
+        { -0.5f, -0.5f, 0.f, 0.f, 1.f, 1.f },
+    };
+    SceneGen_RandomTriangles(&vertexData, numTris, 1234);
+
+    const char* pathNames[] = { "scalar", "sse2", "avx2" };
+    VertexPackPath bestPath = VertexPack_SetPath(VertexPackPath_AVX2);
+    for(int path = VertexPackPath_Scalar; path <= (int)bestPath; ++path)
+    {
+        VertexPack_SetPath((VertexPackPath)path);
+
+        PackedVertex packedTriangle[3];
+        result = Bench_Run(suite, std::string("vertex_buffer/pack_") + pathNames[path] + "/3", 3.0, sizeof(triangle),
+                           [&]() { VertexPack_Convert<BasicVertexFormat, PackedVertexFormat>(triangle, packedTriangle, 3); });
+        if(result)
+            result->checksum = Fnv1a64(packedTriangle, sizeof(packedTriangle));
+
+        size_t numVerts = (size_t)numTris * 3;
+        std::vector<PackedVertex> packed(numVerts);
+        result = Bench_Run(suite, std::string("vertex_buffer/pack_") + pathNames[path] + "/" + std::to_string(numVerts),
+                           (double)numVerts, (double)numVerts * sizeof(BasicVertex),
+                           [&]() { VertexPack_Convert<BasicVertexFormat, PackedVertexFormat>(vertexData.data(), packed.data(), numVerts); });
+        if(result)
+            result->checksum = Fnv1a64(packed.data(), packed.size() * sizeof(PackedVertex));
+    }
+    VertexPack_SetPath(bestPath);
+}
+
+static void* NullQuadMap(QuadMapMode /*mode*/, void* userData)
+{
+    return ((std::vector<QuadInstance>*)userData)->data();
+}
+
+static void NullQuadUnmap(void* /*userData*/)
+{
+}
+
+static void NullQuadDraw(uint64_t /*sortKey*/, uint32_t /*firstInstance*/, uint32_t /*instanceCount*/, void* /*userData*/)
+{
+}
+
+// A frame of sprites through QuadBatch: add in random key order, then sort,
+// gather and stream into a fake instance buffer on flush.
+static void BenchQuadBatch(BenchSuite* suite, uint32_t numQuads)
+{
+    const uint32_t ringCapacity = 64 * 1024;
+    std::vector<QuadInstance> instances(ringCapacity);
+    QuadBackend backend = { NullQuadMap, NullQuadUnmap, NullQuadDraw, &instances };
+    QuadBatch batch;
+    QuadBatch_Init(&batch, ringCapacity);
+
+    std::vector<uint64_t> keys(numQuads);
+    std::vector<float> rects((size_t)numQuads * 4);
+    uint32_t state = 1234;
+    auto next = [&state]() { state = state * 1664525u + 1013904223u; return state >> 8; };
+    for(uint32_t i = 0; i < numQuads; ++i)
+    {
+        keys[i] = QuadBatch_MakeKey((uint16_t)(next() & 3), (uint16_t)(next() & 1), next() & 63);
+        rects[i * 4 + 0] = (float)(next() & 1023) / 512.0f - 1.0f;
+        rects[i * 4 + 1] = (float)(next() & 1023) / 512.0f - 1.0f;
+        rects[i * 4 + 2] = 0.02f;
+        rects[i * 4 + 3] = 0.02f;
+    }
+
+    const float uvRect[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+    QuadBatchStats stats = {};
+    BenchResult* result = Bench_Run(suite, "batch/quads/" + std::to_string(numQuads), numQuads, 0.0, [&]() {
+        for(uint32_t i = 0; i < numQuads; ++i)
+            QuadBatch_Add(&batch, keys[i], &rects[i * 4], uvRect, 0xFF000000u | (uint32_t)(keys[i] & 63));
+        QuadBatch_Flush(&batch, &backend, &stats);
+    });
+    if(result)
+        result->checksum = Fnv1a64(instances.data(), instances.size() * sizeof(QuadInstance));
+}
+
+// Whole frames through the software renderer (clear, bin, rasterize, resolve)
+// for 1, 10, 100, ... triangles, to see where per-frame overhead stops
+// mattering and where fill rate takes over.
+static void BenchRasterSweep(BenchSuite* suite, uint32_t maxTris, int numThreads, bool useAVX2)
+{
+    const int width = 1024;
+    const int height = 768;
+    SoftwareRenderer* renderer = SoftwareRenderer_Create(width, height, numThreads);
+    SoftwareRenderer_SetUseAVX2(renderer, useAVX2);
+
+    std::vector<float> vertexData;
+    for(uint64_t numTris = 1; numTris <= maxTris; numTris *= 10)
+    {
+        std::string name = "raster/triangles/" + std::to_string(numTris);
+        if(!Bench_IsSelected(suite, name))
+            continue;
+
+        SceneGen_RandomTriangles(&vertexData, (uint32_t)numTris, 1234);
+        uint32_t numVerts = (uint32_t)numTris * 3;
+        BenchResult* result = Bench_Run(suite, name, (double)numTris, 0.0, [&]() {
+            float backgroundColor[4] = { 0.1f, 0.2f, 0.6f, 1.0f };
+            SoftwareRenderer_Clear(renderer, backgroundColor);
+            SoftwareRenderer_SetViewport(renderer, { 0.0f, 0.0f, (float)width, (float)height });
+            SoftwareRenderer_Draw(renderer, vertexData.data(), BasicVertexFormat::stride, numVerts);
+            SoftwareRenderer_Flush(renderer);
+        });
+        if(result)
+            result->checksum = HashFramebuffer(SoftwareRenderer_GetFramebuffer(renderer));
+    }
+
+    SoftwareRenderer_Destroy(renderer);
+}
+
+// Golden-image checks on a rendered 1000 triangle frame: PNG encode, and the
+// comparator with each kernel set against the next seed's frame, so every
+// block has real differences to measure.
+static void BenchGoldenImages(BenchSuite* suite, int numThreads)
+{
+    const int width = 1024;
+    const int height = 768;
+    std::string size = std::to_string(width) + "x" + std::to_string(height);
+    const char* pathNames[] = { "scalar", "sse2", "avx2" };
+    ImageDiffPath bestPath = ImageDiff_SetPath(ImageDiffPath_AVX2);
+    std::string encodeName = "golden/png_encode/" + size;
+    std::vector<std::string> compareNames;
+    bool anySelected = Bench_IsSelected(suite, encodeName);
+    for(int path = ImageDiffPath_Scalar; path <= (int)bestPath; ++path)
+    {
+        compareNames.push_back(std::string("golden/compare_") + pathNames[path] + "/" + size);
+        anySelected = anySelected || Bench_IsSelected(suite, compareNames.back());
+    }
+    if(!anySelected)
+        return;
+
+    SoftwareRenderer* renderer = SoftwareRenderer_Create(width, height, numThreads);
+    FrameImage frames[2];
+    std::vector<float> vertexData;
+    for(int i = 0; i < 2; ++i)
+    {
+        SceneGen_RandomTriangles(&vertexData, 1000, 1234 + i);
+        float backgroundColor[4] = { 0.1f, 0.2f, 0.6f, 1.0f };
+        SoftwareRenderer_Clear(renderer, backgroundColor);
+        SoftwareRenderer_SetViewport(renderer, { 0.0f, 0.0f, (float)width, (float)height });
+        SoftwareRenderer_Draw(renderer, vertexData.data(), BasicVertexFormat::stride, (uint32_t)vertexData.size() / 6);
+        SoftwareRenderer_Flush(renderer);
+        SoftwareFramebuffer fb = SoftwareRenderer_GetFramebuffer(renderer);
+        FrameCapture_CopyRows(&frames[i], fb.pixels, fb.width, fb.height, fb.pitch * sizeof(uint32_t));
+    }
+    SoftwareRenderer_Destroy(renderer);
+
+    double numPixels = (double)width * height;
+    std::vector<uint8_t> png;
+    BenchResult* result = Bench_Run(suite, encodeName, numPixels, numPixels * 4,
+                                    [&]() { FrameCapture_EncodePNG(&frames[0], &png); });
+    if(result)
+        result->checksum = Fnv1a64(png.data(), png.size());
+
+    ImageDiffOptions options = {};
+    options.minSsim = 0.99;
+    ImageDiffResult diff;
+    for(int path = ImageDiffPath_Scalar; path <= (int)bestPath; ++path)
+    {
+        ImageDiff_SetPath((ImageDiffPath)path);
+        result = Bench_Run(suite, compareNames[path], numPixels, numPixels * 8,
+                           [&]() { ImageDiff_Compare(&frames[0], &frames[1], &options, &diff, nullptr); });
+        if(result)
+        {
+            uint64_t checksum = Fnv1a64(&diff.numFailingPixels, sizeof(diff.numFailingPixels));
+            checksum = Fnv1a64(&diff.ssim, sizeof(diff.ssim), checksum);
+            result->checksum = Fnv1a64(&diff.worstBlockSsim, sizeof(diff.worstBlockSsim), checksum);
+        }
+    }
+    ImageDiff_SetPath(bestPath);
+}
+
+static bool WriteJson(const char* path, const BenchSuite* suite, const char* label, int numThreads, bool useAVX2)
+{
+    FILE* file = fopen(path, "w");
+    if(!file)
+        return false;
+
+    const BenchOptions* options = &suite->options;
+    fprintf(file, "{\n  \"format\": \"%s\",\n  \"label\": ", BENCH_FORMAT);
+    WriteJsonString(file, label);
+    fprintf(file, ",\n  \"machine\": {\"hardware_threads\": %u, \"avx2\": %s},\n", std::thread::hardware_concurrency(),
+            CpuSupportsAVX2() ? "true" : "false");
+    fprintf(file, "  \"options\": {\"warmup\": %d, \"samples\": %d, \"min_sample_ms\": %.1f, \"render_threads\": %d, \"use_avx2\": %s},\n",
+            options->numWarmup, options->numSamples, options->minSampleSeconds * 1000.0, numThreads, useAVX2 ? "true" : "false");
+    fprintf(file, "  \"benchmarks\": [\n");
+    for(size_t i = 0; i < suite->results.size(); ++i)
+    {
+        const BenchResult* result = &suite->results[i];
+        fprintf(file, "    {\"name\": ");
+        WriteJsonString(file, result->name.c_str());
+        fprintf(file, ", \"median_ns\": %.1f, \"mad_ns\": %.1f, \"min_ns\": %.1f, \"max_ns\": %.1f, \"iterations\": %llu, \"samples\": %d",
+                result->medianNs, result->madNs, result->minNs, result->maxNs, (unsigned long long)result->iterations, result->numSamples);
+        if(result->itemsPerIteration > 0.0)
+            fprintf(file, ", \"items_per_second\": %.1f", result->itemsPerIteration * 1e9 / result->medianNs);
+        if(result->bytesPerIteration > 0.0)
+            fprintf(file, ", \"bytes_per_second\": %.1f", result->bytesPerIteration * 1e9 / result->medianNs);
+        fprintf(file, ", \"checksum\": \"%016llx\"}%s\n", (unsigned long long)result->checksum, i + 1 < suite->results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+// Reads back the benchmark lines of a file written by WriteJson; not a general
+// JSON parser.
+static bool ReadBaseline(const char* path, std::vector<BenchResult>* results)
+{
+    FILE* file = fopen(path, "r");
+    if(!file)
+        return false;
+
+    char line[1024];
+    bool sawFormat = false;
+    while(fgets(line, sizeof(line), file))
+    {
+        if(strstr(line, "\"format\": \"" BENCH_FORMAT "\""))
+            sawFormat = true;
+        const char* name = strstr(line, "{\"name\": \"");
+        const char* median = strstr(line, "\"median_ns\": ");
+        const char* mad = strstr(line, "\"mad_ns\": ");
+        const char* checksum = strstr(line, "\"checksum\": \"");
+        if(!name || !median || !mad || !checksum)
+            continue;
+
+        name += strlen("{\"name\": \"");
+        BenchResult result = {};
+        result.name.assign(name, strcspn(name, "\""));
+        result.medianNs = atof(median + strlen("\"median_ns\": "));
+        result.madNs = atof(mad + strlen("\"mad_ns\": "));
+        result.checksum = strtoull(checksum + strlen("\"checksum\": \""), nullptr, 16);
+        results->push_back(result);
+    }
+    fclose(file);
+    return sawFormat;
+}
+
+// A change counts when the medians are further apart than three times the
+// combined noise, and by more than 2% so very stable benchmarks don't flag
+// harmless jitter. Returns the number of benchmarks whose output changed.
+static int CompareWithBaseline(const BenchSuite* suite, const std::vector<BenchResult>& baseline)
+{
+    int numChanged = 0;
+    printf("\n%-36s %9s\n", "vs baseline", "median");
+    for(const BenchResult& result : suite->results)
+    {
+        const BenchResult* old = nullptr;
+        for(const BenchResult& candidate : baseline)
+            if(candidate.name == result.name)
+                old = &candidate;
+        if(!old) {
+            printf("%-36s %9s\n", result.name.c_str(), "new");
+            continue;
+        }
+
+        double delta = (result.medianNs - old->medianNs) / old->medianNs * 100.0;
+        double noise = 3.0 * (result.madNs + old->madNs);
+        bool significant = fabs(result.medianNs - old->medianNs) > noise && fabs(delta) > 2.0;
+        bool outputChanged = result.checksum != old->checksum;
+        numChanged += outputChanged ? 1 : 0;
+        printf("%-36s %+8.1f%%  %s%s\n", result.name.c_str(), delta,
+               !significant ? "~" : delta > 0.0 ? "slower" : "faster", outputChanged ? "  OUTPUT CHANGED" : "");
+    }
+    return numChanged;
+}
+
+static void PrintUsage()
+{
+    printf("usage: bench [--filter substring] [--samples N] [--warmup N] [--min-sample-ms N]\n"
+           "             [--threads N] [--no-avx2] [--max-triangles N] [--image path]\n"
+           "             [--label text] [--json out.json] [--compare baseline.json]\n");
+}
+
+int main(int argc, char** argv)
+{
+    BenchSuite suite;
+    suite.options.numWarmup = 2;
+    suite.options.numSamples = 10;
+    suite.options.minSampleSeconds = 0.05;
+    suite.options.filter = nullptr;
+    int numThreads = 0;
+    bool useAVX2 = true;
+    uint32_t maxTris = 1000000;
+    const char* imagePath = "res/textures/wall.jpg";
+    const char* label = "";
+    const char* jsonPath = nullptr;
+    const char* baselinePath = nullptr;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "--filter") && hasValue) suite.options.filter = argv[++i];
+        else if(!strcmp(argv[i], "--samples") && hasValue) suite.options.numSamples = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--warmup") && hasValue) suite.options.numWarmup = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--min-sample-ms") && hasValue) suite.options.minSampleSeconds = atof(argv[++i]) / 1000.0;
+        else if(!strcmp(argv[i], "--threads") && hasValue) numThreads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--max-triangles") && hasValue) maxTris = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if(!strcmp(argv[i], "--image") && hasValue) imagePath = argv[++i];
+        else if(!strcmp(argv[i], "--label") && hasValue) label = argv[++i];
+        else if(!strcmp(argv[i], "--json") && hasValue) jsonPath = argv[++i];
+        else if(!strcmp(argv[i], "--compare") && hasValue) baselinePath = argv[++i];
+        else if(!strcmp(argv[i], "--no-avx2")) useAVX2 = false;
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if(suite.options.numSamples < 1 || suite.options.numWarmup < 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    // Read the baseline first so a bad path fails before minutes of benchmarking
+    std::vector<BenchResult> baseline;
+    if(baselinePath && !ReadBaseline(baselinePath, &baseline)) {
+        fprintf(stderr, "Could not read %s as %s output\n", baselinePath, BENCH_FORMAT);
+        return 1;
+    }
+
+    Profiler_Init();
+    Profiler_SetThreadName("Main");
+    printf("%d warmup + %d samples of at least %.0f ms, %u hardware threads, %s\n", suite.options.numWarmup, suite.options.numSamples,
+           suite.options.minSampleSeconds * 1000.0, std::thread::hardware_concurrency(),
+           !ARCH_X64 ? "scalar" : (useAVX2 && CpuSupportsAVX2()) ? "AVX2" : "SSE2");
+
+    int result = 0;
+    if(!BenchDecode(&suite, imagePath))
+        result = 1;
+    BenchVertexBuffers(&suite, 100000);
+    BenchQuadBatch(&suite, 65536);
+    BenchRasterSweep(&suite, maxTris, numThreads, useAVX2);
+    BenchGoldenImages(&suite, numThreads);
+
+    if(jsonPath && !WriteJson(jsonPath, &suite, label, numThreads, useAVX2)) {
+        fprintf(stderr, "Could not write %s\n", jsonPath);
+        result = 1;
+    }
+    if(baselinePath && CompareWithBaseline(&suite, baseline) > 0)
+        result = 1;
+    return result;
+}
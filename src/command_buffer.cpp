@@ -0,0 +1,143 @@
+#include "command_buffer.h"
+
+#include <string.h>
+#include <assert.h>
+
+void CommandBuffer_Reset(CommandBuffer* buffer)
+{
+    buffer->data.clear();
+    buffer->numCommands = 0;
+    buffer->currentShader = COMMAND_INVALID_HANDLE;
+    buffer->currentVertexBuffer = COMMAND_INVALID_HANDLE;
+    buffer->currentStride = 0;
+    buffer->currentOffset = 0;
+}
+
+template<typename T>
+static void PushCommand(CommandBuffer* buffer, CommandType type, T* command)
+{
+    static_assert(sizeof(T) % 4 == 0, "Commands must keep the stream 4-byte aligned");
+    command->header.type = (uint16_t)type;
+    command->header.size = (uint16_t)sizeof(T);
+    size_t offset = buffer->data.size();
+    buffer->data.resize(offset + sizeof(T));
+    memcpy(&buffer->data[offset], command, sizeof(T));
+    buffer->numCommands++;
+}
+
+void CommandBuffer_Clear(CommandBuffer* buffer, const float color[4])
+{
+    ClearCommand command;
+    memcpy(command.color, color, sizeof(command.color));
+    PushCommand(buffer, CommandType_Clear, &command);
+}
+
+void CommandBuffer_SetViewport(CommandBuffer* buffer, float x, float y, float width, float height)
+{
+    SetViewportCommand command;
+    command.x = x;
+    command.y = y;
+    command.width = width;
+    command.height = height;
+    PushCommand(buffer, CommandType_SetViewport, &command);
+}
+
+void CommandBuffer_SetShader(CommandBuffer* buffer, uint32_t shader)
+{
+    if(shader == buffer->currentShader)
+        return;
+    buffer->currentShader = shader;
+
+    SetShaderCommand command;
+    command.shader = shader;
+    PushCommand(buffer, CommandType_SetShader, &command);
+}
+
+void CommandBuffer_SetVertexBuffer(CommandBuffer* buffer, uint32_t vertexBuffer, uint32_t stride, uint32_t offset)
+{
+    if(vertexBuffer == buffer->currentVertexBuffer && stride == buffer->currentStride && offset == buffer->currentOffset)
+        return;
+    buffer->currentVertexBuffer = vertexBuffer;
+    buffer->currentStride = stride;
+    buffer->currentOffset = offset;
+
+    SetVertexBufferCommand command;
+    command.buffer = vertexBuffer;
+    command.stride = stride;
+    command.offset = offset;
+    PushCommand(buffer, CommandType_SetVertexBuffer, &command);
+}
+
+void CommandBuffer_Draw(CommandBuffer* buffer, uint32_t vertexCount, uint32_t startVertex)
+{
+    DrawCommand command;
+    command.vertexCount = vertexCount;
+    command.startVertex = startVertex;
+    PushCommand(buffer, CommandType_Draw, &command);
+}
+
+void CommandBuffer_Append(CommandBuffer* dst, const CommandBuffer* src)
+{
+    dst->data.insert(dst->data.end(), src->data.begin(), src->data.end());
+    dst->numCommands += src->numCommands;
+    if(src->currentShader != COMMAND_INVALID_HANDLE)
+        dst->currentShader = src->currentShader;
+    if(src->currentVertexBuffer != COMMAND_INVALID_HANDLE) {
+        dst->currentVertexBuffer = src->currentVertexBuffer;
+        dst->currentStride = src->currentStride;
+        dst->currentOffset = src->currentOffset;
+    }
+}
+
+void CommandBuffer_Replay(const CommandBuffer* buffer, const CommandBackend* backend)
+{
+    const uint8_t* cursor = buffer->data.data();
+    const uint8_t* end = cursor + buffer->data.size();
+    while(cursor < end)
+    {
+        CommandHeader header;
+        memcpy(&header, cursor, sizeof(header));
+        assert(header.size >= sizeof(header) && cursor + header.size <= end);
+        switch(header.type)
+        {
+            case CommandType_Clear:
+            {
+                ClearCommand command;
+                memcpy(&command, cursor, sizeof(command));
+                backend->clear(command.color, backend->userData);
+                break;
+            }
+            case CommandType_SetViewport:
+            {
+                SetViewportCommand command;
+                memcpy(&command, cursor, sizeof(command));
+                backend->setViewport(command.x, command.y, command.width, command.height, backend->userData);
+                break;
+            }
+            case CommandType_SetShader:
+            {
+                SetShaderCommand command;
+                memcpy(&command, cursor, sizeof(command));
+                backend->setShader(command.shader, backend->userData);
+                break;
+            }
+            case CommandType_SetVertexBuffer:
+            {
+                SetVertexBufferCommand command;
+                memcpy(&command, cursor, sizeof(command));
+                backend->setVertexBuffer(command.buffer, command.stride, command.offset, backend->userData);
+                break;
+            }
+            case CommandType_Draw:
+            {
+                DrawCommand command;
+                memcpy(&command, cursor, sizeof(command));
+                backend->draw(command.vertexCount, command.startVertex, backend->userData);
+                break;
+            }
+            default:
+                assert(!"Unknown command type");
+        }
+        cursor += header.size;
+    }
+}
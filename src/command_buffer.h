@@ -0,0 +1,108 @@
+#pragma once
+
+// Backend-agnostic command buffers. Recording only appends small POD commands
+// to a byte stream, so any number of threads can each fill their own buffer.
+// Buffers are then merged or replayed in a fixed order into a CommandBackend
+// (D3D11 immediate/deferred context, the software rasterizer, or a null
+// backend for measuring recording cost).
+//
+// Shaders and vertex buffers are referenced by integer handles that the
+// backend resolves. Redundant SetShader/SetVertexBuffer commands are dropped
+// while recording; a buffer never assumes state set by another buffer.
+
+#include "base.h"
+
+#include <vector>
+
+#define COMMAND_INVALID_HANDLE 0xFFFFFFFFu
+
+enum CommandType : uint16_t
+{
+  CommandType_Clear,
+  CommandType_SetViewport,
+  CommandType_SetShader,
+  CommandType_SetVertexBuffer,
+  CommandType_Draw,
+  CommandType_Count,
+};
+
+struct CommandHeader
+{
+  uint16_t type; // CommandType
+  uint16_t size; // including the header
+};
+
+struct ClearCommand
+{
+  CommandHeader header;
+  float color[4];
+};
+
+struct SetViewportCommand
+{
+  CommandHeader header;
+  float x, y, width, height;
+};
+
+struct SetShaderCommand
+{
+  CommandHeader header;
+  uint32_t shader;
+};
+
+struct SetVertexBufferCommand
+{
+  CommandHeader header;
+  uint32_t buffer;
+  uint32_t stride;
+  uint32_t offset;
+};
+
+struct DrawCommand
+{
+  CommandHeader header;
+  uint32_t vertexCount;
+  uint32_t startVertex;
+};
+
+struct CommandBuffer
+{
+  std::vector<uint8_t> data;
+  uint32_t numCommands;
+
+  // Last state recorded into this buffer, for redundancy filtering
+  uint32_t currentShader;
+  uint32_t currentVertexBuffer;
+  uint32_t currentStride;
+  uint32_t currentOffset;
+};
+
+typedef void CommandClearFunc(const float color[4], void* userData);
+typedef void CommandSetViewportFunc(float x, float y, float width, float height, void* userData);
+typedef void CommandSetShaderFunc(uint32_t shader, void* userData);
+typedef void CommandSetVertexBufferFunc(uint32_t buffer, uint32_t stride, uint32_t offset, void* userData);
+typedef void CommandDrawFunc(uint32_t vertexCount, uint32_t startVertex, void* userData);
+
+struct CommandBackend
+{
+  CommandClearFunc* clear;
+  CommandSetViewportFunc* setViewport;
+  CommandSetShaderFunc* setShader;
+  CommandSetVertexBufferFunc* setVertexBuffer;
+  CommandDrawFunc* draw;
+  void* userData;
+};
+
+// Also initializes a new buffer. Keeps the allocation, so a buffer reused every
+// frame stops allocating.
+void CommandBuffer_Reset(CommandBuffer* buffer);
+
+void CommandBuffer_Clear(CommandBuffer* buffer, const float color[4]);
+void CommandBuffer_SetViewport(CommandBuffer* buffer, float x, float y, float width, float height);
+void CommandBuffer_SetShader(CommandBuffer* buffer, uint32_t shader);
+void CommandBuffer_SetVertexBuffer(CommandBuffer* buffer, uint32_t vertexBuffer, uint32_t stride, uint32_t offset);
+void CommandBuffer_Draw(CommandBuffer* buffer, uint32_t vertexCount, uint32_t startVertex);
+
+// Appends src to dst. Afterwards dst's filtering state is whatever src left behind.
+void CommandBuffer_Append(CommandBuffer* dst, const CommandBuffer* src);
+void CommandBuffer_Replay(const CommandBuffer* buffer, const CommandBackend* backend);
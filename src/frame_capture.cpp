@@ -0,0 +1,359 @@
+#include "frame_capture.h"
+#include "stb_image_decl.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define PNG_WINDOW_SIZE 32768
+#define PNG_HASH_BITS 15
+#define PNG_MIN_MATCH 3
+#define PNG_MAX_MATCH 258
+
+void FrameCapture_CopyRows(FrameImage* image, const void* pixels, int width, int height, size_t rowPitch)
+{
+    image->width = width;
+    image->height = height;
+    image->pixels.resize((size_t)width * height);
+    for(int y = 0; y < height; ++y)
+        memcpy(&image->pixels[(size_t)y * width], (const uint8_t*)pixels + y * rowPitch, (size_t)width * sizeof(uint32_t));
+}
+
+////////////////////////////////////////////////////////////////
+// PNG
+
+// CRC-32 for the chunks and the fixed Huffman codes of RFC 1951 3.2.6, with
+// codes bit-reversed since deflate packs them starting at the LSB.
+struct PngTables
+{
+    uint32_t crc[256];
+    uint16_t literalCodes[288];
+    uint8_t literalBits[288];
+    uint8_t distanceCodes[30];
+    // Match length 3..258 to symbol 257..285
+    uint16_t lengthSymbols[PNG_MAX_MATCH + 1];
+    // (distance - 1) to symbol: [0, 256) directly, then by (distance - 1) >> 7
+    uint8_t distanceSymbols[512];
+
+    PngTables()
+    {
+        for(uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for(int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc[i] = c;
+        }
+
+        for(uint32_t symbol = 0; symbol < 288; ++symbol)
+        {
+            uint32_t code, bits;
+            if(symbol < 144) { code = 0x30 + symbol; bits = 8; }
+            else if(symbol < 256) { code = 0x190 + symbol - 144; bits = 9; }
+            else if(symbol < 280) { code = symbol - 256; bits = 7; }
+            else { code = 0xC0 + symbol - 280; bits = 8; }
+            literalCodes[symbol] = (uint16_t)Reverse(code, bits);
+            literalBits[symbol] = (uint8_t)bits;
+        }
+        for(uint32_t symbol = 0; symbol < 30; ++symbol)
+            distanceCodes[symbol] = (uint8_t)Reverse(symbol, 5);
+
+        for(uint32_t length = 0; length < PNG_MIN_MATCH; ++length)
+            lengthSymbols[length] = 0;
+        for(uint32_t symbol = 0; symbol < 28; ++symbol)
+            for(uint32_t length = lengthBase[symbol]; length < lengthBase[symbol + 1]; ++length)
+                lengthSymbols[length] = (uint16_t)(257 + symbol);
+        lengthSymbols[PNG_MAX_MATCH] = 285;
+
+        for(uint32_t symbol = 0; symbol < 30; ++symbol)
+        {
+            uint32_t first = distanceBase[symbol] - 1;
+            uint32_t last = first + (1u << distanceExtra[symbol]);
+            for(uint32_t d = first; d < last; ++d)
+            {
+                if(d < 256)
+                    distanceSymbols[d] = (uint8_t)symbol;
+                else if((d & 127) == 0)
+                    distanceSymbols[256 + (d >> 7)] = (uint8_t)symbol;
+            }
+        }
+    }
+
+    static uint32_t Reverse(uint32_t code, uint32_t bits)
+    {
+        uint32_t result = 0;
+        for(uint32_t i = 0; i < bits; ++i)
+            result |= ((code >> i) & 1) << (bits - 1 - i);
+        return result;
+    }
+
+    static const uint16_t lengthBase[29];
+    static const uint8_t lengthExtra[29];
+    static const uint16_t distanceBase[30];
+    static const uint8_t distanceExtra[30];
+};
+
+const uint16_t PngTables::lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t PngTables::lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t PngTables::distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t PngTables::distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static const PngTables* GetPngTables()
+{
+    static PngTables tables;
+    return &tables;
+}
+
+static uint32_t Crc32(const PngTables* tables, const uint8_t* data, size_t size, uint32_t crc = 0)
+{
+    crc = ~crc;
+    for(size_t i = 0; i < size; ++i)
+        crc = tables->crc[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t Adler32(const uint8_t* data, size_t size)
+{
+    // 5552 is the most bytes that can be summed before b may overflow 32 bits
+    uint32_t a = 1, b = 0;
+    while(size)
+    {
+        size_t count = size < 5552 ? size : 5552;
+        size -= count;
+        for(size_t i = 0; i < count; ++i)
+        {
+            a += data[i];
+            b += a;
+        }
+        data += count;
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+struct DeflateWriter
+{
+    uint8_t* out;
+    uint64_t bits;
+    uint32_t numBits;
+};
+
+static inline void PutBits(DeflateWriter* writer, uint32_t value, uint32_t numBits)
+{
+    writer->bits |= (uint64_t)value << writer->numBits;
+    writer->numBits += numBits;
+    if(writer->numBits >= 32)
+    {
+        uint32_t word = (uint32_t)writer->bits;
+        memcpy(writer->out, &word, sizeof(word)); // little-endian, so the LSB goes first
+        writer->out += 4;
+        writer->bits >>= 32;
+        writer->numBits -= 32;
+    }
+}
+
+static inline uint32_t HashTrigram(const uint8_t* p)
+{
+    uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (v * 2654435761u) >> (32 - PNG_HASH_BITS);
+}
+
+// One final fixed-Huffman block. out needs room for 9 bits per input byte plus
+// a few bytes of slack; returns the compressed size.
+static size_t Deflate(const PngTables* tables, const uint8_t* data, size_t size, uint8_t* out)
+{
+    DeflateWriter writer = { out, 0, 0 };
+    PutBits(&writer, 1, 1); // BFINAL
+    PutBits(&writer, 1, 2); // BTYPE = fixed Huffman
+
+    std::vector<int32_t> head((size_t)1 << PNG_HASH_BITS, -1);
+    size_t i = 0;
+    while(i < size)
+    {
+        uint32_t length = 0;
+        size_t distance = 0;
+        if(i + PNG_MIN_MATCH <= size)
+        {
+            uint32_t hash = HashTrigram(data + i);
+            int32_t candidate = head[hash];
+            head[hash] = (int32_t)i;
+            if(candidate >= 0 && i - candidate <= PNG_WINDOW_SIZE)
+            {
+                size_t maxLength = size - i < PNG_MAX_MATCH ? size - i : PNG_MAX_MATCH;
+                const uint8_t* a = data + candidate;
+                const uint8_t* b = data + i;
+                while(length < maxLength && a[length] == b[length])
+                    ++length;
+                distance = i - candidate;
+            }
+        }
+
+        if(length < PNG_MIN_MATCH)
+        {
+            PutBits(&writer, tables->literalCodes[data[i]], tables->literalBits[data[i]]);
+            ++i;
+            continue;
+        }
+
+        uint32_t lengthSymbol = tables->lengthSymbols[length];
+        uint32_t lengthIndex = lengthSymbol - 257;
+        PutBits(&writer, tables->literalCodes[lengthSymbol], tables->literalBits[lengthSymbol]);
+        PutBits(&writer, length - PngTables::lengthBase[lengthIndex], PngTables::lengthExtra[lengthIndex]);
+        size_t d = distance - 1;
+        uint32_t distanceSymbol = d < 256 ? tables->distanceSymbols[d] : tables->distanceSymbols[256 + (d >> 7)];
+        PutBits(&writer, tables->distanceCodes[distanceSymbol], 5);
+        PutBits(&writer, (uint32_t)(distance - PngTables::distanceBase[distanceSymbol]), PngTables::distanceExtra[distanceSymbol]);
+
+        // Index the covered positions so later matches can start inside this one
+        size_t end = i + length;
+        for(++i; i < end && i + PNG_MIN_MATCH <= size; ++i)
+            head[HashTrigram(data + i)] = (int32_t)i;
+        i = end;
+    }
+
+    PutBits(&writer, tables->literalCodes[256], tables->literalBits[256]); // end of block
+    for(; writer.numBits; writer.numBits = writer.numBits > 8 ? writer.numBits - 8 : 0)
+    {
+        *writer.out++ = (uint8_t)writer.bits;
+        writer.bits >>= 8;
+    }
+    return (size_t)(writer.out - out);
+}
+
+static void PutU32BE(std::vector<uint8_t>* out, uint32_t value)
+{
+    uint8_t bytes[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value };
+    out->insert(out->end(), bytes, bytes + 4);
+}
+
+static void PutChunk(const PngTables* tables, std::vector<uint8_t>* png, const char* type, const uint8_t* data, size_t size)
+{
+    PutU32BE(png, (uint32_t)size);
+    size_t start = png->size();
+    png->insert(png->end(), type, type + 4);
+    png->insert(png->end(), data, data + size);
+    PutU32BE(png, Crc32(tables, png->data() + start, size + 4));
+}
+
+void FrameCapture_EncodePNG(const FrameImage* image, std::vector<uint8_t>* png)
+{
+    const PngTables* tables = GetPngTables();
+    size_t rowBytes = (size_t)image->width * 4 + 1;
+
+    // Filter type 1 (Sub) on every row: BGRA to RGBA, minus the pixel to the left
+    std::vector<uint8_t> filtered(rowBytes * image->height);
+    for(int y = 0; y < image->height; ++y)
+    {
+        uint8_t* row = &filtered[rowBytes * y];
+        const uint32_t* pixels = &image->pixels[(size_t)y * image->width];
+        row[0] = 1;
+        uint32_t left = 0;
+        for(int x = 0; x < image->width; ++x)
+        {
+            uint32_t pixel = pixels[x];
+            uint8_t* out = row + 1 + x * 4;
+            out[0] = (uint8_t)((pixel >> 16) - (left >> 16));
+            out[1] = (uint8_t)((pixel >> 8) - (left >> 8));
+            out[2] = (uint8_t)(pixel - left);
+            out[3] = (uint8_t)((pixel >> 24) - (left >> 24));
+            left = pixel;
+        }
+    }
+
+    // zlib header (deflate, 32k window, no dictionary), the block, Adler-32
+    std::vector<uint8_t> idat(2 + filtered.size() + filtered.size() / 8 + 64);
+    idat[0] = 0x78;
+    idat[1] = 0x01;
+    size_t compressedSize = Deflate(tables, filtered.data(), filtered.size(), idat.data() + 2);
+    idat.resize(2 + compressedSize);
+    uint32_t adler = Adler32(filtered.data(), filtered.size());
+    PutU32BE(&idat, adler);
+
+    uint8_t header[13] = {};
+    header[0] = (uint8_t)(image->width >> 24);
+    header[1] = (uint8_t)(image->width >> 16);
+    header[2] = (uint8_t)(image->width >> 8);
+    header[3] = (uint8_t)image->width;
+    header[4] = (uint8_t)(image->height >> 24);
+    header[5] = (uint8_t)(image->height >> 16);
+    header[6] = (uint8_t)(image->height >> 8);
+    header[7] = (uint8_t)image->height;
+    header[8] = 8; // bit depth
+    header[9] = 6; // RGBA
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    png->assign(signature, signature + sizeof(signature));
+    PutChunk(tables, png, "IHDR", header, sizeof(header));
+    PutChunk(tables, png, "IDAT", idat.data(), idat.size());
+    PutChunk(tables, png, "IEND", nullptr, 0);
+}
+
+static bool WriteFile(const char* path, const void* data, size_t size, const void* header = nullptr, size_t headerSize = 0)
+{
+    FILE* file = fopen(path, "wb");
+    if(!file)
+        return false;
+    bool ok = (!headerSize || fwrite(header, 1, headerSize, file) == headerSize) && fwrite(data, 1, size, file) == size;
+    ok &= fclose(file) == 0;
+    return ok;
+}
+
+bool FrameCapture_WritePNG(const FrameImage* image, const char* path)
+{
+    std::vector<uint8_t> png;
+    FrameCapture_EncodePNG(image, &png);
+    return WriteFile(path, png.data(), png.size());
+}
+
+bool FrameCapture_WriteRaw(const FrameImage* image, const char* path)
+{
+    FrameRawHeader header = { FRAME_RAW_MAGIC, (uint32_t)image->width, (uint32_t)image->height, 91 };
+    return WriteFile(path, image->pixels.data(), image->pixels.size() * sizeof(uint32_t), &header, sizeof(header));
+}
+
+bool FrameCapture_Write(const FrameImage* image, const char* path)
+{
+    size_t length = strlen(path);
+    if(length >= 4 && !strcmp(path + length - 4, ".raw"))
+        return FrameCapture_WriteRaw(image, path);
+    return FrameCapture_WritePNG(image, path);
+}
+
+bool FrameCapture_Load(FrameImage* image, const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if(!file)
+        return false;
+
+    FrameRawHeader header;
+    bool isRaw = fread(&header, sizeof(header), 1, file) == 1 && header.magic == FRAME_RAW_MAGIC;
+    if(isRaw)
+    {
+        bool ok = header.width && header.height && header.width <= FRAME_MAX_SIZE && header.height <= FRAME_MAX_SIZE;
+        if(ok)
+        {
+            image->width = (int)header.width;
+            image->height = (int)header.height;
+            image->pixels.resize((size_t)header.width * header.height);
+            ok = fread(image->pixels.data(), sizeof(uint32_t), image->pixels.size(), file) == image->pixels.size();
+        }
+        fclose(file);
+        return ok;
+    }
+    fclose(file);
+
+    int width, height, channels;
+    uint8_t* rgba = stbi_load(path, &width, &height, &channels, 4);
+    if(!rgba)
+        return false;
+    image->width = width;
+    image->height = height;
+    image->pixels.resize((size_t)width * height);
+    for(size_t i = 0; i < image->pixels.size(); ++i)
+    {
+        const uint8_t* p = rgba + i * 4;
+        image->pixels[i] = ((uint32_t)p[3] << 24) | ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    }
+    stbi_image_free(rgba);
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// CPU copies of rendered frames, for golden-image tests and bug reports.
+// Platform layers read their render target back (a staging texture on D3D11,
+// the framebuffer on the software renderer) into a FrameImage, which can be
+// written as PNG or raw and loaded back for comparison (see image_diff.h).
+//
+// The PNG encoder is tuned for throughput over size: Sub filter on every row
+// and a single fixed-Huffman deflate block with greedy, single-probe LZ77.
+// Rendered frames are mostly flat spans, which that handles well.
+//
+// Raw files are a FrameRawHeader followed by the pixels, tightly packed. No
+// compression or checksums, for when encode/decode time matters more than disk.
+
+#include "base.h"
+
+#include <vector>
+
+#define FRAME_RAW_MAGIC 0x57415246u // "FRAW"
+#define FRAME_MAX_SIZE 16384
+
+struct FrameRawHeader
+{
+  uint32_t magic;
+  uint32_t width;
+  uint32_t height;
+  uint32_t format; // 91, DXGI_FORMAT_B8G8R8A8_UNORM_SRGB
+};
+
+struct FrameImage
+{
+  int width;
+  int height;
+  std::vector<uint32_t> pixels; // B8G8R8A8 sRGB encoded, tightly packed rows
+};
+
+// rowPitch is in bytes, as D3D11_MAPPED_SUBRESOURCE::RowPitch.
+void FrameCapture_CopyRows(FrameImage* image, const void* pixels, int width, int height, size_t rowPitch);
+
+// Zlib-wrapped PNG, 8 bit RGBA.
+void FrameCapture_EncodePNG(const FrameImage* image, std::vector<uint8_t>* png);
+bool FrameCapture_WritePNG(const FrameImage* image, const char* path);
+bool FrameCapture_WriteRaw(const FrameImage* image, const char* path);
+// PNG/raw by extension.
+bool FrameCapture_Write(const FrameImage* image, const char* path);
+
+// Raw files by their magic, anything else through stb_image.
+bool FrameCapture_Load(FrameImage* image, const char* path);
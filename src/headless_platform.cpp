@@ -0,0 +1,1202 @@
+// Headless platform layer: runs the triangle pipeline through the software
+// renderer so machines without a GPU (CI, render farm) can produce frames.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "profiler.cpp"
+#include "memory.cpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "vendor/stb_image.h"
+
+#include "sw_renderer.cpp"
+#include "mapped_file.cpp"
+#include "shader_cache.cpp"
+#include "quad_batch.cpp"
+#include "job_system.cpp"
+#include "command_buffer.cpp"
+#include "vertex_pack.cpp"
+#include "texture_process.cpp"
+#include "texture_streamer.cpp"
+#include "input_queue.cpp"
+#include "simulation.cpp"
+#include "scene_gen.cpp"
+#include "frame_capture.cpp"
+#include "image_diff.cpp"
+
+static bool WriteTGA(const char* path, SoftwareFramebuffer fb)
+{
+    FILE* file = fopen(path, "wb");
+    if(!file)
+        return false;
+
+    // Uncompressed true-colour, 32bpp, top-left origin. TGA stores BGRA, same as the framebuffer.
+    uint8_t header[18] = {};
+    header[2] = 2;
+    header[12] = (uint8_t)(fb.width & 0xFF);
+    header[13] = (uint8_t)(fb.width >> 8);
+    header[14] = (uint8_t)(fb.height & 0xFF);
+    header[15] = (uint8_t)(fb.height >> 8);
+    header[16] = 32;
+    header[17] = 0x28;
+    fwrite(header, 1, sizeof(header), file);
+    for(int y = 0; y < fb.height; ++y)
+        fwrite(fb.pixels + (size_t)y * fb.pitch, sizeof(uint32_t), fb.width, file);
+
+    fclose(file);
+    return true;
+}
+
+static uint64_t HashFramebuffer(SoftwareFramebuffer fb)
+{
+    // FNV-1a over the visible pixels, handy for comparing runs
+    uint64_t hash = FNV1A64_INITIAL;
+    for(int y = 0; y < fb.height; ++y)
+        hash = Fnv1a64(fb.pixels + (size_t)y * fb.pitch, fb.width * sizeof(uint32_t), hash);
+    return hash;
+}
+
+// Stand-in for D3DCompileFromFile: reads the source and sleeps for roughly what
+// fxc takes on a small shader, so cold vs warm cache timings are meaningful.
+static bool CompileShaderStub(const ShaderDesc* desc, std::vector<uint8_t>* bytecode, std::string* errors, void* /*userData*/)
+{
+    std::string source;
+    if(!ReadWholeFile(desc->path, &source)) {
+        *errors = "Could not compile shader; file not found";
+        return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    uint64_t hash = Fnv1a64(source.data(), source.size());
+    bytecode->assign((const uint8_t*)&hash, (const uint8_t*)&hash + sizeof(hash));
+    bytecode->insert(bytecode->end(), source.begin(), source.end());
+    return true;
+}
+
+static int RunShaderCacheTest(const char* cachePath, int numThreads)
+{
+    ShaderDesc shaderDescs[2] = {};
+    shaderDescs[0].path = "res/shaders/basic_vs.hlsl";
+    shaderDescs[0].entryPoint = "VSMain";
+    shaderDescs[0].profile = "vs_5_0";
+    shaderDescs[1].path = "res/shaders/basic_ps.hlsl";
+    shaderDescs[1].entryPoint = "PSMain";
+    shaderDescs[1].profile = "ps_5_0";
+    ShaderResult shaderResults[2];
+
+    remove(cachePath);
+    std::vector<uint8_t> coldBytecode[2];
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        ShaderCache shaderCache;
+        double start = GetSeconds();
+        ShaderCache_Open(&shaderCache, cachePath, 1);
+        ShaderCache_Get(&shaderCache, shaderDescs, shaderResults, ArrayCount(shaderDescs), &CompileShaderStub, 0, numThreads);
+        double elapsed = GetSeconds() - start;
+
+        for(uint32_t i = 0; i < ArrayCount(shaderResults); ++i)
+        {
+            if(!shaderResults[i].ok) {
+                fprintf(stderr, "%s: %s\n", shaderDescs[i].path, shaderResults[i].errors.c_str());
+                ShaderCache_Close(&shaderCache);
+                return 1;
+            }
+            const uint8_t* bytecode = (const uint8_t*)shaderResults[i].bytecode;
+            if(pass == 0)
+                coldBytecode[i].assign(bytecode, bytecode + shaderResults[i].size);
+            else if(coldBytecode[i].size() != shaderResults[i].size || memcmp(coldBytecode[i].data(), bytecode, shaderResults[i].size) != 0) {
+                fprintf(stderr, "%s: cached bytecode differs from compiled bytecode\n", shaderDescs[i].path);
+                ShaderCache_Close(&shaderCache);
+                return 1;
+            }
+        }
+        printf("%s: %u hits, %u misses, %.3f ms\n", pass == 0 ? "cold" : "warm",
+               shaderCache.numHits, shaderCache.numMisses, elapsed * 1000.0);
+
+        if(!ShaderCache_Save(&shaderCache)) {
+            fprintf(stderr, "Could not write %s\n", cachePath);
+            ShaderCache_Close(&shaderCache);
+            return 1;
+        }
+        ShaderCache_Close(&shaderCache);
+    }
+    return 0;
+}
+
+// Stands in for the D3D11 dynamic instance buffer and checks every draw: each
+// instance carries its texture id in the colour so a bad gather or sort shows up.
+struct FakeQuadTarget
+{
+    std::vector<QuadInstance> buffer;
+    uint64_t lastKey;
+    uint32_t numDrawn;
+    bool valid;
+};
+
+static void* FakeQuadMap(QuadMapMode /*mode*/, void* userData)
+{
+    return ((FakeQuadTarget*)userData)->buffer.data();
+}
+
+static void FakeQuadUnmap(void* /*userData*/)
+{
+}
+
+static void FakeQuadDraw(uint64_t sortKey, uint32_t firstInstance, uint32_t instanceCount, void* userData)
+{
+    FakeQuadTarget* target = (FakeQuadTarget*)userData;
+    if(sortKey < target->lastKey || firstInstance + instanceCount > target->buffer.size())
+        target->valid = false;
+    for(uint32_t i = 0; i < instanceCount && target->valid; ++i)
+        target->valid = (target->buffer[firstInstance + i].color & 0xFFFFFF) == (sortKey & 0xFFFFFF);
+    target->lastKey = sortKey;
+    target->numDrawn += instanceCount;
+}
+
+// Expands one instance into the triangle strip quad_vs.hlsl produces and
+// rasterizes it, which culls back faces like the D3D11 default rasterizer
+// state. Both triangles have to be front facing to cover the whole rect.
+static bool CheckQuadCoverage()
+{
+    const int size = 64;
+    QuadInstance instance = { { -0.5f, -0.5f, 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 1.0f }, 0xFFFFFFFFu };
+    BasicVertex strip[4];
+    for(uint32_t vertexId = 0; vertexId < 4; ++vertexId)
+    {
+        float cornerX = (float)(vertexId >> 1);
+        float cornerY = (float)(vertexId & 1);
+        strip[vertexId] = { { instance.rect[0] + cornerX * instance.rect[2], instance.rect[1] + cornerY * instance.rect[3] },
+                            { 1.0f, 1.0f, 1.0f, 1.0f } };
+    }
+    // Odd triangles of a strip swap their first two vertices to keep the winding
+    BasicVertex triangles[6] = { strip[0], strip[1], strip[2], strip[2], strip[1], strip[3] };
+
+    SoftwareRenderer* renderer = SoftwareRenderer_Create(size, size, 1);
+    const float black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    SoftwareRenderer_Clear(renderer, black);
+    SoftwareRenderer_SetViewport(renderer, { 0.0f, 0.0f, (float)size, (float)size });
+    SoftwareRenderer_Draw(renderer, triangles, BasicVertexFormat::stride, 6);
+    SoftwareRenderer_Flush(renderer);
+
+    SoftwareFramebuffer fb = SoftwareRenderer_GetFramebuffer(renderer);
+    int numCovered = 0;
+    for(int y = 0; y < fb.height; ++y)
+        for(int x = 0; x < fb.width; ++x)
+            numCovered += fb.pixels[(size_t)y * fb.pitch + x] == 0xFFFFFFFFu;
+    SoftwareRenderer_Destroy(renderer);
+
+    int expected = (size / 2) * (size / 2);
+    if(numCovered != expected) {
+        fprintf(stderr, "quad strip covers %d pixels, expected %d\n", numCovered, expected);
+        return false;
+    }
+    return true;
+}
+
+static int RunQuadBatchTest(uint32_t numQuads, int numFrames)
+{
+    if(!CheckQuadCoverage())
+        return 1;
+
+    const uint32_t ringCapacity = 64 * 1024;
+    QuadBatch batch;
+    QuadBatch_Init(&batch, ringCapacity);
+    FakeQuadTarget target;
+    target.buffer.resize(ringCapacity);
+    QuadBackend backend = { FakeQuadMap, FakeQuadUnmap, FakeQuadDraw, &target };
+
+    uint32_t state = 1234;
+    auto next = [&state]() { state = state * 1664525u + 1013904223u; return state >> 8; };
+
+    double addSeconds = 0.0;
+    double flushSeconds = 0.0;
+    QuadBatchStats stats = {};
+    uint32_t numDiscards = 0;
+    for(int frame = 0; frame < numFrames; ++frame)
+    {
+        double start = GetSeconds();
+        for(uint32_t i = 0; i < numQuads; ++i)
+        {
+            // A handful of layers/shaders and 64 textures, in random order
+            uint32_t texture = next() & 63;
+            uint64_t key = QuadBatch_MakeKey((uint16_t)(next() & 3), (uint16_t)(next() & 1), texture);
+            float rect[4] = { (float)(next() & 1023) / 512.0f - 1.0f, (float)(next() & 1023) / 512.0f - 1.0f, 0.02f, 0.02f };
+            float uvRect[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+            QuadBatch_Add(&batch, key, rect, uvRect, 0xFF000000u | texture);
+        }
+        double added = GetSeconds();
+
+        target.lastKey = 0;
+        target.numDrawn = 0;
+        target.valid = true;
+        QuadBatch_Flush(&batch, &backend, &stats);
+        double flushed = GetSeconds();
+        if(!target.valid || target.numDrawn != numQuads) {
+            fprintf(stderr, "frame %d: batched draws don't match the submitted quads\n", frame);
+            return 1;
+        }
+
+        addSeconds += added - start;
+        flushSeconds += flushed - added;
+        numDiscards += stats.numDiscards;
+        Profiler_FrameMark();
+    }
+
+    double totalQuads = (double)numQuads * numFrames;
+    printf("%u quads x %d frames, ring %u instances\n", numQuads, numFrames, ringCapacity);
+    printf("draws per frame: %u, maps per frame: %u, discards total: %u\n", stats.numDraws, stats.numMaps, numDiscards);
+    printf("add: %.1f quads/ms, flush (sort + stream): %.1f quads/ms\n",
+           totalQuads / (addSeconds * 1000.0), totalQuads / (flushSeconds * 1000.0));
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////
+// Command buffer recording benchmark
+
+struct SceneObject
+{
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    uint32_t shader;
+};
+
+struct SceneRecordJob
+{
+    const float* vertexData; // x, y, r, g, b, a
+    const SceneObject* objects;
+    uint32_t numObjects;
+    uint32_t numChunks;
+    CommandBuffer* buffers; // one per chunk
+};
+
+// Bounds test against clip space, the per-object work a real scene walk does before submitting
+static bool IsSceneObjectVisible(const float* vertexData, const SceneObject* object)
+{
+    float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+    for(uint32_t v = 0; v < object->vertexCount; ++v)
+    {
+        const float* vertex = vertexData + (size_t)(object->firstVertex + v) * 6;
+        minX = vertex[0] < minX ? vertex[0] : minX;
+        maxX = vertex[0] > maxX ? vertex[0] : maxX;
+        minY = vertex[1] < minY ? vertex[1] : minY;
+        maxY = vertex[1] > maxY ? vertex[1] : maxY;
+    }
+    return maxX >= -1.0f && minX <= 1.0f && maxY >= -1.0f && minY <= 1.0f;
+}
+
+static void RecordSceneChunk(void* data, uint32_t chunk)
+{
+    SceneRecordJob* job = (SceneRecordJob*)data;
+    uint32_t begin = (uint32_t)((uint64_t)job->numObjects * chunk / job->numChunks);
+    uint32_t end = (uint32_t)((uint64_t)job->numObjects * (chunk + 1) / job->numChunks);
+    CommandBuffer* buffer = &job->buffers[chunk];
+    CommandBuffer_Reset(buffer);
+    for(uint32_t i = begin; i < end; ++i)
+    {
+        const SceneObject* object = &job->objects[i];
+        if(!IsSceneObjectVisible(job->vertexData, object))
+            continue;
+        CommandBuffer_SetShader(buffer, object->shader);
+        CommandBuffer_SetVertexBuffer(buffer, 0, BasicVertexFormat::stride, 0);
+        CommandBuffer_Draw(buffer, object->vertexCount, object->firstVertex);
+    }
+}
+
+struct NullCommandTarget
+{
+    uint32_t numCommands;
+    uint32_t numDraws;
+    uint64_t numVertices;
+};
+
+static void NullCommandClear(const float* /*color*/, void* userData) { ((NullCommandTarget*)userData)->numCommands++; }
+static void NullCommandSetViewport(float, float, float, float, void* userData) { ((NullCommandTarget*)userData)->numCommands++; }
+static void NullCommandSetShader(uint32_t, void* userData) { ((NullCommandTarget*)userData)->numCommands++; }
+static void NullCommandSetVertexBuffer(uint32_t, uint32_t, uint32_t, void* userData) { ((NullCommandTarget*)userData)->numCommands++; }
+static void NullCommandDraw(uint32_t vertexCount, uint32_t /*startVertex*/, void* userData)
+{
+    NullCommandTarget* target = (NullCommandTarget*)userData;
+    target->numCommands++;
+    target->numDraws++;
+    target->numVertices += vertexCount;
+}
+
+// Replays into the software rasterizer. It has a single fixed shading model,
+// so shader handles are accepted and ignored.
+struct SwCommandTarget
+{
+    SoftwareRenderer* renderer;
+    const uint8_t* vertexBuffers[1];
+    const uint8_t* currentVertices;
+    uint32_t currentStride;
+};
+
+static void SwCommandClear(const float* color, void* userData)
+{
+    SoftwareRenderer_Clear(((SwCommandTarget*)userData)->renderer, color);
+}
+
+static void SwCommandSetViewport(float x, float y, float width, float height, void* userData)
+{
+    SoftwareRenderer_SetViewport(((SwCommandTarget*)userData)->renderer, { x, y, width, height });
+}
+
+static void SwCommandSetShader(uint32_t /*shader*/, void* /*userData*/)
+{
+}
+
+static void SwCommandSetVertexBuffer(uint32_t buffer, uint32_t stride, uint32_t offset, void* userData)
+{
+    SwCommandTarget* target = (SwCommandTarget*)userData;
+    target->currentVertices = target->vertexBuffers[buffer] + offset;
+    target->currentStride = stride;
+}
+
+static void SwCommandDraw(uint32_t vertexCount, uint32_t startVertex, void* userData)
+{
+    SwCommandTarget* target = (SwCommandTarget*)userData;
+    SoftwareRenderer_Draw(target->renderer, target->currentVertices + (size_t)startVertex * target->currentStride, target->currentStride, vertexCount);
+}
+
+static int RunCommandBufferTest(uint32_t numObjects, int numFrames, int numThreads, int width, int height)
+{
+    const uint32_t trisPerObject = 4;
+    const float backgroundColor[4] = { 0.1f, 0.2f, 0.6f, 1.0f };
+    std::vector<float> vertexData;
+    SceneGen_RandomTriangles(&vertexData, numObjects * trisPerObject, 1234);
+    std::vector<SceneObject> objects(numObjects);
+    for(uint32_t i = 0; i < numObjects; ++i)
+        objects[i] = { i * trisPerObject * 3, trisPerObject * 3, (i / 16) % 4 };
+
+    // The generator keeps everything inside clip space; push every fourth
+    // object out past the right edge so the recorders have something to cull
+    uint32_t numOffscreen = 0;
+    for(uint32_t i = 3; i < numObjects; i += 4, ++numOffscreen)
+    {
+        for(uint32_t v = 0; v < objects[i].vertexCount; ++v)
+            vertexData[(size_t)(objects[i].firstVertex + v) * 6] += 3.0f;
+    }
+
+    JobSystem* jobSystem = JobSystem_Create(numThreads);
+    uint32_t numChunks = (uint32_t)JobSystem_GetThreadCount(jobSystem) * 4;
+    std::vector<CommandBuffer> chunkBuffers(numChunks);
+    CommandBuffer serialBuffer;
+    CommandBuffer merged;
+    SceneRecordJob serialJob = { vertexData.data(), objects.data(), numObjects, 1, &serialBuffer };
+    SceneRecordJob parallelJob = { vertexData.data(), objects.data(), numObjects, numChunks, chunkBuffers.data() };
+
+    MemoryArena frameArena;
+    MemoryArena_Init(&frameArena, 1 << 20, "Frame");
+
+    NullCommandTarget nullTarget = {};
+    CommandBackend nullBackend = { NullCommandClear, NullCommandSetViewport, NullCommandSetShader, NullCommandSetVertexBuffer, NullCommandDraw, &nullTarget };
+
+    double serialSeconds = 0.0, parallelSeconds = 0.0, mergeSeconds = 0.0, replaySeconds = 0.0;
+    for(int frame = 0; frame < numFrames; ++frame)
+    {
+        MemoryArena_Reset(&frameArena);
+        double start = GetSeconds();
+        RecordSceneChunk(&serialJob, 0);
+        double recordedSerial = GetSeconds();
+        JobSystem_ParallelFor(jobSystem, RecordSceneChunk, &parallelJob, numChunks, &frameArena);
+        double recordedParallel = GetSeconds();
+
+        CommandBuffer_Reset(&merged);
+        CommandBuffer_Clear(&merged, backgroundColor);
+        CommandBuffer_SetViewport(&merged, 0.0f, 0.0f, (float)width, (float)height);
+        for(uint32_t i = 0; i < numChunks; ++i)
+            CommandBuffer_Append(&merged, &chunkBuffers[i]);
+        double mergedTime = GetSeconds();
+
+        nullTarget = {};
+        CommandBuffer_Replay(&merged, &nullBackend);
+        double replayed = GetSeconds();
+
+        serialSeconds += recordedSerial - start;
+        parallelSeconds += recordedParallel - recordedSerial;
+        mergeSeconds += mergedTime - recordedParallel;
+        replaySeconds += replayed - mergedTime;
+        Profiler_FrameMark();
+    }
+
+    // The merged stream has to produce the same image as submitting directly
+    SoftwareRenderer* renderer = SoftwareRenderer_Create(width, height, numThreads);
+    SwCommandTarget swTarget = { renderer, { (const uint8_t*)vertexData.data() }, 0, 0 };
+    CommandBackend swBackend = { SwCommandClear, SwCommandSetViewport, SwCommandSetShader, SwCommandSetVertexBuffer, SwCommandDraw, &swTarget };
+    CommandBuffer_Replay(&merged, &swBackend);
+    SoftwareRenderer_Flush(renderer);
+    uint64_t replayHash = HashFramebuffer(SoftwareRenderer_GetFramebuffer(renderer));
+
+    SoftwareRenderer_Clear(renderer, backgroundColor);
+    SoftwareRenderer_SetViewport(renderer, { 0.0f, 0.0f, (float)width, (float)height });
+    for(uint32_t i = 0; i < numObjects; ++i)
+    {
+        if(IsSceneObjectVisible(vertexData.data(), &objects[i]))
+            SoftwareRenderer_Draw(renderer, vertexData.data() + (size_t)objects[i].firstVertex * 6, BasicVertexFormat::stride, objects[i].vertexCount);
+    }
+    SoftwareRenderer_Flush(renderer);
+    uint64_t directHash = HashFramebuffer(SoftwareRenderer_GetFramebuffer(renderer));
+    SoftwareRenderer_Destroy(renderer);
+
+    printf("%u objects x %d frames, %d job threads, %u chunks\n", numObjects, numFrames, JobSystem_GetThreadCount(jobSystem), numChunks);
+    uint32_t numCulled = numObjects - nullTarget.numDraws;
+    printf("commands per frame: %u (%u draws, %u culled, %u bytes)\n", nullTarget.numCommands, nullTarget.numDraws,
+           numCulled, (uint32_t)merged.data.size());
+    printf("record serial: %.3f ms, record parallel: %.3f ms (%.2fx)\n", serialSeconds * 1000.0 / numFrames,
+           parallelSeconds * 1000.0 / numFrames, serialSeconds / parallelSeconds);
+    printf("merge: %.3f ms, null replay: %.3f ms (%.1f commands/ms)\n", mergeSeconds * 1000.0 / numFrames,
+           replaySeconds * 1000.0 / numFrames, (double)nullTarget.numCommands * numFrames / (replaySeconds * 1000.0));
+    printf("software replay hash: %016llx, direct: %016llx\n", (unsigned long long)replayHash, (unsigned long long)directHash);
+
+    JobSystem_Destroy(jobSystem);
+    MemoryArena_Release(&frameArena);
+    if(numCulled != numOffscreen) {
+        fprintf(stderr, "culled %u objects, expected the %u placed off screen\n", numCulled, numOffscreen);
+        return 1;
+    }
+    return replayHash == directHash ? 0 : 1;
+}
+
+////////////////////////////////////////////////////////////////
+// Vertex packing benchmark
+
+static int RunVertexPackTest(uint32_t numVerts, int numFrames)
+{
+    std::vector<float> vertexData;
+    SceneGen_RandomTriangles(&vertexData, (numVerts + 2) / 3, 1234);
+    vertexData.resize((size_t)numVerts * 6);
+    // Edge cases for the half conversion: overflow, inf, NaN, denormals, ties
+    const float specials[] = { 65504.0f, 65520.0f, 1e10f, INFINITY, -INFINITY, NAN, 1e-5f, -6e-8f, 3e-8f, 1.0f + 1.0f / 2048.0f, -0.0f };
+    for(uint32_t i = 0; i < ArrayCount(specials) && i < numVerts; ++i)
+        vertexData[i * 6] = specials[i];
+
+    const VertexPackPath paths[] = { VertexPackPath_Scalar, VertexPackPath_SSE2, VertexPackPath_AVX2 };
+    const char* pathNames[] = { "scalar", "SSE2", "AVX2" };
+    std::vector<PackedVertex> reference(numVerts);
+    std::vector<PackedVertex> packed(numVerts);
+    printf("%u vertices, %u -> %u bytes per vertex\n", numVerts, BasicVertexFormat::stride, PackedVertexFormat::stride);
+
+    int result = 0;
+    for(uint32_t p = 0; p < ArrayCount(paths); ++p)
+    {
+        if(VertexPack_SetPath(paths[p]) != paths[p])
+            continue;
+        double bestSeconds = 1e30;
+        for(int frame = 0; frame < numFrames; ++frame)
+        {
+            double start = GetSeconds();
+            VertexPack_Convert<BasicVertexFormat, PackedVertexFormat>(vertexData.data(), packed.data(), numVerts);
+            double elapsed = GetSeconds() - start;
+            bestSeconds = elapsed < bestSeconds ? elapsed : bestSeconds;
+        }
+        if(p == 0)
+            reference = packed;
+        bool matches = memcmp(reference.data(), packed.data(), numVerts * sizeof(PackedVertex)) == 0;
+        printf("%-6s: %.3f ms, %.1f Mverts/s, %s\n", pathNames[p], bestSeconds * 1000.0,
+               numVerts / (bestSeconds * 1e6), matches ? "matches scalar" : "DIFFERS from scalar");
+        if(!matches)
+            result = 1;
+    }
+    VertexPack_SetPath(VertexPackPath_AVX2);
+
+    // Half positions must round-trip within half a ulp of the half format
+    double maxError = 0.0;
+    for(uint32_t i = ArrayCount(specials); i < numVerts; ++i)
+    {
+        for(int c = 0; c < 2; ++c)
+        {
+            float value = vertexData[(size_t)i * 6 + c];
+            double error = fabs((double)VertexPack_HalfToFloat(reference[i].position[c]) - value);
+            int exponent = value != 0.0f ? ilogbf(value) : -14;
+            double ulp = ldexp(1.0, (exponent < -14 ? -14 : exponent) - 10); // denormals share one ulp
+            maxError = error / ulp > maxError ? error / ulp : maxError;
+        }
+    }
+    printf("max position error: %.3f half ulp\n", maxError);
+    return maxError <= 0.5 ? result : 1;
+}
+
+////////////////////////////////////////////////////////////////
+// Allocator benchmark
+
+static uint64_t DecodeAndHash(const std::string& fileData, MemoryArena* arena)
+{
+    MemoryArena* previousArena = Memory_BindStbiArena(arena);
+    int width, height, channels;
+    uint8_t* rgba = stbi_load_from_memory((const stbi_uc*)fileData.data(), (int)fileData.size(), &width, &height, &channels, 4);
+    uint64_t hash = rgba ? Fnv1a64(rgba, (size_t)width * height * 4) : 0;
+    stbi_image_free(rgba);
+    Memory_BindStbiArena(previousArena);
+    if(arena)
+        MemoryArena_Reset(arena);
+    return hash;
+}
+
+// Small render object stand-in, the kind of thing pools are for
+struct PoolTestObject
+{
+    float transform[12];
+    uint32_t mesh;
+    uint32_t material;
+};
+
+static int RunAllocatorBench(const char* imagePath, int numFrames)
+{
+    // Decode from memory so file IO doesn't hide the allocator cost
+    std::string fileData;
+    if(!ReadWholeFile(imagePath, &fileData)) {
+        fprintf(stderr, "Could not read %s\n", imagePath);
+        return 1;
+    }
+
+    MemoryArena scratch;
+    if(!MemoryArena_Init(&scratch, 64 << 20, "Decode Scratch")) {
+        fprintf(stderr, "Could not allocate the scratch arena\n");
+        return 1;
+    }
+
+    // Alternate the two so neither gets the warmer caches
+    uint64_t heapHash = DecodeAndHash(fileData, nullptr);
+    uint64_t arenaHash = DecodeAndHash(fileData, &scratch);
+    double heapSeconds = 0.0, arenaSeconds = 0.0;
+    double heapBest = 1e30, arenaBest = 1e30;
+    bool hashesMatch = heapHash != 0 && heapHash == arenaHash;
+    for(int frame = 0; frame < numFrames; ++frame)
+    {
+        double start = GetSeconds();
+        hashesMatch &= DecodeAndHash(fileData, nullptr) == heapHash;
+        double heapElapsed = GetSeconds() - start;
+        start = GetSeconds();
+        hashesMatch &= DecodeAndHash(fileData, &scratch) == heapHash;
+        double arenaElapsed = GetSeconds() - start;
+
+        heapSeconds += heapElapsed;
+        arenaSeconds += arenaElapsed;
+        heapBest = heapElapsed < heapBest ? heapElapsed : heapBest;
+        arenaBest = arenaElapsed < arenaBest ? arenaElapsed : arenaBest;
+    }
+
+    uint32_t numDecodes = scratch.numResets;
+    printf("%s x %d decodes\n", imagePath, numFrames);
+    printf("default allocator: avg %.3f ms, best %.3f ms\n", heapSeconds * 1000.0 / numFrames, heapBest * 1000.0);
+    printf("scratch arena    : avg %.3f ms, best %.3f ms (%.2fx)\n", arenaSeconds * 1000.0 / numFrames, arenaBest * 1000.0,
+           heapSeconds / arenaSeconds);
+    printf("scratch arena    : high water %.2f MB, %.1f allocations per decode, %llu spilled to the heap\n",
+           scratch.highWater / (1024.0 * 1024.0), (double)scratch.numAllocs / numDecodes, (unsigned long long)scratch.numFailed);
+    printf("pixels %s\n", hashesMatch ? "match" : "DIFFER");
+    MemoryArena_Release(&scratch);
+
+    // Pool vs heap under create/destroy churn with a stable live set
+    const uint32_t numLive = 4096;
+    const uint32_t numOps = 1 << 22;
+    MemoryPool pool;
+    MemoryPool_Init(&pool, sizeof(PoolTestObject), numLive, "Render Objects");
+    std::vector<void*> live(numLive);
+    double poolSeconds = 0.0, heapPoolSeconds = 0.0;
+    for(int usePool = 0; usePool < 2; ++usePool)
+    {
+        uint32_t state = 1234;
+        double start = GetSeconds();
+        for(uint32_t i = 0; i < numLive; ++i)
+            live[i] = usePool ? MemoryPool_Alloc(&pool) : malloc(sizeof(PoolTestObject));
+        for(uint32_t op = 0; op < numOps; ++op)
+        {
+            state = state * 1664525u + 1013904223u;
+            uint32_t slot = (state >> 8) % numLive;
+            if(usePool) {
+                MemoryPool_Free(&pool, live[slot]);
+                live[slot] = MemoryPool_Alloc(&pool);
+            } else {
+                free(live[slot]);
+                live[slot] = malloc(sizeof(PoolTestObject));
+            }
+            ((PoolTestObject*)live[slot])->mesh = op;
+        }
+        for(uint32_t i = 0; i < numLive; ++i)
+        {
+            if(usePool)
+                MemoryPool_Free(&pool, live[i]);
+            else
+                free(live[i]);
+        }
+        (usePool ? poolSeconds : heapPoolSeconds) = GetSeconds() - start;
+    }
+    printf("%u-byte objects, %u live, %u free+alloc pairs\n", (uint32_t)sizeof(PoolTestObject), numLive, numOps);
+    printf("malloc/free: %.1f ns per pair\n", heapPoolSeconds * 1e9 / numOps);
+    printf("pool       : %.1f ns per pair (%.2fx), high water %u of %u slots, %llu failed\n", poolSeconds * 1e9 / numOps,
+           heapPoolSeconds / poolSeconds, pool.highWater, pool.capacity, (unsigned long long)pool.numFailed);
+    MemoryPool_Release(&pool);
+
+    return hashesMatch ? 0 : 1;
+}
+
+////////////////////////////////////////////////////////////////
+// Texture streaming benchmark
+
+// Stand-in for GPU textures: keeps a CPU copy of every resident mip and checks
+// the streamer only uploads into storage it asked for.
+struct FakeStreamTexture
+{
+    uint32_t firstMip;
+    uint32_t numMips;
+    std::vector<uint8_t> mips[TEXTURE_STREAMER_MAX_MIPS];
+};
+
+struct FakeStreamTarget
+{
+    std::vector<FakeStreamTexture> textures;
+    uint64_t residentBytes;
+    uint32_t numResizes;
+    uint32_t numErrors;
+};
+
+static void FakeStreamResize(uint32_t texture, const TextureStreamInfo* info, uint32_t firstMip, uint32_t previousFirstMip, void* userData)
+{
+    FakeStreamTarget* target = (FakeStreamTarget*)userData;
+    if(texture >= target->textures.size())
+    {
+        FakeStreamTexture empty;
+        empty.firstMip = TEXTURE_STREAMER_MAX_MIPS;
+        empty.numMips = 0;
+        target->textures.resize(texture + 1, empty);
+    }
+    FakeStreamTexture* fake = &target->textures[texture];
+    if(fake->numMips == 0) {
+        fake->numMips = info->numMips;
+        fake->firstMip = info->numMips;
+    }
+    if(fake->firstMip != previousFirstMip || fake->numMips != info->numMips || firstMip >= info->numMips)
+        target->numErrors++;
+
+    for(uint32_t mip = 0; mip < info->numMips; ++mip)
+    {
+        std::vector<uint8_t>* pixels = &fake->mips[mip];
+        target->residentBytes -= pixels->size();
+        if(mip < firstMip)
+            std::vector<uint8_t>().swap(*pixels);
+        else
+            pixels->resize(TextureStreamer_MipBytes(info, mip));
+        target->residentBytes += pixels->size();
+    }
+    fake->firstMip = firstMip;
+    target->numResizes++;
+}
+
+static void FakeStreamUpload(uint32_t texture, uint32_t mip, uint32_t width, uint32_t height, const uint8_t* pixels, void* userData)
+{
+    FakeStreamTarget* target = (FakeStreamTarget*)userData;
+    if(texture >= target->textures.size() || mip < target->textures[texture].firstMip ||
+       target->textures[texture].mips[mip].size() != (size_t)width * height * 4) {
+        target->numErrors++;
+        return;
+    }
+    memcpy(target->textures[texture].mips[mip].data(), pixels, (size_t)width * height * 4);
+}
+
+static int RunTextureStreamTest(const char* imagePath, uint32_t numTextures, int numFrames, int numThreads, double budgetMB, double frameBudgetMs)
+{
+    const double frameSeconds = 1.0 / 60.0;
+    FakeStreamTarget target = {};
+    TextureStreamerDesc desc = {};
+    desc.numThreads = numThreads;
+    desc.memoryBudget = budgetMB > 0.0 ? (uint64_t)(budgetMB * 1024.0 * 1024.0) : ~0ull;
+    desc.mipFilter = MipFilter_Box;
+    desc.backend = { FakeStreamResize, FakeStreamUpload, &target };
+    TextureStreamer* streamer = TextureStreamer_Create(&desc);
+
+    // Every request decodes the file again, so N requests are N distinct loads
+    double start = GetSeconds();
+    std::vector<uint32_t> textures(numTextures);
+    for(uint32_t i = 0; i < numTextures; ++i)
+        textures[i] = TextureStreamer_Request(streamer, imagePath);
+
+    // A camera panning across the set: a quarter of the textures are on screen
+    // and want their top mip, the window moves one texture per frame.
+    uint32_t numVisible = numTextures > 4 ? numTextures / 4 : 1;
+    std::vector<double> updateMs;
+    double allLoadedSeconds = 0.0;
+    uint64_t allLoadedBytes = 0;
+    bool overBudget = false;
+    int frame = 0;
+    for(; frame < numFrames || !allLoadedSeconds; ++frame)
+    {
+        double frameStart = GetSeconds();
+        for(uint32_t i = 0; i < numVisible; ++i)
+            TextureStreamer_MarkSampled(streamer, textures[(frame + i) % numTextures], 0);
+
+        double updateStart = GetSeconds();
+        TextureStreamer_Update(streamer, frameBudgetMs / 1000.0);
+        updateMs.push_back((GetSeconds() - updateStart) * 1000.0);
+        Profiler_FrameMark();
+
+        TextureStreamerStats stats;
+        TextureStreamer_GetStats(streamer, &stats);
+        overBudget |= stats.residentBytes > desc.memoryBudget || stats.residentBytes != target.residentBytes;
+        if(!allLoadedSeconds && stats.numLoaded + stats.numFailed >= numTextures) {
+            allLoadedSeconds = GetSeconds() - start;
+            allLoadedBytes = stats.bytesUploaded;
+        }
+        if(frame > 100000)
+            break;
+
+        // The rest of the frame goes to the workers
+        double remaining = frameSeconds - (GetSeconds() - frameStart);
+        if(remaining > 0.0)
+            std::this_thread::sleep_for(std::chrono::duration<double>(remaining));
+    }
+
+    TextureStreamerStats stats;
+    TextureStreamer_GetStats(streamer, &stats);
+    uint32_t numIncomplete = 0;
+    for(uint32_t i = 0; i < numTextures; ++i)
+    {
+        TextureStreamResidency residency;
+        TextureStreamer_GetResidency(streamer, textures[i], &residency);
+        numIncomplete += residency.failed || residency.firstValidMip >= residency.info.numMips;
+    }
+    TextureStreamer_Destroy(streamer);
+
+    std::vector<double> sortedMs = updateMs;
+    std::sort(sortedMs.begin(), sortedMs.end());
+    auto percentile = [&](double p) { return sortedMs[std::min(sortedMs.size() - 1, (size_t)(p * sortedMs.size()))]; };
+    uint32_t numHitches = 0;
+    for(size_t i = 0; i < updateMs.size(); ++i)
+        numHitches += updateMs[i] > frameBudgetMs * 2.0;
+
+    printf("%u x %s, %d frames, budget %s, %.1f ms per frame\n", numTextures, imagePath, frame,
+           budgetMB > 0.0 ? "limited" : "unlimited", frameBudgetMs);
+    printf("all loaded after %.1f ms (%.1f MB/s), %.1f MB in %u mips uploaded over the run\n", allLoadedSeconds * 1000.0,
+           allLoadedBytes / (1024.0 * 1024.0) / allLoadedSeconds, stats.bytesUploaded / (1024.0 * 1024.0), stats.numMipsUploaded);
+    printf("update: p50 %.3f ms, p99 %.3f ms, max %.3f ms, %u frames over twice the budget\n",
+           percentile(0.5), percentile(0.99), sortedMs.back(), numHitches);
+    printf("resident: peak %.1f MB, %u mips evicted, %u dropped, %u requests (%u re-streams), %u resizes\n",
+           stats.peakResidentBytes / (1024.0 * 1024.0), stats.numMipsEvicted, stats.numMipsDropped, stats.numRequests,
+           stats.numRequests - numTextures, target.numResizes);
+    printf("%u failed, %u without a valid mip, %u target errors%s\n", stats.numFailed, numIncomplete, target.numErrors,
+           overBudget ? ", OVER BUDGET" : "");
+    return (stats.numFailed || numIncomplete || target.numErrors || overBudget) ? 1 : 0;
+}
+
+////////////////////////////////////////////////////////////////
+// Simulation thread test
+
+// Plays the platform layer: random key transitions at random intervals, pushed
+// from one thread like WndProc would
+static void SimulationInputMain(InputQueue* queue, double endTime, uint32_t* numPushed)
+{
+    uint32_t state = 4321;
+    uint32_t heldKeys = 0;
+    while(GetSeconds() < endTime)
+    {
+        state = state * 1664525u + 1013904223u;
+        InputKey key = (InputKey)((state >> 16) % InputKey_Count);
+        bool isDown = (heldKeys >> key) & 1;
+        InputEvent event = { GetSeconds(), isDown ? InputEventType_KeyUp : InputEventType_KeyDown, key };
+        if(InputQueue_Push(queue, &event)) {
+            heldKeys ^= 1u << key;
+            (*numPushed)++;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(500 + (state >> 8) % 15000));
+    }
+}
+
+static int RunSimulationTest(double seconds, double tickRate)
+{
+    const double frameSeconds = 1.0 / 60.0;
+    InputQueue* queue = new InputQueue;
+    InputQueue_Init(queue);
+    Simulation* simulation = Simulation_Create(queue, tickRate);
+    double step = Simulation_GetStepSeconds(simulation);
+
+    double start = GetSeconds();
+    uint32_t numPushed = 0;
+    std::thread inputThread(SimulationInputMain, queue, start + seconds, &numPushed);
+
+    // Renderer at 60 Hz: the blended state must move forward in time and stay
+    // within a couple of ticks of the present
+    uint32_t numFrames = 0, numBackwards = 0;
+    double lastTime = 0.0, maxLag = 0.0;
+    while(GetSeconds() - start < seconds)
+    {
+        double frameStart = GetSeconds();
+        SimState state;
+        if(Simulation_GetRenderState(simulation, frameStart, &state))
+        {
+            numBackwards += state.time < lastTime;
+            lastTime = state.time;
+            maxLag = std::max(maxLag, frameStart - state.time);
+            numFrames++;
+        }
+        double remaining = frameSeconds - (GetSeconds() - frameStart);
+        if(remaining > 0.0)
+            std::this_thread::sleep_for(std::chrono::duration<double>(remaining));
+    }
+    inputThread.join();
+
+    // Give the last events a few ticks to be consumed
+    std::this_thread::sleep_for(std::chrono::duration<double>(step * 4));
+    SimulationStats stats;
+    Simulation_GetStats(simulation, &stats);
+    double elapsed = GetSeconds() - start;
+    Simulation_Destroy(simulation);
+    delete queue;
+
+    uint64_t expectedTicks = (uint64_t)(elapsed / step);
+    printf("%.1f s at %.0f Hz: %llu ticks (%llu expected), %llu skipped, start late p99 %.3f ms, max %.3f ms\n", elapsed, tickRate,
+           (unsigned long long)stats.numTicks, (unsigned long long)expectedTicks, (unsigned long long)stats.numSkippedTicks,
+           stats.tickLateP99Ms, stats.tickLateMaxMs);
+    printf("input: %u pushed, %llu consumed, %u dropped; latency p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", numPushed,
+           (unsigned long long)stats.numEvents, stats.numDropped, stats.latencyP50Ms, stats.latencyP99Ms, stats.latencyMaxMs);
+    printf("render: %u frames, max lag behind now %.3f ms, %u went back in time\n", numFrames, maxLag * 1000.0, numBackwards);
+
+    // Interpolation trails by up to two ticks, plus a frame of sampling slack
+    double maxAllowedLag = 2.0 * step + frameSeconds;
+    if(maxLag > maxAllowedLag)
+        fprintf(stderr, "render state lagged %.3f ms behind, allowed %.3f ms\n", maxLag * 1000.0, maxAllowedLag * 1000.0);
+
+    bool ok = stats.numEvents == numPushed && numBackwards == 0 && maxLag <= maxAllowedLag
+           && stats.numTicks + stats.numSkippedTicks + 2 >= expectedTicks;
+    return ok ? 0 : 1;
+}
+
+static void PrintDiffResult(const char* name, const ImageDiffResult* result)
+{
+    if(!result->sizeMatches) {
+        printf("%s: size differs\n", name);
+        return;
+    }
+    printf("%s: %s, %llu pixels over tolerance, max delta b %u g %u r %u a %u, mean %.4f, ssim %.5f, worst block %.4f at %d,%d\n",
+           name, result->passed ? "pass" : "FAIL", (unsigned long long)result->numFailingPixels, result->maxDelta[0],
+           result->maxDelta[1], result->maxDelta[2], result->maxDelta[3], result->meanAbsDelta, result->ssim,
+           result->worstBlockSsim, result->worstBlockX, result->worstBlockY);
+}
+
+// Compares two image files with every kernel set, checks they agree and
+// optionally writes the heatmap.
+static int RunImageDiff(const char* referencePath, const char* testPath, const ImageDiffOptions* options, const char* heatmapPath)
+{
+    FrameImage reference, test;
+    if(!FrameCapture_Load(&reference, referencePath) || !FrameCapture_Load(&test, testPath)) {
+        fprintf(stderr, "Could not load %s or %s\n", referencePath, testPath);
+        return 1;
+    }
+
+    const char* pathNames[] = { "scalar", "SSE2", "AVX2" };
+    ImageDiffResult results[3];
+    ImageDiffPath bestPath = ImageDiff_SetPath(ImageDiffPath_AVX2);
+    bool consistent = true;
+    for(int path = ImageDiffPath_Scalar; path <= (int)bestPath; ++path)
+    {
+        ImageDiff_SetPath((ImageDiffPath)path);
+        const int numRuns = 20;
+        double start = GetSeconds();
+        for(int run = 0; run < numRuns; ++run)
+            ImageDiff_Compare(&reference, &test, options, &results[path], nullptr);
+        double elapsed = (GetSeconds() - start) / numRuns;
+        printf("%-6s: %.3f ms, %.0f Mpixels/s\n", pathNames[path], elapsed * 1000.0, reference.pixels.size() / elapsed * 1e-6);
+        const ImageDiffResult* a = &results[path];
+        const ImageDiffResult* b = &results[0];
+        consistent &= a->numFailingPixels == b->numFailingPixels && !memcmp(a->maxDelta, b->maxDelta, sizeof(a->maxDelta)) &&
+                      a->meanAbsDelta == b->meanAbsDelta && a->ssim == b->ssim && a->worstBlockSsim == b->worstBlockSsim &&
+                      a->worstBlockX == b->worstBlockX && a->worstBlockY == b->worstBlockY;
+    }
+    ImageDiff_SetPath(bestPath);
+    PrintDiffResult(testPath, &results[bestPath]);
+    if(!consistent)
+        printf("kernel results DIFFER\n");
+
+    if(heatmapPath)
+    {
+        FrameImage heatmap;
+        ImageDiff_Compare(&reference, &test, options, &results[bestPath], &heatmap);
+        if(!results[bestPath].sizeMatches || !FrameCapture_Write(&heatmap, heatmapPath)) {
+            fprintf(stderr, "Could not write %s\n", heatmapPath);
+            return 1;
+        }
+    }
+    return results[bestPath].passed && consistent ? 0 : 1;
+}
+
+// Renders numFrames scenes through the software renderer and checks each
+// against goldenDir/frame_NNNN.png (or .raw), writing the frame and a heatmap
+// next to any golden it doesn't match. update rewrites the goldens instead.
+static int RunGoldenTest(const char* goldenDir, bool update, bool raw, int numFrames, uint32_t numTris, int width, int height,
+                         int numThreads, bool useAVX2, const ImageDiffOptions* options)
+{
+    SoftwareRenderer* renderer = SoftwareRenderer_Create(width, height, numThreads);
+    SoftwareRenderer_SetUseAVX2(renderer, useAVX2);
+
+    const char* extension = raw ? "raw" : "png";
+    FrameImage frame, golden, heatmap;
+    std::vector<float> vertexData;
+    double renderSeconds = 0.0, ioSeconds = 0.0, compareSeconds = 0.0;
+    uint32_t numPassed = 0, numFailed = 0, numMissing = 0;
+    double start = GetSeconds();
+    for(int i = 0; i < numFrames; ++i)
+    {
+        // Frame i is the --triangles scene with seed 1234 + i
+        vertexData = { // x, y, r, g, b, a
+            0.0f,  0.5f, 0.f, 1.f, 0.f, 1.f,
+            0.5f, -0.5f, 1.f, 0.f, 0.f, 1.f,
+            -0.5f, -0.5f, 0.f, 0.f, 1.f, 1.f
+        };
+        if(numTris)
+            SceneGen_RandomTriangles(&vertexData, numTris, 1234 + i);
+
+        double frameStart = GetSeconds();
+        float backgroundColor[4] = { 0.1f, 0.2f, 0.6f, 1.0f };
+        SoftwareRenderer_Clear(renderer, backgroundColor);
+        SoftwareRenderer_SetViewport(renderer, { 0.0f, 0.0f, (float)width, (float)height });
+        SoftwareRenderer_Draw(renderer, vertexData.data(), BasicVertexFormat::stride, (uint32_t)(vertexData.size() * sizeof(float) / BasicVertexFormat::stride));
+        SoftwareRenderer_Flush(renderer);
+        SoftwareFramebuffer fb = SoftwareRenderer_GetFramebuffer(renderer);
+        FrameCapture_CopyRows(&frame, fb.pixels, fb.width, fb.height, fb.pitch * sizeof(uint32_t));
+        double rendered = GetSeconds();
+        renderSeconds += rendered - frameStart;
+
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/frame_%04d.%s", goldenDir, i, extension);
+        if(update)
+        {
+            // Read every golden back so an encoder bug can't slip into the set
+            bool ok = FrameCapture_Write(&frame, path) && FrameCapture_Load(&golden, path) && golden.pixels == frame.pixels;
+            ioSeconds += GetSeconds() - rendered;
+            if(!ok) {
+                fprintf(stderr, "Could not write %s\n", path);
+                SoftwareRenderer_Destroy(renderer);
+                return 1;
+            }
+            numPassed++;
+            continue;
+        }
+
+        bool loaded = FrameCapture_Load(&golden, path);
+        double compareStart = GetSeconds();
+        ioSeconds += compareStart - rendered;
+        if(!loaded) {
+            printf("%s: missing\n", path);
+            numMissing++;
+            continue;
+        }
+        ImageDiffResult result;
+        bool passed = ImageDiff_Compare(&golden, &frame, options, &result, nullptr);
+        compareSeconds += GetSeconds() - compareStart;
+        if(passed) {
+            numPassed++;
+            continue;
+        }
+
+        numFailed++;
+        PrintDiffResult(path, &result);
+        char outPath[1024];
+        snprintf(outPath, sizeof(outPath), "%s/frame_%04d_actual.png", goldenDir, i);
+        bool ok = FrameCapture_WritePNG(&frame, outPath);
+        if(result.sizeMatches) {
+            ImageDiff_Compare(&golden, &frame, options, &result, &heatmap);
+            snprintf(outPath, sizeof(outPath), "%s/frame_%04d_diff.png", goldenDir, i);
+            ok &= FrameCapture_WritePNG(&heatmap, outPath);
+        }
+        if(!ok)
+            fprintf(stderr, "Could not write the failure images for frame %d\n", i);
+    }
+    double elapsed = GetSeconds() - start;
+    SoftwareRenderer_Destroy(renderer);
+
+    printf("%d frames %dx%d, %u triangles: %u %s, %u failed, %u missing\n", numFrames, width, height, numTris, numPassed,
+           update ? "written" : "passed", numFailed, numMissing);
+    printf("render %.3f ms, %s %s %.3f ms, compare %.3f ms per frame; %.0f frames per minute\n", renderSeconds * 1000.0 / numFrames,
+           extension, update ? "write" : "read", ioSeconds * 1000.0 / numFrames, compareSeconds * 1000.0 / numFrames,
+           numFrames / elapsed * 60.0);
+    return numFailed || numMissing ? 1 : 0;
+}
+
+static void PrintUsage()
+{
+    printf("usage: headless [--width N] [--height N] [--threads N] [--frames N]\n"
+           "                [--triangles N] [--no-avx2] [--out frame.tga|png|raw]\n"
+           "                [--trace trace.json] [--csv zones.csv]\n"
+           "       headless --shader-cache cache.bin [--threads N]\n"
+           "       headless --quads N [--frames N]\n"
+           "       headless --commands N [--frames N] [--threads N]\n"
+           "       headless --vertex-pack N [--frames N]\n"
+           "       headless --alloc-bench image.jpg [--frames N]\n"
+           "       headless --stream N [--stream-image image.jpg] [--stream-budget MB]\n"
+           "                [--stream-ms N] [--frames N] [--threads N]\n"
+           "       headless --simulate SECONDS [--tick-rate HZ]\n"
+           "       headless --golden DIR [--update-golden] [--golden-raw] [--frames N]\n"
+           "                [--triangles N] [--tolerance N] [--max-failing N] [--min-ssim X]\n"
+           "       headless --diff reference.png test.png [--diff-out heatmap.png]\n"
+           "                [--tolerance N] [--max-failing N] [--min-ssim X]\n");
+}
+
+int main(int argc, char** argv)
+{
+    int width = 1024;
+    int height = 768;
+    int numThreads = 0;
+    int numFrames = 1;
+    uint32_t numRandomTris = 0;
+    bool useAVX2 = true;
+    const char* outPath = nullptr;
+    const char* shaderCachePath = nullptr;
+    const char* tracePath = nullptr;
+    const char* csvPath = nullptr;
+    const char* allocBenchPath = nullptr;
+    uint32_t numStreamTextures = 0;
+    const char* streamImagePath = "res/textures/wall.jpg";
+    double streamBudgetMB = 0.0;
+    double streamFrameMs = 2.0;
+    double simulateSeconds = 0.0;
+    double tickRate = 120.0;
+    uint32_t numBatchQuads = 0;
+    uint32_t numCommandObjects = 0;
+    uint32_t numPackVerts = 0;
+    const char* goldenDir = nullptr;
+    bool updateGolden = false;
+    bool goldenRaw = false;
+    const char* diffPaths[2] = {};
+    const char* diffOutPath = nullptr;
+    ImageDiffOptions diffOptions = {};
+    diffOptions.minSsim = 0.99;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        bool hasValue = i + 1 < argc;
+        if(!strcmp(argv[i], "--width") && hasValue) width = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--height") && hasValue) height = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--threads") && hasValue) numThreads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--frames") && hasValue) numFrames = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--triangles") && hasValue) numRandomTris = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if(!strcmp(argv[i], "--out") && hasValue) outPath = argv[++i];
+        else if(!strcmp(argv[i], "--trace") && hasValue) tracePath = argv[++i];
+        else if(!strcmp(argv[i], "--csv") && hasValue) csvPath = argv[++i];
+        else if(!strcmp(argv[i], "--simulate") && hasValue) simulateSeconds = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--tick-rate") && hasValue) tickRate = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--stream") && hasValue) numStreamTextures = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if(!strcmp(argv[i], "--stream-image") && hasValue) streamImagePath = argv[++i];
+        else if(!strcmp(argv[i], "--stream-budget") && hasValue) streamBudgetMB = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--stream-ms") && hasValue) streamFrameMs = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--alloc-bench") && hasValue) allocBenchPath = argv[++i];
+        else if(!strcmp(argv[i], "--vertex-pack") && hasValue) numPackVerts = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if(!strcmp(argv[i], "--commands") && hasValue) numCommandObjects = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if(!strcmp(argv[i], "--quads") && hasValue) numBatchQuads = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if(!strcmp(argv[i], "--shader-cache") && hasValue) shaderCachePath = argv[++i];
+        else if(!strcmp(argv[i], "--golden") && hasValue) goldenDir = argv[++i];
+        else if(!strcmp(argv[i], "--update-golden")) updateGolden = true;
+        else if(!strcmp(argv[i], "--golden-raw")) goldenRaw = true;
+        else if(!strcmp(argv[i], "--diff") && i + 2 < argc) { diffPaths[0] = argv[++i]; diffPaths[1] = argv[++i]; }
+        else if(!strcmp(argv[i], "--diff-out") && hasValue) diffOutPath = argv[++i];
+        else if(!strcmp(argv[i], "--tolerance") && hasValue) memset(diffOptions.tolerance, atoi(argv[++i]), sizeof(diffOptions.tolerance));
+        else if(!strcmp(argv[i], "--max-failing") && hasValue) diffOptions.maxFailingPixels = strtoull(argv[++i], nullptr, 10);
+        else if(!strcmp(argv[i], "--min-ssim") && hasValue) diffOptions.minSsim = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--no-avx2")) useAVX2 = false;
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if(shaderCachePath)
+        return RunShaderCacheTest(shaderCachePath, numThreads);
+    if(numBatchQuads) {
+        Profiler_Init();
+        return RunQuadBatchTest(numBatchQuads, numFrames);
+    }
+    if(simulateSeconds > 0.0) {
+        Profiler_Init();
+        return RunSimulationTest(simulateSeconds, tickRate);
+    }
+    if(numStreamTextures) {
+        Profiler_Init();
+        Profiler_SetThreadName("Main");
+        return RunTextureStreamTest(streamImagePath, numStreamTextures, numFrames, numThreads, streamBudgetMB, streamFrameMs);
+    }
+    if(allocBenchPath)
+        return RunAllocatorBench(allocBenchPath, numFrames);
+    if(numPackVerts)
+        return RunVertexPackTest(numPackVerts, numFrames);
+    if(numCommandObjects) {
+        Profiler_Init();
+        return RunCommandBufferTest(numCommandObjects, numFrames, numThreads, width, height);
+    }
+    if(diffPaths[0])
+        return RunImageDiff(diffPaths[0], diffPaths[1], &diffOptions, diffOutPath);
+
+    if(width <= 0 || height <= 0 || width > SW_MAX_FRAMEBUFFER_SIZE || height > SW_MAX_FRAMEBUFFER_SIZE) {
+        fprintf(stderr, "Framebuffer size must be within 1..%d\n", SW_MAX_FRAMEBUFFER_SIZE);
+        return 1;
+    }
+
+    Profiler_Init();
+    Profiler_SetThreadName("Main");
+    if(goldenDir)
+        return RunGoldenTest(goldenDir, updateGolden, goldenRaw, numFrames, numRandomTris, width, height, numThreads, useAVX2, &diffOptions);
+    SoftwareRenderer* renderer = SoftwareRenderer_Create(width, height, numThreads);
+    SoftwareRenderer_SetUseAVX2(renderer, useAVX2);
+
+    // Same vertex stream as the Create Vertex Buffer block in win32_platform.cpp
+    std::vector<float> vertexData = { // x, y, r, g, b, a
+        0.0f,  0.5f, 0.f, 1.f, 0.f, 1.f,
+        0.5f, -0.5f, 1.f, 0.f, 0.f, 1.f,
+        -0.5f, -0.5f, 0.f, 0.f, 1.f, 1.f
+    };
+    if(numRandomTris)
+        SceneGen_RandomTriangles(&vertexData, numRandomTris, 1234);
+    uint32_t stride = BasicVertexFormat::stride;
+    uint32_t numVerts = (uint32_t)(vertexData.size() * sizeof(float) / stride);
+
+    double totalSeconds = 0.0;
+    double bestSeconds = 1e30;
+    for(int frame = 0; frame < numFrames; ++frame)
+    {
+        double start = GetSeconds();
+
+        {
+            PROFILE_ZONE("Submit");
+            float backgroundColor[4] = { 0.1f, 0.2f, 0.6f, 1.0f };
+            SoftwareRenderer_Clear(renderer, backgroundColor);
+            SoftwareRenderer_SetViewport(renderer, { 0.0f, 0.0f, (float)width, (float)height });
+            SoftwareRenderer_Draw(renderer, vertexData.data(), stride, numVerts);
+        }
+        SoftwareRenderer_Flush(renderer);
+
+        double elapsed = GetSeconds() - start;
+        totalSeconds += elapsed;
+        if(elapsed < bestSeconds)
+            bestSeconds = elapsed;
+        Profiler_FrameMark();
+    }
+
+    SoftwareFramebuffer fb = SoftwareRenderer_GetFramebuffer(renderer);
+    printf("%dx%d, %u triangles, %d threads, %s\n", width, height, numVerts / 3,
+           SoftwareRenderer_GetThreadCount(renderer), !ARCH_X64 ? "scalar" : (useAVX2 && CpuSupportsAVX2()) ? "AVX2" : "SSE2");
+    printf("frames: %d, avg %.3f ms, best %.3f ms\n", numFrames, totalSeconds * 1000.0 / numFrames, bestSeconds * 1000.0);
+    ProfilerFrameStats frameStats;
+    Profiler_GetFrameStats(&frameStats);
+    printf("frame time over last %u: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+           frameStats.numFrames, frameStats.p50Ms, frameStats.p95Ms, frameStats.p99Ms, frameStats.maxMs);
+    printf("framebuffer hash: %016llx\n", (unsigned long long)HashFramebuffer(fb));
+
+    int result = 0;
+    if(tracePath && !Profiler_WriteChromeTrace(tracePath)) {
+        fprintf(stderr, "Could not write %s\n", tracePath);
+        result = 1;
+    }
+    if(csvPath && !Profiler_WriteCSV(csvPath)) {
+        fprintf(stderr, "Could not write %s\n", csvPath);
+        result = 1;
+    }
+    size_t outPathLength = outPath ? strlen(outPath) : 0;
+    bool outIsTGA = outPathLength >= 4 && !strcmp(outPath + outPathLength - 4, ".tga");
+    FrameImage frame;
+    if(outPath && !outIsTGA)
+        FrameCapture_CopyRows(&frame, fb.pixels, fb.width, fb.height, fb.pitch * sizeof(uint32_t));
+    if(outPath && !(outIsTGA ? WriteTGA(outPath, fb) : FrameCapture_Write(&frame, outPath))) {
+        fprintf(stderr, "Could not write %s\n", outPath);
+        result = 1;
+    }
+
+    SoftwareRenderer_Destroy(renderer);
+    return result;
+}
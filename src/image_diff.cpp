@@ -0,0 +1,408 @@
+#include "image_diff.h"
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+// SSIM stabilizers for 8 bit data, (0.01 * 255)^2 and (0.03 * 255)^2
+#define SSIM_C1 6.5025
+#define SSIM_C2 58.5225
+
+static ImageDiffPath global_imageDiffPath = ImageDiffPath_AVX2;
+static bool global_imageDiffPathChecked = false;
+
+ImageDiffPath ImageDiff_SetPath(ImageDiffPath path)
+{
+    ImageDiffPath best = !ARCH_X64 ? ImageDiffPath_Scalar : CpuSupportsAVX2() ? ImageDiffPath_AVX2 : ImageDiffPath_SSE2;
+    global_imageDiffPath = path < best ? path : best;
+    global_imageDiffPathChecked = true;
+    return global_imageDiffPath;
+}
+
+static ImageDiffPath GetImageDiffPath()
+{
+    if(!global_imageDiffPathChecked)
+        ImageDiff_SetPath(ImageDiffPath_AVX2);
+    return global_imageDiffPath;
+}
+
+// Accumulated over the rows of one image
+struct DiffStats
+{
+    uint64_t numPassing;
+    uint64_t sumAbsDelta;
+    uint8_t maxDelta[4];
+};
+
+// Sums over one block of luma, enough for its mean, variance and covariance
+struct BlockSums
+{
+    uint32_t count;
+    uint32_t sumA, sumB;
+    uint32_t sumAA, sumBB, sumAB;
+};
+
+////////////////////////////////////////////////////////////////
+// Scalar
+
+// Rec. 709 weights scaled to 256, summing to 256 so white stays 255
+static inline uint32_t DiffLuma(uint32_t pixel)
+{
+    return (((pixel >> 16) & 0xFF) * 54 + ((pixel >> 8) & 0xFF) * 183 + (pixel & 0xFF) * 19 + 128) >> 8;
+}
+
+static void DiffRow(const uint32_t* a, const uint32_t* b, size_t count, uint32_t tolerance,
+                    uint8_t* lumaA, uint8_t* lumaB, DiffStats* stats)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        bool pass = true;
+        for(int c = 0; c < 4; ++c)
+        {
+            int ca = (a[i] >> (c * 8)) & 0xFF;
+            int cb = (b[i] >> (c * 8)) & 0xFF;
+            uint32_t delta = (uint32_t)(ca > cb ? ca - cb : cb - ca);
+            stats->sumAbsDelta += delta;
+            if(delta > stats->maxDelta[c])
+                stats->maxDelta[c] = (uint8_t)delta;
+            pass &= delta <= ((tolerance >> (c * 8)) & 0xFF);
+        }
+        stats->numPassing += pass ? 1 : 0;
+        lumaA[i] = (uint8_t)DiffLuma(a[i]);
+        lumaB[i] = (uint8_t)DiffLuma(b[i]);
+    }
+}
+
+static void SumBlock(const uint8_t* lumaA, const uint8_t* lumaB, size_t pitch, int width, int height, BlockSums* sums)
+{
+    *sums = {};
+    sums->count = (uint32_t)(width * height);
+    for(int y = 0; y < height; ++y)
+    {
+        for(int x = 0; x < width; ++x)
+        {
+            uint32_t a = lumaA[y * pitch + x];
+            uint32_t b = lumaB[y * pitch + x];
+            sums->sumA += a;
+            sums->sumB += b;
+            sums->sumAA += a * a;
+            sums->sumBB += b * b;
+            sums->sumAB += a * b;
+        }
+    }
+}
+
+static double BlockSsim(const BlockSums* sums)
+{
+    double n = (double)sums->count;
+    double meanA = sums->sumA / n;
+    double meanB = sums->sumB / n;
+    double varianceA = sums->sumAA / n - meanA * meanA;
+    double varianceB = sums->sumBB / n - meanB * meanB;
+    double covariance = sums->sumAB / n - meanA * meanB;
+    return ((2.0 * meanA * meanB + SSIM_C1) * (2.0 * covariance + SSIM_C2)) /
+           ((meanA * meanA + meanB * meanB + SSIM_C1) * (varianceA + varianceB + SSIM_C2));
+}
+
+////////////////////////////////////////////////////////////////
+// SSE2 / AVX2
+
+#if ARCH_X64
+// Luma of 4 pixels in the low byte of each 32 bit lane. Every product and sum
+// fits 16 bits, so the 16 bit multiplies give exactly DiffLuma.
+static inline __m128i Luma4_SSE2(__m128i pixels)
+{
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    __m128i b = _mm_and_si128(pixels, mask);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 8), mask);
+    __m128i r = _mm_and_si128(_mm_srli_epi32(pixels, 16), mask);
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi32(54)), _mm_mullo_epi16(g, _mm_set1_epi32(183)));
+    y = _mm_add_epi16(y, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi32(19)), _mm_set1_epi32(128)));
+    return _mm_srli_epi32(y, 8);
+}
+
+static inline void StoreLuma4_SSE2(uint8_t* out, __m128i luma)
+{
+    __m128i packed = _mm_packus_epi16(_mm_packs_epi32(luma, luma), luma);
+    uint32_t bytes = (uint32_t)_mm_cvtsi128_si32(packed);
+    memcpy(out, &bytes, sizeof(bytes));
+}
+
+static void ReduceDiffStats(const uint8_t maxBytes[], int numPixels, DiffStats* stats)
+{
+    for(int i = 0; i < numPixels; ++i)
+        for(int c = 0; c < 4; ++c)
+            if(maxBytes[i * 4 + c] > stats->maxDelta[c])
+                stats->maxDelta[c] = maxBytes[i * 4 + c];
+}
+
+static size_t DiffRow_SSE2(const uint32_t* a, const uint32_t* b, size_t count, uint32_t tolerance,
+                           uint8_t* lumaA, uint8_t* lumaB, DiffStats* stats)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i limit = _mm_set1_epi32((int)tolerance);
+    __m128i maxDelta = zero;
+    __m128i sumDelta = zero;
+    __m128i passing = zero;
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i pa = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i pb = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i delta = _mm_or_si128(_mm_subs_epu8(pa, pb), _mm_subs_epu8(pb, pa));
+        maxDelta = _mm_max_epu8(maxDelta, delta);
+        sumDelta = _mm_add_epi64(sumDelta, _mm_sad_epu8(delta, zero));
+        // Lanes with nothing left after subtracting the tolerance pass; the
+        // compare gives -1 for those, so subtracting counts them
+        passing = _mm_sub_epi32(passing, _mm_cmpeq_epi32(_mm_subs_epu8(delta, limit), zero));
+        StoreLuma4_SSE2(lumaA + i, Luma4_SSE2(pa));
+        StoreLuma4_SSE2(lumaB + i, Luma4_SSE2(pb));
+    }
+
+    uint8_t maxBytes[16];
+    uint32_t passingLanes[4];
+    uint64_t sumLanes[2];
+    _mm_storeu_si128((__m128i*)maxBytes, maxDelta);
+    _mm_storeu_si128((__m128i*)passingLanes, passing);
+    _mm_storeu_si128((__m128i*)sumLanes, sumDelta);
+    ReduceDiffStats(maxBytes, 4, stats);
+    stats->numPassing += (uint64_t)passingLanes[0] + passingLanes[1] + passingLanes[2] + passingLanes[3];
+    stats->sumAbsDelta += sumLanes[0] + sumLanes[1];
+    return i;
+}
+
+static inline uint32_t HorizontalSum_SSE2(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+// Two horizontally adjacent full-width blocks, 16 columns
+static void SumBlockPair_SSE2(const uint8_t* lumaA, const uint8_t* lumaB, size_t pitch, int height, BlockSums sums[2])
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sumA = zero, sumB = zero;
+    __m128i sumAA[2] = { zero, zero }, sumBB[2] = { zero, zero }, sumAB[2] = { zero, zero };
+    for(int y = 0; y < height; ++y)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(lumaA + y * pitch));
+        __m128i b = _mm_loadu_si128((const __m128i*)(lumaB + y * pitch));
+        // sad against zero sums each 8 byte half, which is exactly one block row
+        sumA = _mm_add_epi64(sumA, _mm_sad_epu8(a, zero));
+        sumB = _mm_add_epi64(sumB, _mm_sad_epu8(b, zero));
+        __m128i a16[2] = { _mm_unpacklo_epi8(a, zero), _mm_unpackhi_epi8(a, zero) };
+        __m128i b16[2] = { _mm_unpacklo_epi8(b, zero), _mm_unpackhi_epi8(b, zero) };
+        for(int i = 0; i < 2; ++i)
+        {
+            sumAA[i] = _mm_add_epi32(sumAA[i], _mm_madd_epi16(a16[i], a16[i]));
+            sumBB[i] = _mm_add_epi32(sumBB[i], _mm_madd_epi16(b16[i], b16[i]));
+            sumAB[i] = _mm_add_epi32(sumAB[i], _mm_madd_epi16(a16[i], b16[i]));
+        }
+    }
+
+    uint64_t lanesA[2], lanesB[2];
+    _mm_storeu_si128((__m128i*)lanesA, sumA);
+    _mm_storeu_si128((__m128i*)lanesB, sumB);
+    for(int i = 0; i < 2; ++i)
+    {
+        sums[i].count = (uint32_t)(IMAGE_DIFF_BLOCK_SIZE * height);
+        sums[i].sumA = (uint32_t)lanesA[i];
+        sums[i].sumB = (uint32_t)lanesB[i];
+        sums[i].sumAA = HorizontalSum_SSE2(sumAA[i]);
+        sums[i].sumBB = HorizontalSum_SSE2(sumBB[i]);
+        sums[i].sumAB = HorizontalSum_SSE2(sumAB[i]);
+    }
+}
+
+TARGET_AVX2
+static inline __m256i Luma8_AVX2(__m256i pixels)
+{
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    __m256i b = _mm256_and_si256(pixels, mask);
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), mask);
+    __m256i r = _mm256_and_si256(_mm256_srli_epi32(pixels, 16), mask);
+    __m256i y = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi32(54)), _mm256_mullo_epi16(g, _mm256_set1_epi32(183)));
+    y = _mm256_add_epi16(y, _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi32(19)), _mm256_set1_epi32(128)));
+    return _mm256_srli_epi32(y, 8);
+}
+
+TARGET_AVX2
+static inline void StoreLuma8_AVX2(uint8_t* out, __m256i luma)
+{
+    // packs works per 128 bit lane, each lane ends up with its 4 bytes at the bottom
+    __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(luma, luma), luma);
+    uint32_t bytes[2] = { (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(packed)),
+                          (uint32_t)_mm_cvtsi128_si32(_mm256_extracti128_si256(packed, 1)) };
+    memcpy(out, bytes, sizeof(bytes));
+}
+
+TARGET_AVX2
+static size_t DiffRow_AVX2(const uint32_t* a, const uint32_t* b, size_t count, uint32_t tolerance,
+                           uint8_t* lumaA, uint8_t* lumaB, DiffStats* stats)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i limit = _mm256_set1_epi32((int)tolerance);
+    __m256i maxDelta = zero;
+    __m256i sumDelta = zero;
+    __m256i passing = zero;
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i pa = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i pb = _mm256_loadu_si256((const __m256i*)(b + i));
+        __m256i delta = _mm256_or_si256(_mm256_subs_epu8(pa, pb), _mm256_subs_epu8(pb, pa));
+        maxDelta = _mm256_max_epu8(maxDelta, delta);
+        sumDelta = _mm256_add_epi64(sumDelta, _mm256_sad_epu8(delta, zero));
+        passing = _mm256_sub_epi32(passing, _mm256_cmpeq_epi32(_mm256_subs_epu8(delta, limit), zero));
+        StoreLuma8_AVX2(lumaA + i, Luma8_AVX2(pa));
+        StoreLuma8_AVX2(lumaB + i, Luma8_AVX2(pb));
+    }
+
+    uint8_t maxBytes[32];
+    uint32_t passingLanes[8];
+    uint64_t sumLanes[4];
+    _mm256_storeu_si256((__m256i*)maxBytes, maxDelta);
+    _mm256_storeu_si256((__m256i*)passingLanes, passing);
+    _mm256_storeu_si256((__m256i*)sumLanes, sumDelta);
+    ReduceDiffStats(maxBytes, 8, stats);
+    for(int lane = 0; lane < 8; ++lane)
+        stats->numPassing += passingLanes[lane];
+    stats->sumAbsDelta += sumLanes[0] + sumLanes[1] + sumLanes[2] + sumLanes[3];
+    return i;
+}
+#endif
+
+////////////////////////////////////////////////////////////////
+// Heatmap
+
+static uint32_t HeatColor(uint32_t delta)
+{
+    // sqrt so single-step differences are already clearly blue
+    static const float stops[4][3] = { { 0.0f, 64.0f, 255.0f }, { 0.0f, 255.0f, 0.0f }, { 255.0f, 255.0f, 0.0f }, { 255.0f, 0.0f, 0.0f } };
+    float t = sqrtf(delta / 255.0f) * 3.0f;
+    int segment = t >= 3.0f ? 2 : (int)t;
+    float f = t - segment;
+    uint32_t rgb[3];
+    for(int c = 0; c < 3; ++c)
+        rgb[c] = (uint32_t)(stops[segment][c] + (stops[segment + 1][c] - stops[segment][c]) * f + 0.5f);
+    return 0xFF000000u | (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+}
+
+static void DrawHeatmap(const FrameImage* reference, const FrameImage* test, uint32_t tolerance, FrameImage* heatmap)
+{
+    uint32_t palette[256];
+    for(uint32_t i = 0; i < 256; ++i)
+        palette[i] = HeatColor(i);
+
+    heatmap->width = reference->width;
+    heatmap->height = reference->height;
+    heatmap->pixels.resize(reference->pixels.size());
+    for(size_t i = 0; i < reference->pixels.size(); ++i)
+    {
+        uint32_t a = reference->pixels[i];
+        uint32_t b = test->pixels[i];
+        uint32_t largest = 0;
+        bool pass = true;
+        for(int c = 0; c < 4; ++c)
+        {
+            int ca = (a >> (c * 8)) & 0xFF;
+            int cb = (b >> (c * 8)) & 0xFF;
+            uint32_t delta = (uint32_t)(ca > cb ? ca - cb : cb - ca);
+            largest = delta > largest ? delta : largest;
+            pass &= delta <= ((tolerance >> (c * 8)) & 0xFF);
+        }
+        uint32_t grey = DiffLuma(a) / 4;
+        heatmap->pixels[i] = pass ? 0xFF000000u | grey * 0x010101u : palette[largest];
+    }
+}
+
+////////////////////////////////////////////////////////////////
+// Compare
+
+bool ImageDiff_Compare(const FrameImage* reference, const FrameImage* test, const ImageDiffOptions* options,
+                       ImageDiffResult* result, FrameImage* heatmap)
+{
+    *result = {};
+    result->sizeMatches = reference->width == test->width && reference->height == test->height;
+    if(!result->sizeMatches)
+        return false;
+
+    ImageDiffPath path = GetImageDiffPath();
+    int width = reference->width;
+    int height = reference->height;
+    uint32_t tolerance = options->tolerance[0] | (options->tolerance[1] << 8) | (options->tolerance[2] << 16) |
+                         ((uint32_t)options->tolerance[3] << 24);
+
+    // Luma for one strip of block rows at a time, so it stays in cache
+    std::vector<uint8_t> luma((size_t)width * IMAGE_DIFF_BLOCK_SIZE * 2);
+    uint8_t* lumaA = luma.data();
+    uint8_t* lumaB = luma.data() + (size_t)width * IMAGE_DIFF_BLOCK_SIZE;
+
+    DiffStats stats = {};
+    double ssimSum = 0.0;
+    result->worstBlockSsim = 2.0;
+    for(int y0 = 0; y0 < height; y0 += IMAGE_DIFF_BLOCK_SIZE)
+    {
+        int rows = height - y0 < IMAGE_DIFF_BLOCK_SIZE ? height - y0 : IMAGE_DIFF_BLOCK_SIZE;
+        for(int row = 0; row < rows; ++row)
+        {
+            const uint32_t* a = &reference->pixels[(size_t)(y0 + row) * width];
+            const uint32_t* b = &test->pixels[(size_t)(y0 + row) * width];
+            uint8_t* rowLumaA = lumaA + (size_t)row * width;
+            uint8_t* rowLumaB = lumaB + (size_t)row * width;
+            size_t i = 0;
+#if ARCH_X64
+            if(path == ImageDiffPath_AVX2)
+                i = DiffRow_AVX2(a, b, width, tolerance, rowLumaA, rowLumaB, &stats);
+            if(path >= ImageDiffPath_SSE2)
+                i += DiffRow_SSE2(a + i, b + i, width - i, tolerance, rowLumaA + i, rowLumaB + i, &stats);
+#endif
+            DiffRow(a + i, b + i, width - i, tolerance, rowLumaA + i, rowLumaB + i, &stats);
+        }
+
+        for(int x = 0; x < width;)
+        {
+            BlockSums sums[2];
+            int numBlocks = 1;
+#if ARCH_X64
+            if(path >= ImageDiffPath_SSE2 && x + 2 * IMAGE_DIFF_BLOCK_SIZE <= width)
+            {
+                SumBlockPair_SSE2(lumaA + x, lumaB + x, width, rows, sums);
+                numBlocks = 2;
+            }
+            else
+#endif
+            {
+                int columns = width - x < IMAGE_DIFF_BLOCK_SIZE ? width - x : IMAGE_DIFF_BLOCK_SIZE;
+                SumBlock(lumaA + x, lumaB + x, width, columns, rows, &sums[0]);
+            }
+
+            for(int i = 0; i < numBlocks; ++i)
+            {
+                // Partial blocks at the right and bottom edges count by their area
+                double ssim = BlockSsim(&sums[i]);
+                ssimSum += ssim * sums[i].count;
+                if(ssim < result->worstBlockSsim) {
+                    result->worstBlockSsim = ssim;
+                    result->worstBlockX = x + i * IMAGE_DIFF_BLOCK_SIZE;
+                    result->worstBlockY = y0;
+                }
+            }
+            x += numBlocks * IMAGE_DIFF_BLOCK_SIZE;
+        }
+    }
+
+    uint64_t numPixels = (uint64_t)width * height;
+    result->numFailingPixels = numPixels - stats.numPassing;
+    memcpy(result->maxDelta, stats.maxDelta, sizeof(result->maxDelta));
+    result->meanAbsDelta = numPixels ? (double)stats.sumAbsDelta / (numPixels * 4) : 0.0;
+    result->ssim = numPixels ? ssimSum / numPixels : 1.0;
+    if(!numPixels)
+        result->worstBlockSsim = 1.0;
+    result->passed = result->numFailingPixels <= options->maxFailingPixels && result->ssim >= options->minSsim;
+
+    if(heatmap)
+        DrawHeatmap(reference, test, tolerance, heatmap);
+    return result->passed;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+// Golden-image comparison for captured frames (see frame_capture.h).
+//
+// Two measures, both computed in one pass over the images:
+// - Per-channel tolerance: a pixel fails when any channel differs by more than
+//   the tolerance for that channel. Catches hard breaks like missing draws.
+// - Structural similarity: SSIM of the luma (Rec. 709 weights on the sRGB
+//   bytes) over non-overlapping 8x8 blocks. Mean and worst block; tolerates
+//   dithering or a half-texel shift while still flagging smeared or lost detail.
+//
+// All statistics are integer sums until the final per-block SSIM, so the
+// scalar, SSE2 and AVX2 paths give bit-identical results.
+
+#include "base.h"
+#include "frame_capture.h"
+
+#define IMAGE_DIFF_BLOCK_SIZE 8
+
+enum ImageDiffPath
+{
+  ImageDiffPath_Scalar,
+  ImageDiffPath_SSE2,
+  ImageDiffPath_AVX2,
+};
+
+struct ImageDiffOptions
+{
+  uint8_t tolerance[4];      // max difference per channel, B, G, R, A like the pixels
+  uint64_t maxFailingPixels; // over tolerance
+  double minSsim;            // mean over all blocks
+};
+
+struct ImageDiffResult
+{
+  bool sizeMatches;
+  bool passed;
+  uint64_t numFailingPixels;
+  uint8_t maxDelta[4]; // B, G, R, A
+  double meanAbsDelta; // over all channels, in 8 bit steps
+  double ssim;         // mean over blocks, 1 for identical images
+  double worstBlockSsim;
+  int worstBlockX;     // pixel position of the worst block
+  int worstBlockY;
+};
+
+// Caps the kernels at path (clamped to what the CPU supports) and returns the path now in use.
+ImageDiffPath ImageDiff_SetPath(ImageDiffPath path);
+
+// reference and test must have the same size, or the result fails with
+// sizeMatches false. If heatmap is given it gets a picture of the differences:
+// the reference dimmed to grey where pixels are within tolerance, a blue to red
+// ramp by the largest channel difference where they're not.
+bool ImageDiff_Compare(const FrameImage* reference, const FrameImage* test, const ImageDiffOptions* options,
+                       ImageDiffResult* result, FrameImage* heatmap);
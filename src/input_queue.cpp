@@ -0,0 +1,32 @@
+#include "input_queue.h"
+
+void InputQueue_Init(InputQueue* queue)
+{
+    queue->head.store(0, std::memory_order_relaxed);
+    queue->tail.store(0, std::memory_order_relaxed);
+    queue->numDropped.store(0, std::memory_order_relaxed);
+}
+
+bool InputQueue_Push(InputQueue* queue, const InputEvent* event)
+{
+    uint32_t head = queue->head.load(std::memory_order_relaxed);
+    uint32_t tail = queue->tail.load(std::memory_order_acquire);
+    if(head - tail >= INPUT_QUEUE_CAPACITY) {
+        queue->numDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    queue->events[head & (INPUT_QUEUE_CAPACITY - 1)] = *event;
+    queue->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool InputQueue_Pop(InputQueue* queue, InputEvent* event)
+{
+    uint32_t tail = queue->tail.load(std::memory_order_relaxed);
+    uint32_t head = queue->head.load(std::memory_order_acquire);
+    if(tail == head)
+        return false;
+    *event = queue->events[tail & (INPUT_QUEUE_CAPACITY - 1)];
+    queue->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// Single-producer single-consumer ring of platform input events. The platform
+// layer (WndProc on the main thread) pushes, the simulation thread pops; no
+// locks, no allocation. Events are timestamped with GetSeconds() when pushed
+// so the consumer can measure latency and assign them to the right tick.
+
+#include "base.h"
+
+#include <atomic>
+
+#define INPUT_QUEUE_CAPACITY 1024 // power of two; pushes into a full queue are dropped and counted
+
+enum InputEventType : uint32_t
+{
+  InputEventType_KeyDown,
+  InputEventType_KeyUp,
+};
+
+// Platform-neutral keys, bit positions in SimState::heldKeys
+enum InputKey : uint32_t
+{
+  InputKey_Left,
+  InputKey_Right,
+  InputKey_Up,
+  InputKey_Down,
+  InputKey_Count,
+};
+
+struct InputEvent
+{
+  double timestamp; // GetSeconds() when the platform saw it
+  InputEventType type;
+  InputKey key;
+};
+
+struct InputQueue
+{
+  std::atomic<uint32_t> head; // next slot to write, only the producer stores it
+  char padding0[60];           // keep producer and consumer indices on separate cache lines
+  std::atomic<uint32_t> tail; // next slot to read, only the consumer stores it
+  char padding1[60];
+  std::atomic<uint32_t> numDropped;
+  InputEvent events[INPUT_QUEUE_CAPACITY];
+};
+
+void InputQueue_Init(InputQueue* queue);
+// Producer side. Returns false if the queue was full.
+bool InputQueue_Push(InputQueue* queue, const InputEvent* event);
+// Consumer side. Returns false if the queue was empty.
+bool InputQueue_Pop(InputQueue* queue, InputEvent* event);
@@ -0,0 +1,246 @@
+#include "job_system.h"
+#include "profiler.h"
+
+#include <assert.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define JOB_SPIN_COUNT 64
+
+// Chase-Lev deque as formulated for C11 atomics by Le, Pop, Cohen and Zappa
+// Nardelli. Fixed capacity, the jobs themselves live in the dispatcher's array.
+struct JobDeque
+{
+    std::atomic<int64_t> top;
+    char padding[56]; // keep thieves and the owner on separate cache lines
+    std::atomic<int64_t> bottom;
+    std::atomic<Job*> jobs[JOB_DEQUE_CAPACITY];
+};
+
+struct JobSystem
+{
+    std::vector<JobDeque*> deques; // one per thread, index 0 is the creating thread
+    std::vector<std::thread> workers;
+
+    std::atomic<int32_t> pendingJobs; // pushed but not started
+    std::atomic<bool> quit;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+};
+
+static thread_local int global_jobThreadIndex = -1;
+
+static bool JobDeque_Push(JobDeque* deque, Job* job)
+{
+    int64_t bottom = deque->bottom.load(std::memory_order_relaxed);
+    int64_t top = deque->top.load(std::memory_order_acquire);
+    if(bottom - top >= JOB_DEQUE_CAPACITY)
+        return false;
+    deque->jobs[bottom & (JOB_DEQUE_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+}
+
+static Job* JobDeque_Pop(JobDeque* deque)
+{
+    int64_t bottom = deque->bottom.load(std::memory_order_relaxed) - 1;
+    deque->bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = deque->top.load(std::memory_order_relaxed);
+
+    Job* job = 0;
+    if(top <= bottom)
+    {
+        job = deque->jobs[bottom & (JOB_DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+        if(top == bottom)
+        {
+            // Last job, race the thieves for it
+            if(!deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                job = 0;
+            deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+    }
+    else
+        deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+    return job;
+}
+
+static Job* JobDeque_Steal(JobDeque* deque)
+{
+    int64_t top = deque->top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = deque->bottom.load(std::memory_order_acquire);
+    if(top >= bottom)
+        return 0;
+
+    Job* job = deque->jobs[top & (JOB_DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+    if(!deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return 0;
+    return job;
+}
+
+static void RunJob(JobSystem* jobSystem, Job* job)
+{
+    jobSystem->pendingJobs.fetch_sub(1, std::memory_order_relaxed);
+    job->func(job->data, job->index);
+    job->counter->value.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+// Own deque first (LIFO, cache warm), then steal starting at the next thread
+static Job* FindJob(JobSystem* jobSystem, int threadIndex)
+{
+    Job* job = JobDeque_Pop(jobSystem->deques[threadIndex]);
+    if(job)
+        return job;
+
+    int numThreads = (int)jobSystem->deques.size();
+    for(int i = 1; i < numThreads; ++i)
+    {
+        job = JobDeque_Steal(jobSystem->deques[(threadIndex + i) % numThreads]);
+        if(job)
+            return job;
+    }
+    return 0;
+}
+
+static void JobWorkerMain(JobSystem* jobSystem, int threadIndex)
+{
+    global_jobThreadIndex = threadIndex;
+    Profiler_SetThreadName("Job Worker");
+
+    while(!jobSystem->quit.load(std::memory_order_acquire))
+    {
+        Job* job = 0;
+        for(int spin = 0; spin < JOB_SPIN_COUNT && !job; ++spin)
+            job = FindJob(jobSystem, threadIndex);
+        if(job) {
+            RunJob(jobSystem, job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(jobSystem->mutex);
+        jobSystem->wakeCondition.wait(lock, [&] {
+            return jobSystem->quit.load(std::memory_order_acquire) || jobSystem->pendingJobs.load(std::memory_order_acquire) > 0;
+        });
+    }
+}
+
+JobSystem* JobSystem_Create(int numThreads)
+{
+    if(numThreads <= 0)
+        numThreads = (int)std::thread::hardware_concurrency();
+    if(numThreads <= 0)
+        numThreads = 1;
+
+    JobSystem* jobSystem = new JobSystem;
+    jobSystem->pendingJobs.store(0, std::memory_order_relaxed);
+    jobSystem->quit.store(false, std::memory_order_relaxed);
+    jobSystem->deques.resize(numThreads);
+    for(int i = 0; i < numThreads; ++i)
+    {
+        jobSystem->deques[i] = new JobDeque;
+        jobSystem->deques[i]->top.store(0, std::memory_order_relaxed);
+        jobSystem->deques[i]->bottom.store(0, std::memory_order_relaxed);
+    }
+
+    global_jobThreadIndex = 0;
+    for(int i = 1; i < numThreads; ++i)
+        jobSystem->workers.emplace_back(JobWorkerMain, jobSystem, i);
+    return jobSystem;
+}
+
+void JobSystem_Destroy(JobSystem* jobSystem)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobSystem->mutex);
+        jobSystem->quit.store(true, std::memory_order_release);
+        jobSystem->wakeCondition.notify_all();
+    }
+    for(size_t i = 0; i < jobSystem->workers.size(); ++i)
+        jobSystem->workers[i].join();
+    for(size_t i = 0; i < jobSystem->deques.size(); ++i)
+        delete jobSystem->deques[i];
+    global_jobThreadIndex = -1;
+    delete jobSystem;
+}
+
+int JobSystem_GetThreadCount(const JobSystem* jobSystem)
+{
+    return (int)jobSystem->deques.size();
+}
+
+int JobSystem_GetThreadIndex()
+{
+    return global_jobThreadIndex;
+}
+
+void JobSystem_Dispatch(JobSystem* jobSystem, Job* jobs, uint32_t count, JobCounter* counter)
+{
+    int threadIndex = global_jobThreadIndex;
+    assert(threadIndex >= 0 && threadIndex < (int)jobSystem->deques.size());
+
+    counter->value.store((int32_t)count, std::memory_order_relaxed);
+    JobDeque* deque = jobSystem->deques[threadIndex];
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        jobs[i].counter = counter;
+        jobSystem->pendingJobs.fetch_add(1, std::memory_order_release);
+        if(!JobDeque_Push(deque, &jobs[i]))
+            RunJob(jobSystem, &jobs[i]);
+    }
+
+    if(!jobSystem->workers.empty())
+    {
+        // Taking the lock orders this against a worker that is about to sleep
+        std::lock_guard<std::mutex> lock(jobSystem->mutex);
+        jobSystem->wakeCondition.notify_all();
+    }
+}
+
+void JobSystem_Wait(JobSystem* jobSystem, JobCounter* counter)
+{
+    int threadIndex = global_jobThreadIndex;
+    assert(threadIndex >= 0 && threadIndex < (int)jobSystem->deques.size());
+
+    while(counter->value.load(std::memory_order_acquire) > 0)
+    {
+        Job* job = FindJob(jobSystem, threadIndex);
+        if(job)
+            RunJob(jobSystem, job);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem_ParallelFor(JobSystem* jobSystem, JobFunc* func, void* data, uint32_t count, MemoryArena* scratch)
+{
+    std::vector<Job> heapJobs;
+    MemoryArenaMarker marker = {};
+    Job* jobs = nullptr;
+    if(scratch)
+    {
+        marker = MemoryArena_GetMarker(scratch);
+        jobs = MEMORY_PUSH_ARRAY(scratch, Job, count);
+    }
+    if(!jobs)
+    {
+        heapJobs.resize(count);
+        jobs = heapJobs.data();
+    }
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        jobs[i].func = func;
+        jobs[i].data = data;
+        jobs[i].index = i;
+    }
+    JobCounter counter;
+    JobSystem_Dispatch(jobSystem, jobs, count, &counter);
+    JobSystem_Wait(jobSystem, &counter);
+
+    if(scratch && jobs != heapJobs.data())
+        MemoryArena_Rewind(scratch, marker);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// Work-stealing job scheduler. Every thread (the creating thread plus the
+// workers) owns a Chase-Lev deque: the owner pushes and pops at the bottom
+// without locks, idle threads steal from the top of someone else's deque.
+// Waiting on a counter runs other jobs instead of blocking, so jobs may
+// dispatch and wait on further jobs.
+//
+// Only the thread that called JobSystem_Create and the job system's own
+// workers may dispatch. Idle workers spin briefly and then sleep until new
+// work is pushed.
+
+#include "base.h"
+#include "memory.h"
+
+#include <atomic>
+
+#define JOB_DEQUE_CAPACITY 4096 // per thread, power of two; a full deque runs jobs inline
+
+struct JobSystem;
+
+typedef void JobFunc(void* data, uint32_t index);
+
+struct JobCounter
+{
+  std::atomic<int32_t> value;
+};
+
+struct Job
+{
+  JobFunc* func;
+  void* data;
+  uint32_t index;
+  JobCounter* counter; // set by dispatch
+};
+
+// numThreads counts the calling thread, 0 = one per hardware core.
+JobSystem* JobSystem_Create(int numThreads);
+void JobSystem_Destroy(JobSystem* jobSystem);
+int JobSystem_GetThreadCount(const JobSystem* jobSystem);
+// 0 for the creating thread, 1..n-1 for workers, -1 for anything else.
+int JobSystem_GetThreadIndex();
+
+// jobs must stay valid until the counter reaches zero. The counter is reset to
+// count, so it can't be shared by concurrent dispatches.
+void JobSystem_Dispatch(JobSystem* jobSystem, Job* jobs, uint32_t count, JobCounter* counter);
+void JobSystem_Wait(JobSystem* jobSystem, JobCounter* counter);
+
+// Convenience: runs func(data, i) for every i in [0, count) and waits. The job
+// array comes from scratch when given (e.g. the frame arena), else the heap.
+void JobSystem_ParallelFor(JobSystem* jobSystem, JobFunc* func, void* data, uint32_t count, MemoryArena* scratch = nullptr);
@@ -0,0 +1,106 @@
+#include "mapped_file.h"
+
+#include <string.h>
+
+#if defined(_WIN32)
+    #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+    #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#if defined(_WIN32)
+
+bool MappedFile_Open(MappedFile* file, const char* path)
+{
+    memset(file, 0, sizeof(*file));
+
+    HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if(fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0) {
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    HANDLE mappingHandle = CreateFileMappingA(fileHandle, 0, PAGE_READONLY, 0, 0, 0);
+    if(!mappingHandle) {
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    void* data = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if(!data) {
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    file->data = (const uint8_t*)data;
+    file->size = (uint64_t)size.QuadPart;
+    file->fileHandle = fileHandle;
+    file->mappingHandle = mappingHandle;
+    return true;
+}
+
+void MappedFile_Close(MappedFile* file)
+{
+    if(file->data)
+        UnmapViewOfFile(file->data);
+    if(file->mappingHandle)
+        CloseHandle((HANDLE)file->mappingHandle);
+    if(file->fileHandle)
+        CloseHandle((HANDLE)file->fileHandle);
+    memset(file, 0, sizeof(*file));
+}
+
+#else
+
+bool MappedFile_Open(MappedFile* file, const char* path)
+{
+    memset(file, 0, sizeof(*file));
+    file->fd = -1;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    file->data = (const uint8_t*)data;
+    file->size = (uint64_t)st.st_size;
+    file->fd = fd;
+    return true;
+}
+
+void MappedFile_Close(MappedFile* file)
+{
+    if(file->data)
+        munmap((void*)file->data, (size_t)file->size);
+    if(file->fd >= 0)
+        close(file->fd);
+    memset(file, 0, sizeof(*file));
+    file->fd = -1;
+}
+
+#endif
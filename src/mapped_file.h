@@ -0,0 +1,21 @@
+#pragma once
+
+// Read-only memory mapping of a whole file. Backed by CreateFileMapping on
+// Windows and mmap everywhere else.
+
+#include "base.h"
+
+struct MappedFile
+{
+  const uint8_t* data;
+  uint64_t size;
+#if defined(_WIN32)
+  void* fileHandle;
+  void* mappingHandle;
+#else
+  int fd;
+#endif
+};
+
+bool MappedFile_Open(MappedFile* file, const char* path);
+void MappedFile_Close(MappedFile* file);
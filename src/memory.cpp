@@ -0,0 +1,202 @@
+#include "memory.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+    #include <malloc.h>
+#endif
+
+static thread_local MemoryArena* global_stbiArena = nullptr;
+
+static void* AlignedAlloc(size_t size)
+{
+#if defined(_WIN32)
+    return _aligned_malloc(size, MEMORY_DEFAULT_ALIGNMENT);
+#else
+    void* ptr = nullptr;
+    return posix_memalign(&ptr, MEMORY_DEFAULT_ALIGNMENT, size) == 0 ? ptr : nullptr;
+#endif
+}
+
+static void AlignedFree(void* ptr)
+{
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+bool MemoryArena_Init(MemoryArena* arena, size_t capacity, const char* name)
+{
+    *arena = {};
+    arena->name = name;
+    arena->base = (uint8_t*)AlignedAlloc(capacity);
+    if(!arena->base)
+        return false;
+    arena->capacity = capacity;
+    return true;
+}
+
+void MemoryArena_Release(MemoryArena* arena)
+{
+    AlignedFree(arena->base);
+    *arena = {};
+}
+
+void* MemoryArena_Push(MemoryArena* arena, size_t size, size_t alignment)
+{
+    assert(alignment && (alignment & (alignment - 1)) == 0);
+    size_t offset = (arena->used + alignment - 1) & ~(alignment - 1);
+    if(offset > arena->capacity || size > arena->capacity - offset) {
+        arena->numFailed++;
+        return nullptr;
+    }
+
+    arena->lastOffset = offset;
+    arena->used = offset + size;
+    if(arena->used > arena->highWater)
+        arena->highWater = arena->used;
+    arena->numAllocs++;
+    return arena->base + offset;
+}
+
+void* MemoryArena_Realloc(MemoryArena* arena, void* ptr, size_t oldSize, size_t newSize)
+{
+    if(!ptr)
+        return MemoryArena_Push(arena, newSize);
+    assert(MemoryArena_Owns(arena, ptr));
+
+    size_t offset = (size_t)((uint8_t*)ptr - arena->base);
+    if(offset == arena->lastOffset && newSize <= arena->capacity - offset)
+    {
+        arena->used = offset + newSize;
+        if(arena->used > arena->highWater)
+            arena->highWater = arena->used;
+        return ptr;
+    }
+
+    void* result = MemoryArena_Push(arena, newSize);
+    if(result)
+        memcpy(result, ptr, oldSize < newSize ? oldSize : newSize);
+    return result;
+}
+
+bool MemoryArena_Owns(const MemoryArena* arena, const void* ptr)
+{
+    return (const uint8_t*)ptr >= arena->base && (const uint8_t*)ptr < arena->base + arena->capacity;
+}
+
+void MemoryArena_Reset(MemoryArena* arena)
+{
+    arena->used = 0;
+    arena->lastOffset = 0;
+    arena->numResets++;
+}
+
+MemoryArenaMarker MemoryArena_GetMarker(const MemoryArena* arena)
+{
+    return { arena->used, arena->lastOffset };
+}
+
+void MemoryArena_Rewind(MemoryArena* arena, MemoryArenaMarker marker)
+{
+    assert(marker.used <= arena->used);
+    arena->used = marker.used;
+    arena->lastOffset = marker.lastOffset;
+}
+
+bool MemoryPool_Init(MemoryPool* pool, uint32_t slotSize, uint32_t capacity, const char* name)
+{
+    *pool = {};
+    pool->name = name;
+    pool->slotSize = (slotSize + MEMORY_DEFAULT_ALIGNMENT - 1) & ~(uint32_t)(MEMORY_DEFAULT_ALIGNMENT - 1);
+    pool->base = (uint8_t*)AlignedAlloc((size_t)pool->slotSize * capacity);
+    if(!pool->base)
+        return false;
+    pool->capacity = capacity;
+
+    // Thread the free list front to back so fresh pools hand out ascending addresses
+    for(uint32_t i = capacity; i-- > 0;)
+    {
+        void* slot = pool->base + (size_t)i * pool->slotSize;
+        *(void**)slot = pool->freeList;
+        pool->freeList = slot;
+    }
+    return true;
+}
+
+void MemoryPool_Release(MemoryPool* pool)
+{
+    AlignedFree(pool->base);
+    *pool = {};
+}
+
+void* MemoryPool_Alloc(MemoryPool* pool)
+{
+    void* slot = pool->freeList;
+    if(!slot) {
+        pool->numFailed++;
+        return nullptr;
+    }
+    pool->freeList = *(void**)slot;
+    pool->numUsed++;
+    if(pool->numUsed > pool->highWater)
+        pool->highWater = pool->numUsed;
+    pool->numAllocs++;
+    return slot;
+}
+
+void MemoryPool_Free(MemoryPool* pool, void* ptr)
+{
+    if(!ptr)
+        return;
+    assert((uint8_t*)ptr >= pool->base && (size_t)((uint8_t*)ptr - pool->base) % pool->slotSize == 0);
+    assert(pool->numUsed > 0);
+    *(void**)ptr = pool->freeList;
+    pool->freeList = ptr;
+    pool->numUsed--;
+}
+
+MemoryArena* Memory_BindStbiArena(MemoryArena* arena)
+{
+    MemoryArena* previous = global_stbiArena;
+    global_stbiArena = arena;
+    return previous;
+}
+
+void* Memory_StbiMalloc(size_t size)
+{
+    MemoryArena* arena = global_stbiArena;
+    void* ptr = arena ? MemoryArena_Push(arena, size) : nullptr;
+    return ptr ? ptr : malloc(size);
+}
+
+void* Memory_StbiRealloc(void* ptr, size_t oldSize, size_t newSize)
+{
+    MemoryArena* arena = global_stbiArena;
+    if(ptr && !(arena && MemoryArena_Owns(arena, ptr)))
+        return realloc(ptr, newSize);
+    if(arena)
+    {
+        void* result = MemoryArena_Realloc(arena, ptr, oldSize, newSize);
+        if(result)
+            return result;
+    }
+
+    // Arena full, move the block to the heap
+    void* result = malloc(newSize);
+    if(result && ptr)
+        memcpy(result, ptr, oldSize < newSize ? oldSize : newSize);
+    return result;
+}
+
+void Memory_StbiFree(void* ptr)
+{
+    MemoryArena* arena = global_stbiArena;
+    if(arena && MemoryArena_Owns(arena, ptr))
+        return;
+    free(ptr);
+}
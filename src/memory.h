@@ -0,0 +1,100 @@
+#pragma once
+
+// Allocators for short-lived and small data, so steady-state frames and asset
+// loads don't go through malloc:
+//
+// - MemoryArena: one fixed block, bump allocation, freed all at once by a
+//   reset. Used as the per-frame arena (reset at the top of the main loop) and
+//   as the scratch arena of a load.
+// - MemoryPool: fixed-size slots on a free list, for small objects that are
+//   created and destroyed individually.
+//
+// Neither is thread safe; give each thread its own or hand them out per job.
+// Both keep allocation counts and a high-water mark so budgets can be sized
+// from real runs.
+
+#include "base.h"
+
+#define MEMORY_DEFAULT_ALIGNMENT 16 // what malloc guarantees on x64, SSE loads rely on it
+
+struct MemoryArena
+{
+  const char* name;
+  uint8_t* base;
+  size_t capacity;
+  size_t used;
+  size_t lastOffset; // start of the most recent allocation, for growing it in place
+
+  // Stats
+  size_t highWater;
+  uint64_t numAllocs;    // since init
+  uint64_t numFailed;    // pushes that didn't fit
+  uint32_t numResets;
+};
+
+// Position to rewind to, for scoped temporaries inside a longer lived arena
+struct MemoryArenaMarker
+{
+  size_t used;
+  size_t lastOffset;
+};
+
+struct MemoryPool
+{
+  const char* name;
+  uint8_t* base;
+  void* freeList;
+  uint32_t slotSize;
+  uint32_t capacity; // in slots
+
+  // Stats
+  uint32_t numUsed;
+  uint32_t highWater;
+  uint64_t numAllocs;
+  uint64_t numFailed;
+};
+
+bool MemoryArena_Init(MemoryArena* arena, size_t capacity, const char* name);
+void MemoryArena_Release(MemoryArena* arena);
+
+// Returns null (and counts a failure) when the arena is full. alignment must be a power of two.
+void* MemoryArena_Push(MemoryArena* arena, size_t size, size_t alignment = MEMORY_DEFAULT_ALIGNMENT);
+// Grows ptr in place if it was the last allocation, otherwise pushes a copy.
+// The old block is not reclaimed until the next reset.
+void* MemoryArena_Realloc(MemoryArena* arena, void* ptr, size_t oldSize, size_t newSize);
+bool MemoryArena_Owns(const MemoryArena* arena, const void* ptr);
+void MemoryArena_Reset(MemoryArena* arena);
+MemoryArenaMarker MemoryArena_GetMarker(const MemoryArena* arena);
+void MemoryArena_Rewind(MemoryArena* arena, MemoryArenaMarker marker);
+
+#define MEMORY_PUSH_ARRAY(arena, Type, count) ((Type*)MemoryArena_Push((arena), sizeof(Type) * (count), alignof(Type) > MEMORY_DEFAULT_ALIGNMENT ? alignof(Type) : MEMORY_DEFAULT_ALIGNMENT))
+
+// Slots are slotSize rounded up to MEMORY_DEFAULT_ALIGNMENT.
+bool MemoryPool_Init(MemoryPool* pool, uint32_t slotSize, uint32_t capacity, const char* name);
+void MemoryPool_Release(MemoryPool* pool);
+// Returns null (and counts a failure) when every slot is in use.
+void* MemoryPool_Alloc(MemoryPool* pool);
+void MemoryPool_Free(MemoryPool* pool, void* ptr);
+
+////////////////////////////////////////////////////////////////
+// stb_image hooks
+//
+// While an arena is bound to the calling thread, stb_image allocates its
+// working buffers and the returned pixels from it and stbi_image_free is a
+// no-op, so a decode costs a handful of bumps and one reset afterwards.
+// Allocations that don't fit, and every allocation while nothing is bound, go
+// to the heap. Free pixels while the arena is still bound (or just drop them
+// and reset the arena). Include this header before defining
+// STB_IMAGE_IMPLEMENTATION.
+
+// Binds arena (may be null) to the calling thread and returns the previous binding.
+MemoryArena* Memory_BindStbiArena(MemoryArena* arena);
+void* Memory_StbiMalloc(size_t size);
+void* Memory_StbiRealloc(void* ptr, size_t oldSize, size_t newSize);
+void Memory_StbiFree(void* ptr);
+
+#ifndef STBI_MALLOC
+  #define STBI_MALLOC(size) Memory_StbiMalloc(size)
+  #define STBI_REALLOC_SIZED(ptr, oldSize, newSize) Memory_StbiRealloc(ptr, oldSize, newSize)
+  #define STBI_FREE(ptr) Memory_StbiFree(ptr)
+#endif
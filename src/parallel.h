@@ -0,0 +1,35 @@
+#pragma once
+
+// Fork-join helper for coarse offline/startup work (asset baking, shader
+// compiles). Spawns its threads per call, so keep it out of per-frame code.
+
+#include "base.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Calls func(i) for every i in [0, count) on up to numThreads threads
+// (0 = one per hardware core), the calling thread included.
+template<typename Func>
+static void ParallelForEach(uint32_t count, int numThreads, Func func)
+{
+  if(numThreads <= 0)
+    numThreads = (int)std::thread::hardware_concurrency();
+  if(numThreads <= 0)
+    numThreads = 1;
+  if((uint32_t)numThreads > count)
+    numThreads = (int)count;
+
+  std::atomic<uint32_t> next(0);
+  auto worker = [&]() {
+    for(uint32_t i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+      func(i);
+  };
+  std::vector<std::thread> threads;
+  for(int i = 1; i < numThreads; ++i)
+    threads.emplace_back(worker);
+  worker();
+  for(size_t i = 0; i < threads.size(); ++i)
+    threads[i].join();
+}
@@ -0,0 +1,259 @@
+#include "profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+struct Profiler
+{
+    std::atomic<bool> enabled;
+    double secondsPerTick;
+    uint64_t baseTicks; // trace timestamps are relative to Profiler_Init
+    std::atomic<uint32_t> numThreads;
+    std::atomic<ProfilerThread*> threads[PROFILER_MAX_THREADS];
+
+    // Frame window, main thread only
+    uint64_t lastFrameTicks;
+    uint32_t numFrames;
+    uint32_t nextFrame;
+    double frameMs[PROFILER_FRAME_HISTORY];
+};
+
+static Profiler global_profiler;
+static thread_local ProfilerThread* global_profilerThread;
+
+void Profiler_Init()
+{
+#if ARCH_X64
+    // The TSC is invariant on everything that runs D3D11 feature level 11 hardware,
+    // so a short calibration against the steady clock is enough.
+    double startSeconds = GetSeconds();
+    uint64_t startTicks = Profiler_ReadTicks();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    double elapsedSeconds = GetSeconds() - startSeconds;
+    uint64_t elapsedTicks = Profiler_ReadTicks() - startTicks;
+    global_profiler.secondsPerTick = elapsedSeconds / (double)(elapsedTicks ? elapsedTicks : 1);
+#else
+    global_profiler.secondsPerTick = 1e-9;
+#endif
+    global_profiler.baseTicks = Profiler_ReadTicks();
+    global_profiler.lastFrameTicks = global_profiler.baseTicks;
+    global_profiler.numFrames = 0;
+    global_profiler.nextFrame = 0;
+    global_profiler.enabled.store(true, std::memory_order_release);
+}
+
+void Profiler_SetEnabled(bool enabled)
+{
+    global_profiler.enabled.store(enabled, std::memory_order_release);
+}
+
+bool Profiler_IsEnabled()
+{
+    return global_profiler.enabled.load(std::memory_order_relaxed);
+}
+
+double Profiler_TicksToSeconds(uint64_t ticks)
+{
+    return (double)ticks * global_profiler.secondsPerTick;
+}
+
+ProfilerThread* Profiler_GetThread()
+{
+    if(global_profilerThread)
+        return global_profilerThread;
+
+    uint32_t index = global_profiler.numThreads.fetch_add(1, std::memory_order_acq_rel);
+    if(index >= PROFILER_MAX_THREADS)
+        return 0;
+
+    ProfilerThread* thread = new ProfilerThread;
+    snprintf(thread->name, sizeof(thread->name), "Thread %u", index);
+    thread->index = index;
+    thread->depth = 0;
+    thread->writeCount.store(0, std::memory_order_relaxed);
+    global_profiler.threads[index].store(thread, std::memory_order_release);
+    global_profilerThread = thread;
+    return thread;
+}
+
+void Profiler_SetThreadName(const char* name)
+{
+    ProfilerThread* thread = Profiler_GetThread();
+    if(!thread)
+        return;
+    // Readers may see a half-written name; it only ends up in a trace label
+    strncpy(thread->name, name, sizeof(thread->name) - 1);
+    thread->name[sizeof(thread->name) - 1] = 0;
+}
+
+void Profiler_Record(const char* name, uint64_t begin, uint64_t end, uint32_t depth)
+{
+    ProfilerThread* thread = Profiler_GetThread();
+    if(!thread)
+        return;
+    uint64_t writeCount = thread->writeCount.load(std::memory_order_relaxed);
+    ProfilerEvent* event = &thread->events[writeCount & (PROFILER_RING_SIZE - 1)];
+    event->name = name;
+    event->begin = begin;
+    event->end = end;
+    event->depth = depth;
+    thread->writeCount.store(writeCount + 1, std::memory_order_release);
+}
+
+void Profiler_FrameMark()
+{
+    uint64_t now = Profiler_ReadTicks();
+    uint64_t begin = global_profiler.lastFrameTicks;
+    global_profiler.lastFrameTicks = now;
+    if(!Profiler_IsEnabled())
+        return;
+
+    Profiler_Record("Frame", begin, now, 0);
+    global_profiler.frameMs[global_profiler.nextFrame] = Profiler_TicksToSeconds(now - begin) * 1000.0;
+    global_profiler.nextFrame = (global_profiler.nextFrame + 1) % PROFILER_FRAME_HISTORY;
+    if(global_profiler.numFrames < PROFILER_FRAME_HISTORY)
+        global_profiler.numFrames++;
+}
+
+void Profiler_GetFrameStats(ProfilerFrameStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    uint32_t numFrames = global_profiler.numFrames;
+    if(numFrames == 0)
+        return;
+
+    double sorted[PROFILER_FRAME_HISTORY];
+    memcpy(sorted, global_profiler.frameMs, numFrames * sizeof(double));
+    std::sort(sorted, sorted + numFrames);
+
+    // Nearest-rank percentiles
+    auto percentile = [&](double p) {
+        uint32_t rank = (uint32_t)ceil(p * numFrames);
+        return sorted[rank > 0 ? rank - 1 : 0];
+    };
+    double total = 0.0;
+    for(uint32_t i = 0; i < numFrames; ++i)
+        total += sorted[i];
+
+    stats->numFrames = numFrames;
+    stats->averageMs = total / numFrames;
+    stats->p50Ms = percentile(0.50);
+    stats->p95Ms = percentile(0.95);
+    stats->p99Ms = percentile(0.99);
+    stats->maxMs = sorted[numFrames - 1];
+}
+
+////////////////////////////////////////////////////////////////
+// Export
+
+struct ProfilerSnapshotEvent
+{
+    ProfilerEvent event;
+    const ProfilerThread* thread;
+};
+
+static void SnapshotEvents(std::vector<ProfilerSnapshotEvent>* events)
+{
+    events->clear();
+    uint32_t numThreads = std::min(global_profiler.numThreads.load(std::memory_order_acquire), (uint32_t)PROFILER_MAX_THREADS);
+    for(uint32_t t = 0; t < numThreads; ++t)
+    {
+        const ProfilerThread* thread = global_profiler.threads[t].load(std::memory_order_acquire);
+        if(!thread)
+            continue;
+
+        uint64_t endCount = thread->writeCount.load(std::memory_order_acquire);
+        uint64_t beginCount = endCount > PROFILER_RING_SIZE ? endCount - PROFILER_RING_SIZE : 0;
+        size_t firstCopied = events->size();
+        for(uint64_t i = beginCount; i < endCount; ++i)
+            events->push_back({ thread->events[i & (PROFILER_RING_SIZE - 1)], thread });
+
+        // The owner kept writing while we copied: everything up to one past the
+        // latest published event may have been overwritten, drop those slots.
+        // The fence keeps the copies above from moving past the re-read.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t laterCount = thread->writeCount.load(std::memory_order_relaxed);
+        uint64_t firstValid = laterCount + 1 > PROFILER_RING_SIZE ? laterCount + 1 - PROFILER_RING_SIZE : 0;
+        if(firstValid > beginCount) {
+            size_t numStale = (size_t)std::min(firstValid - beginCount, endCount - beginCount);
+            events->erase(events->begin() + firstCopied, events->begin() + firstCopied + numStale);
+        }
+    }
+}
+
+static void WriteJsonString(FILE* file, const char* string)
+{
+    fputc('"', file);
+    for(const char* c = string; *c; ++c)
+    {
+        if(*c == '"' || *c == '\\')
+            fputc('\\', file);
+        if((unsigned char)*c >= 0x20)
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static double TicksToTraceMicroseconds(uint64_t ticks)
+{
+    int64_t relative = (int64_t)(ticks - global_profiler.baseTicks);
+    return (double)relative * global_profiler.secondsPerTick * 1e6;
+}
+
+bool Profiler_WriteChromeTrace(const char* path)
+{
+    std::vector<ProfilerSnapshotEvent> events;
+    SnapshotEvents(&events);
+
+    FILE* file = fopen(path, "wb");
+    if(!file)
+        return false;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    uint32_t numThreads = std::min(global_profiler.numThreads.load(std::memory_order_acquire), (uint32_t)PROFILER_MAX_THREADS);
+    for(uint32_t t = 0; t < numThreads; ++t)
+    {
+        const ProfilerThread* thread = global_profiler.threads[t].load(std::memory_order_acquire);
+        if(!thread)
+            continue;
+        fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", thread->index);
+        WriteJsonString(file, thread->name);
+        fprintf(file, "}}");
+        first = false;
+    }
+    for(size_t i = 0; i < events.size(); ++i)
+    {
+        const ProfilerEvent* event = &events[i].event;
+        fprintf(file, "%s{\"ph\":\"X\",\"name\":", first ? "" : ",\n");
+        WriteJsonString(file, event->name);
+        fprintf(file, ",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", events[i].thread->index,
+                TicksToTraceMicroseconds(event->begin), Profiler_TicksToSeconds(event->end - event->begin) * 1e6);
+        first = false;
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
+bool Profiler_WriteCSV(const char* path)
+{
+    std::vector<ProfilerSnapshotEvent> events;
+    SnapshotEvents(&events);
+
+    FILE* file = fopen(path, "wb");
+    if(!file)
+        return false;
+
+    fprintf(file, "thread,name,depth,begin_us,duration_us\n");
+    for(size_t i = 0; i < events.size(); ++i)
+    {
+        const ProfilerEvent* event = &events[i].event;
+        fprintf(file, "%s,%s,%u,%.3f,%.3f\n", events[i].thread->name, event->name, event->depth,
+                TicksToTraceMicroseconds(event->begin), Profiler_TicksToSeconds(event->end - event->begin) * 1e6);
+    }
+    return fclose(file) == 0;
+}
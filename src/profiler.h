@@ -0,0 +1,125 @@
+#pragma once
+
+// Scoped-zone frame profiler. Every thread that records gets its own ring
+// buffer of completed zones; the owning thread is the only writer, so
+// recording is two timestamp reads and one release store, with no locks or
+// shared cache lines. Old events are overwritten once a ring wraps, which keeps
+// the cost constant no matter how long the profiler runs.
+//
+// Timestamps come from rdtsc on x64 (calibrated against the steady clock at
+// init) and from std::chrono elsewhere, so the same zones work on Win32 and in
+// the headless Linux build.
+//
+//   PROFILE_ZONE("Present");   // records until the end of the enclosing scope
+//   Profiler_FrameMark();      // once per frame on the main thread
+
+#include "base.h"
+
+#include <atomic>
+
+#ifndef PROFILER_ENABLED
+  #define PROFILER_ENABLED 1
+#endif
+
+#define PROFILER_RING_SIZE 16384 // events per thread, power of two
+#define PROFILER_MAX_THREADS 64
+#define PROFILER_MAX_THREAD_NAME 32
+#define PROFILER_FRAME_HISTORY 512 // frames in the rolling percentile window
+
+#if ARCH_X64 && defined(_MSC_VER)
+  #include <intrin.h>
+#elif ARCH_X64
+  #include <x86intrin.h>
+#endif
+
+struct ProfilerEvent
+{
+  const char* name; // must outlive the profiler, normally a string literal
+  uint64_t begin;
+  uint64_t end;
+  uint32_t depth;
+};
+
+struct ProfilerThread
+{
+  char name[PROFILER_MAX_THREAD_NAME];
+  uint32_t index;
+  uint32_t depth; // only touched by the owning thread
+  std::atomic<uint64_t> writeCount;
+  ProfilerEvent events[PROFILER_RING_SIZE];
+};
+
+struct ProfilerFrameStats
+{
+  uint32_t numFrames; // frames in the window
+  double averageMs;
+  double p50Ms;
+  double p95Ms;
+  double p99Ms;
+  double maxMs;
+};
+
+static inline uint64_t Profiler_ReadTicks()
+{
+#if ARCH_X64
+  return __rdtsc();
+#else
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Calibrates the tick rate; call once before any thread records. Rings are
+// allocated on a thread's first zone and live until the process exits.
+void Profiler_Init();
+void Profiler_SetEnabled(bool enabled);
+bool Profiler_IsEnabled();
+double Profiler_TicksToSeconds(uint64_t ticks);
+
+// Optional, shows up as the thread's name in trace viewers.
+void Profiler_SetThreadName(const char* name);
+ProfilerThread* Profiler_GetThread();
+void Profiler_Record(const char* name, uint64_t begin, uint64_t end, uint32_t depth);
+
+// Closes the current frame: records a "Frame" zone and feeds the rolling window.
+void Profiler_FrameMark();
+void Profiler_GetFrameStats(ProfilerFrameStats* stats);
+
+// Snapshots every ring and writes whatever hasn't been overwritten yet. Safe to
+// call while other threads keep recording. Returns false if the file can't be written.
+bool Profiler_WriteChromeTrace(const char* path); // chrome://tracing / Perfetto
+bool Profiler_WriteCSV(const char* path);
+
+struct ProfilerZone
+{
+  const char* name;
+  uint64_t begin;
+  ProfilerThread* thread;
+
+  explicit ProfilerZone(const char* zoneName)
+  {
+    thread = Profiler_IsEnabled() ? Profiler_GetThread() : 0;
+    if(thread) {
+      name = zoneName;
+      thread->depth++;
+      begin = Profiler_ReadTicks();
+    }
+  }
+  ~ProfilerZone()
+  {
+    if(thread) {
+      uint64_t end = Profiler_ReadTicks();
+      thread->depth--;
+      Profiler_Record(name, begin, end, thread->depth);
+    }
+  }
+};
+
+#if PROFILER_ENABLED
+  #define PROFILER_CONCAT2(a, b) a##b
+  #define PROFILER_CONCAT(a, b) PROFILER_CONCAT2(a, b)
+  #define PROFILE_ZONE(name) ProfilerZone PROFILER_CONCAT(profilerZone_, __LINE__)(name)
+  #define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#else
+  #define PROFILE_ZONE(name)
+  #define PROFILE_FUNCTION()
+#endif
@@ -0,0 +1,178 @@
+#include "quad_batch.h"
+#include "profiler.h"
+
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+
+void QuadBatch_Init(QuadBatch* batch, uint32_t ringCapacity)
+{
+    assert(ringCapacity > 0);
+    batch->ring.capacity = ringCapacity;
+    // Starting full makes the very first map a discard
+    batch->ring.head = ringCapacity;
+}
+
+void QuadBatch_Add(QuadBatch* batch, uint64_t sortKey, const float rect[4], const float uvRect[4], uint32_t color)
+{
+    batch->keys.push_back(sortKey);
+    batch->x.push_back(rect[0]);
+    batch->y.push_back(rect[1]);
+    batch->width.push_back(rect[2]);
+    batch->height.push_back(rect[3]);
+    batch->u0.push_back(uvRect[0]);
+    batch->v0.push_back(uvRect[1]);
+    batch->u1.push_back(uvRect[2]);
+    batch->v1.push_back(uvRect[3]);
+    batch->colors.push_back(color);
+}
+
+uint32_t QuadBatch_Count(const QuadBatch* batch)
+{
+    return (uint32_t)batch->keys.size();
+}
+
+void QuadBatch_Sort(QuadBatch* batch)
+{
+    PROFILE_ZONE("QuadBatch_Sort");
+    uint32_t count = QuadBatch_Count(batch);
+    batch->sortedKeys.assign(batch->keys.begin(), batch->keys.end());
+    batch->keyScratch.resize(count);
+    batch->order.resize(count);
+    batch->orderScratch.resize(count);
+    for(uint32_t i = 0; i < count; ++i)
+        batch->order[i] = i;
+    if(count < 2)
+        return;
+
+    // One read over the keys builds the histograms of all 8 digits
+    uint32_t histograms[8][256];
+    memset(histograms, 0, sizeof(histograms));
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        uint64_t key = batch->sortedKeys[i];
+        for(int digit = 0; digit < 8; ++digit)
+            histograms[digit][(key >> (digit * 8)) & 0xFF]++;
+    }
+
+    uint64_t* keys = batch->sortedKeys.data();
+    uint64_t* keysOut = batch->keyScratch.data();
+    uint32_t* order = batch->order.data();
+    uint32_t* orderOut = batch->orderScratch.data();
+    for(int digit = 0; digit < 8; ++digit)
+    {
+        uint32_t* histogram = histograms[digit];
+        int shift = digit * 8;
+        // Typical keys only use a few distinct layers/shaders/textures
+        if(histogram[(keys[0] >> shift) & 0xFF] == count)
+            continue;
+
+        uint32_t offsets[256];
+        uint32_t sum = 0;
+        for(int bucket = 0; bucket < 256; ++bucket)
+        {
+            offsets[bucket] = sum;
+            sum += histogram[bucket];
+        }
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t dst = offsets[(keys[i] >> shift) & 0xFF]++;
+            keysOut[dst] = keys[i];
+            orderOut[dst] = order[i];
+        }
+        std::swap(keys, keysOut);
+        std::swap(order, orderOut);
+    }
+
+    // An odd number of passes leaves the result in the scratch arrays
+    if(keys != batch->sortedKeys.data()) {
+        batch->sortedKeys.swap(batch->keyScratch);
+        batch->order.swap(batch->orderScratch);
+    }
+}
+
+QuadMapMode QuadRing_Alloc(QuadRing* ring, uint32_t count, uint32_t* firstInstance)
+{
+    assert(count <= ring->capacity);
+    QuadMapMode mode = QuadMapMode_NoOverwrite;
+    if(count > ring->capacity - ring->head) {
+        ring->head = 0;
+        mode = QuadMapMode_Discard;
+    }
+    *firstInstance = ring->head;
+    ring->head += count;
+    return mode;
+}
+
+void QuadBatch_Flush(QuadBatch* batch, const QuadBackend* backend, QuadBatchStats* stats)
+{
+    PROFILE_ZONE("QuadBatch_Flush");
+    QuadBatchStats flushStats = {};
+    uint32_t count = QuadBatch_Count(batch);
+    flushStats.numQuads = count;
+    QuadBatch_Sort(batch);
+
+    // Anything bigger than the ring goes out in ring-sized chunks. Each chunk's
+    // draws are issued before the next map, because a discard only protects
+    // draws that were already submitted.
+    uint32_t done = 0;
+    while(done < count)
+    {
+        uint32_t chunkCount = count - done;
+        if(chunkCount > batch->ring.capacity)
+            chunkCount = batch->ring.capacity;
+
+        uint32_t firstInstance;
+        QuadMapMode mode = QuadRing_Alloc(&batch->ring, chunkCount, &firstInstance);
+        QuadInstance* instances = (QuadInstance*)backend->map(mode, backend->userData) + firstInstance;
+        flushStats.numMaps++;
+        if(mode == QuadMapMode_Discard)
+            flushStats.numDiscards++;
+
+        // Gather from the staging arrays in sorted order; the destination is
+        // written strictly sequentially since it is usually write-combined memory
+        const uint32_t* order = batch->order.data() + done;
+        for(uint32_t i = 0; i < chunkCount; ++i)
+        {
+            uint32_t src = order[i];
+            QuadInstance instance;
+            instance.rect[0] = batch->x[src];
+            instance.rect[1] = batch->y[src];
+            instance.rect[2] = batch->width[src];
+            instance.rect[3] = batch->height[src];
+            instance.uvRect[0] = batch->u0[src];
+            instance.uvRect[1] = batch->v0[src];
+            instance.uvRect[2] = batch->u1[src];
+            instance.uvRect[3] = batch->v1[src];
+            instance.color = batch->colors[src];
+            instances[i] = instance;
+        }
+        backend->unmap(backend->userData);
+
+        const uint64_t* sortedKeys = batch->sortedKeys.data() + done;
+        uint32_t runStart = 0;
+        while(runStart < chunkCount)
+        {
+            uint32_t runEnd = runStart + 1;
+            while(runEnd < chunkCount && sortedKeys[runEnd] == sortedKeys[runStart])
+                ++runEnd;
+            backend->draw(sortedKeys[runStart], firstInstance + runStart, runEnd - runStart, backend->userData);
+            flushStats.numDraws++;
+            runStart = runEnd;
+        }
+        done += chunkCount;
+    }
+
+    batch->keys.clear();
+    batch->x.clear();
+    batch->y.clear();
+    batch->width.clear();
+    batch->height.clear();
+    batch->u0.clear();
+    batch->v0.clear();
+    batch->u1.clear();
+    batch->v1.clear();
+    batch->colors.clear();
+    if(stats)
+        *stats = flushStats;
+}
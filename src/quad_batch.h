@@ -0,0 +1,108 @@
+#pragma once
+
+// Batched quad/sprite renderer. Quads are accumulated in SoA staging arrays,
+// stable-sorted by a 64 bit layer/shader/texture key at flush time and streamed
+// into one large dynamic instance buffer, one DrawInstanced per run of equal
+// keys.
+//
+// The instance buffer is used as a ring: appends map with NO_OVERWRITE, and
+// once the ring is full the next map is a DISCARD so the driver renames the
+// buffer instead of stalling on draws still reading it. All of that is driven
+// through QuadBackend callbacks, so the batching, sorting and ring logic has no
+// D3D dependency and runs headless.
+
+#include "base.h"
+#include "vertex_format.h"
+
+#include <vector>
+
+// GPU layout of one quad, read per instance by res/shaders/quad_vs.hlsl
+struct QuadInstance
+{
+  float rect[4];   // x, y (bottom-left corner), width, height in clip space
+  float uvRect[4]; // u0, v0 (top-left), u1, v1
+  uint32_t color;  // RGBA8, R in the lowest byte
+};
+
+typedef VertexFormat<VertexAttrib<VertexSemantic_Rect, VertexAttribFormat_Float32x4>,
+                     VertexAttrib<VertexSemantic_Texcoord, VertexAttribFormat_Float32x4>,
+                     VertexAttrib<VertexSemantic_Color, VertexAttribFormat_Unorm8x4>> QuadInstanceFormat;
+
+VERTEX_FORMAT_CHECK_STRIDE(QuadInstance, QuadInstanceFormat);
+VERTEX_FORMAT_CHECK_MEMBER(QuadInstance, QuadInstanceFormat, 0, rect);
+VERTEX_FORMAT_CHECK_MEMBER(QuadInstance, QuadInstanceFormat, 1, uvRect);
+VERTEX_FORMAT_CHECK_MEMBER(QuadInstance, QuadInstanceFormat, 2, color);
+
+enum QuadMapMode
+{
+  QuadMapMode_NoOverwrite, // D3D11_MAP_WRITE_NO_OVERWRITE
+  QuadMapMode_Discard,     // D3D11_MAP_WRITE_DISCARD
+};
+
+// map returns the start of the instance buffer. draw instances are addressed
+// from the start of the buffer (StartInstanceLocation), so the vertex buffer
+// binding never changes.
+typedef void* QuadMapFunc(QuadMapMode mode, void* userData);
+typedef void QuadUnmapFunc(void* userData);
+typedef void QuadDrawFunc(uint64_t sortKey, uint32_t firstInstance, uint32_t instanceCount, void* userData);
+
+struct QuadBackend
+{
+  QuadMapFunc* map;
+  QuadUnmapFunc* unmap;
+  QuadDrawFunc* draw;
+  void* userData;
+};
+
+struct QuadRing
+{
+  uint32_t capacity; // in instances
+  uint32_t head;
+};
+
+struct QuadBatchStats
+{
+  uint32_t numQuads;
+  uint32_t numDraws;
+  uint32_t numMaps;
+  uint32_t numDiscards;
+};
+
+struct QuadBatch
+{
+  // Staging, one element per quad in submission order
+  std::vector<uint64_t> keys;
+  std::vector<float> x, y, width, height;
+  std::vector<float> u0, v0, u1, v1;
+  std::vector<uint32_t> colors;
+
+  // Sort scratch, kept around so steady-state flushes don't allocate
+  std::vector<uint64_t> sortedKeys, keyScratch;
+  std::vector<uint32_t> order, orderScratch;
+
+  QuadRing ring;
+};
+
+// Layer is the most significant part so it can be used for back-to-front
+// ordering; within a key quads keep their submission order.
+static inline uint64_t QuadBatch_MakeKey(uint16_t layer, uint16_t shader, uint32_t texture)
+{
+  return ((uint64_t)layer << 48) | ((uint64_t)shader << 32) | texture;
+}
+
+// ringCapacity is the size of the backend's instance buffer, in instances.
+void QuadBatch_Init(QuadBatch* batch, uint32_t ringCapacity);
+void QuadBatch_Add(QuadBatch* batch, uint64_t sortKey, const float rect[4], const float uvRect[4], uint32_t color);
+uint32_t QuadBatch_Count(const QuadBatch* batch);
+
+// Stable LSD radix sort of the staged keys into batch->sortedKeys / order.
+// Byte positions where every key is equal are skipped.
+void QuadBatch_Sort(QuadBatch* batch);
+
+// Reserves count contiguous instances. Wraps to the start with a discard when
+// the rest of the ring is too small; count must not exceed the capacity.
+QuadMapMode QuadRing_Alloc(QuadRing* ring, uint32_t count, uint32_t* firstInstance);
+
+// Sorts, streams and draws everything staged since the last flush, then clears
+// the staging arrays. stats may be null.
+void QuadBatch_Flush(QuadBatch* batch, const QuadBackend* backend, QuadBatchStats* stats);
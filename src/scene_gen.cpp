@@ -0,0 +1,25 @@
+#include "scene_gen.h"
+
+void SceneGen_RandomTriangles(std::vector<float>* vertexData, uint32_t numTris, uint32_t seed)
+{
+    vertexData->resize((size_t)numTris * 3 * 6);
+    float* v = vertexData->data();
+    uint32_t state = seed;
+    auto next = [&state]() { state = state * 1664525u + 1013904223u; return (float)(state >> 8) / 16777216.0f; };
+    for(uint32_t t = 0; t < numTris; ++t)
+    {
+        float cx = next() * 2.0f - 1.0f;
+        float cy = next() * 2.0f - 1.0f;
+        float size = 0.01f + next() * 0.05f;
+        float corners[3][2] = { { cx, cy + size }, { cx + size, cy - size }, { cx - size, cy - size } };
+        for(int i = 0; i < 3; ++i)
+        {
+            *v++ = corners[i][0];
+            *v++ = corners[i][1];
+            *v++ = next();
+            *v++ = next();
+            *v++ = next();
+            *v++ = 1.0f;
+        }
+    }
+}
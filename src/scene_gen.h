@@ -0,0 +1,13 @@
+#pragma once
+
+// Deterministic synthetic scenes for the headless tests and benchmarks. Same
+// seed, same vertices on every platform, so framebuffer hashes can be compared
+// between machines and commits.
+
+#include "base.h"
+
+#include <vector>
+
+// Small clockwise triangles scattered over clip space in the BasicVertex layout
+// (x, y, r, g, b, a per vertex). Replaces the contents of vertexData.
+void SceneGen_RandomTriangles(std::vector<float>* vertexData, uint32_t numTris, uint32_t seed);
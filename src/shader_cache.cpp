@@ -0,0 +1,339 @@
+#include "shader_cache.h"
+#include "parallel.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(_WIN32)
+    #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+    #define NOMINMAX
+    #endif
+    #include <windows.h>
+#endif
+
+#define SHADER_CACHE_ALIGNMENT 16
+#define SHADER_CACHE_MAX_INCLUDE_DEPTH 16
+
+static bool ReadWholeFile(const char* path, std::string* contents)
+{
+    FILE* file = fopen(path, "rb");
+    if(!file)
+        return false;
+    contents->clear();
+    char buffer[4096];
+    size_t bytesRead;
+    while((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        contents->append(buffer, bytesRead);
+    fclose(file);
+    return true;
+}
+
+static std::string DirectoryOf(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+static uint64_t HashString(const char* string, uint64_t hash)
+{
+    // Include the terminator so ("ab", "c") and ("a", "bc") hash differently
+    if(!string)
+        string = "";
+    return Fnv1a64(string, strlen(string) + 1, hash);
+}
+
+// Hashes the contents of every file reached via #include "..." (or <...>),
+// resolved relative to the including file like D3D_COMPILE_STANDARD_FILE_INCLUDE.
+// Anything that can't be opened only contributes its name; the compiler will
+// report it when the key misses.
+static uint64_t HashIncludes(const std::string& source, const std::string& directory, int depth,
+                             std::vector<std::string>* visited, uint64_t hash)
+{
+    if(depth >= SHADER_CACHE_MAX_INCLUDE_DEPTH)
+        return hash;
+
+    size_t pos = 0;
+    while((pos = source.find("#", pos)) != std::string::npos)
+    {
+        size_t cursor = pos + 1;
+        pos = cursor;
+        while(cursor < source.size() && (source[cursor] == ' ' || source[cursor] == '\t'))
+            ++cursor;
+        if(source.compare(cursor, 7, "include") != 0)
+            continue;
+        cursor += 7;
+        while(cursor < source.size() && (source[cursor] == ' ' || source[cursor] == '\t'))
+            ++cursor;
+        if(cursor >= source.size() || (source[cursor] != '"' && source[cursor] != '<'))
+            continue;
+        char terminator = source[cursor] == '"' ? '"' : '>';
+        size_t end = source.find(terminator, cursor + 1);
+        if(end == std::string::npos)
+            break;
+
+        std::string name = source.substr(cursor + 1, end - cursor - 1);
+        std::string includePath = directory + name;
+        hash = HashString(name.c_str(), hash);
+        if(std::find(visited->begin(), visited->end(), includePath) != visited->end())
+            continue;
+        visited->push_back(includePath);
+
+        std::string contents;
+        if(ReadWholeFile(includePath.c_str(), &contents))
+        {
+            hash = Fnv1a64(contents.data(), contents.size(), hash);
+            hash = HashIncludes(contents, DirectoryOf(includePath), depth + 1, visited, hash);
+        }
+        pos = end;
+    }
+    return hash;
+}
+
+bool ShaderCache_ComputeKey(const ShaderDesc* desc, uint64_t* key)
+{
+    std::string source;
+    if(!ReadWholeFile(desc->path, &source))
+        return false;
+
+    uint64_t hash = FNV1A64_INITIAL;
+    hash = Fnv1a64(source.data(), source.size(), hash);
+    std::vector<std::string> visited;
+    hash = HashIncludes(source, DirectoryOf(desc->path), 0, &visited, hash);
+    hash = HashString(desc->entryPoint, hash);
+    hash = HashString(desc->profile, hash);
+    hash = Fnv1a64(&desc->flags, sizeof(desc->flags), hash);
+    for(uint32_t i = 0; i < desc->numDefines; ++i)
+    {
+        hash = HashString(desc->defines[i].name, hash);
+        hash = HashString(desc->defines[i].value, hash);
+    }
+    *key = hash;
+    return true;
+}
+
+void ShaderCache_Open(ShaderCache* cache, const char* path, uint64_t compilerSalt)
+{
+    cache->path = path;
+    cache->compilerSalt = compilerSalt;
+    cache->header = 0;
+    cache->entries = 0;
+    cache->added.clear();
+    cache->numHits = 0;
+    cache->numMisses = 0;
+
+    if(!MappedFile_Open(&cache->file, path))
+        return;
+
+    const ShaderCacheHeader* header = (const ShaderCacheHeader*)cache->file.data;
+    bool valid = cache->file.size >= sizeof(ShaderCacheHeader)
+              && header->magic == SHADER_CACHE_MAGIC
+              && header->version == SHADER_CACHE_VERSION
+              && header->compilerSalt == compilerSalt
+              && header->fileSize == cache->file.size
+              && header->entriesOffset <= cache->file.size
+              && (uint64_t)header->numEntries * sizeof(ShaderCacheEntry) <= cache->file.size - header->entriesOffset
+              && (header->entriesOffset % alignof(ShaderCacheEntry)) == 0;
+    if(valid)
+    {
+        const ShaderCacheEntry* entries = (const ShaderCacheEntry*)(cache->file.data + header->entriesOffset);
+        for(uint32_t i = 0; i < header->numEntries && valid; ++i)
+        {
+            valid = entries[i].offset <= cache->file.size && entries[i].size <= cache->file.size - entries[i].offset
+                 && (i == 0 || entries[i - 1].key < entries[i].key);
+        }
+    }
+    if(!valid) {
+        MappedFile_Close(&cache->file);
+        return;
+    }
+
+    cache->header = header;
+    cache->entries = (const ShaderCacheEntry*)(cache->file.data + header->entriesOffset);
+}
+
+void ShaderCache_Close(ShaderCache* cache)
+{
+    if(cache->header)
+        MappedFile_Close(&cache->file);
+    cache->header = 0;
+    cache->entries = 0;
+    cache->added.clear();
+}
+
+bool ShaderCache_Find(const ShaderCache* cache, uint64_t key, const void** bytecode, size_t* size)
+{
+    for(size_t i = 0; i < cache->added.size(); ++i)
+    {
+        if(cache->added[i].persistent && cache->added[i].key == key) {
+            *bytecode = cache->added[i].bytecode.data();
+            *size = cache->added[i].bytecode.size();
+            return true;
+        }
+    }
+
+    if(!cache->header)
+        return false;
+    const ShaderCacheEntry* begin = cache->entries;
+    const ShaderCacheEntry* end = cache->entries + cache->header->numEntries;
+    const ShaderCacheEntry* entry = std::lower_bound(begin, end, key, [](const ShaderCacheEntry& e, uint64_t k) { return e.key < k; });
+    if(entry == end || entry->key != key)
+        return false;
+
+    // Catches torn or corrupted writes; a bad entry simply gets recompiled
+    const uint8_t* data = cache->file.data + entry->offset;
+    if(Fnv1a64(data, (size_t)entry->size) != entry->checksum)
+        return false;
+    *bytecode = data;
+    *size = (size_t)entry->size;
+    return true;
+}
+
+void ShaderCache_Get(ShaderCache* cache, const ShaderDesc* descs, ShaderResult* results, uint32_t count,
+                     ShaderCompileFunc* compile, void* userData, int numThreads)
+{
+    std::vector<uint32_t> misses;
+    std::vector<uint64_t> keys(count);
+    std::vector<bool> hasKey(count);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        ShaderResult* result = &results[i];
+        result->ok = false;
+        result->fromCache = false;
+        result->bytecode = 0;
+        result->size = 0;
+        result->errors.clear();
+
+        hasKey[i] = ShaderCache_ComputeKey(&descs[i], &keys[i]);
+        if(hasKey[i] && ShaderCache_Find(cache, keys[i], &result->bytecode, &result->size)) {
+            result->ok = true;
+            result->fromCache = true;
+            ++cache->numHits;
+        }
+        else {
+            misses.push_back(i);
+            ++cache->numMisses;
+        }
+    }
+    if(misses.empty())
+        return;
+
+    std::vector<std::vector<uint8_t>> compiled(misses.size());
+    ParallelForEach((uint32_t)misses.size(), numThreads, [&](uint32_t m) {
+        uint32_t i = misses[m];
+        results[i].ok = compile(&descs[i], &compiled[m], &results[i].errors, userData);
+    });
+
+    // Results point into `added`; reserve so later inserts don't move the vectors around
+    cache->added.reserve(cache->added.size() + misses.size());
+    for(size_t m = 0; m < misses.size(); ++m)
+    {
+        uint32_t i = misses[m];
+        if(!results[i].ok)
+            continue;
+        // If the compiler found a file we couldn't read there is no valid key;
+        // hand the bytecode out but never persist it
+        ShaderCacheBlob blob;
+        blob.key = keys[i];
+        blob.persistent = hasKey[i];
+        blob.bytecode = std::move(compiled[m]);
+        cache->added.push_back(std::move(blob));
+        results[i].bytecode = cache->added.back().bytecode.data();
+        results[i].size = cache->added.back().bytecode.size();
+    }
+}
+
+bool ShaderCache_Save(ShaderCache* cache)
+{
+    bool anyPersistent = false;
+    for(size_t i = 0; i < cache->added.size(); ++i)
+        anyPersistent = anyPersistent || cache->added[i].persistent;
+    if(!anyPersistent)
+        return true;
+
+    struct PendingEntry
+    {
+        uint64_t key;
+        const uint8_t* data;
+        uint64_t size;
+    };
+    std::vector<PendingEntry> pending;
+    for(size_t i = 0; i < cache->added.size(); ++i)
+        if(cache->added[i].persistent)
+            pending.push_back({ cache->added[i].key, cache->added[i].bytecode.data(), cache->added[i].bytecode.size() });
+    if(cache->header)
+    {
+        for(uint32_t i = 0; i < cache->header->numEntries; ++i)
+        {
+            const ShaderCacheEntry* entry = &cache->entries[i];
+            pending.push_back({ entry->key, cache->file.data + entry->offset, entry->size });
+        }
+    }
+    // New blobs come first, so a stable sort + unique keeps them over stale copies
+    std::stable_sort(pending.begin(), pending.end(), [](const PendingEntry& a, const PendingEntry& b) { return a.key < b.key; });
+    pending.erase(std::unique(pending.begin(), pending.end(), [](const PendingEntry& a, const PendingEntry& b) { return a.key == b.key; }), pending.end());
+
+    ShaderCacheHeader header = {};
+    header.magic = SHADER_CACHE_MAGIC;
+    header.version = SHADER_CACHE_VERSION;
+    header.compilerSalt = cache->compilerSalt;
+    header.entriesOffset = sizeof(ShaderCacheHeader);
+    header.numEntries = (uint32_t)pending.size();
+
+    std::vector<ShaderCacheEntry> entries(pending.size());
+    uint64_t offset = header.entriesOffset + pending.size() * sizeof(ShaderCacheEntry);
+    for(size_t i = 0; i < pending.size(); ++i)
+    {
+        offset = (offset + SHADER_CACHE_ALIGNMENT - 1) & ~(uint64_t)(SHADER_CACHE_ALIGNMENT - 1);
+        entries[i].key = pending[i].key;
+        entries[i].offset = offset;
+        entries[i].size = pending[i].size;
+        entries[i].checksum = Fnv1a64(pending[i].data, (size_t)pending[i].size);
+        offset += pending[i].size;
+    }
+    header.fileSize = offset;
+
+    // Build the whole file in memory: the old mapping has to be released before
+    // the file can be replaced on Windows.
+    std::vector<uint8_t> image((size_t)header.fileSize, 0);
+    memcpy(&image[0], &header, sizeof(header));
+    if(!entries.empty())
+        memcpy(&image[(size_t)header.entriesOffset], entries.data(), entries.size() * sizeof(ShaderCacheEntry));
+    for(size_t i = 0; i < pending.size(); ++i)
+        memcpy(&image[(size_t)entries[i].offset], pending[i].data, (size_t)pending[i].size);
+
+    std::string path = cache->path;
+    uint64_t compilerSalt = cache->compilerSalt;
+    uint32_t numHits = cache->numHits;
+    uint32_t numMisses = cache->numMisses;
+    ShaderCache_Close(cache);
+
+    std::string tempPath = path + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    bool ok = file != 0;
+    if(file)
+    {
+        ok = fwrite(image.data(), 1, image.size(), file) == image.size();
+        ok = (fclose(file) == 0) && ok;
+    }
+    if(ok)
+    {
+        // Replace in one step so a crash leaves either the old or the new cache;
+        // Windows rename() fails if the target exists
+#if defined(_WIN32)
+        ok = MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        ok = rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+    }
+    if(!ok)
+        remove(tempPath.c_str());
+
+    ShaderCache_Open(cache, path.c_str(), compilerSalt);
+    cache->numHits = numHits;
+    cache->numMisses = numMisses;
+    return ok;
+}
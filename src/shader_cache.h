@@ -0,0 +1,110 @@
+#pragma once
+
+// Persistent shader bytecode cache. Entries are keyed by a hash of everything
+// that affects compiler output: source text, every file reached through
+// #include "...", defines, entry point, profile and compile flags. The cache is
+// a single file that gets memory mapped at startup, so a warm start never
+// touches the compiler. Misses are compiled in parallel through a callback,
+// which keeps this file free of any D3D dependency.
+//
+// File layout (little-endian):
+//   ShaderCacheHeader
+//   ShaderCacheEntry[numEntries]   sorted by key
+//   bytecode blobs                 16-byte aligned
+
+#include "base.h"
+#include "mapped_file.h"
+
+#include <string>
+#include <vector>
+
+#define SHADER_CACHE_MAGIC 0x43444853u // "SHDC"
+#define SHADER_CACHE_VERSION 1
+
+// Same layout as D3D_SHADER_MACRO
+struct ShaderDefine
+{
+  const char* name;
+  const char* value;
+};
+
+struct ShaderDesc
+{
+  const char* path;
+  const char* entryPoint;
+  const char* profile;
+  uint32_t flags;
+  const ShaderDefine* defines;
+  uint32_t numDefines;
+};
+
+struct ShaderCacheHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t compilerSalt; // entries from a different compiler are discarded
+  uint64_t entriesOffset;
+  uint32_t numEntries;
+  uint32_t reserved;
+  uint64_t fileSize;
+  uint64_t reserved2;
+};
+
+struct ShaderCacheEntry
+{
+  uint64_t key;
+  uint64_t offset;
+  uint64_t size;
+  uint64_t checksum;
+};
+
+static_assert(sizeof(ShaderCacheHeader) == 48, "ShaderCacheHeader layout changed");
+static_assert(sizeof(ShaderCacheEntry) == 32, "ShaderCacheEntry layout changed");
+
+struct ShaderCacheBlob
+{
+  uint64_t key;
+  bool persistent; // false if the key couldn't be computed
+  std::vector<uint8_t> bytecode;
+};
+
+struct ShaderCache
+{
+  std::string path;
+  uint64_t compilerSalt;
+  MappedFile file;
+  const ShaderCacheHeader* header; // null if there was no valid cache file
+  const ShaderCacheEntry* entries;
+  std::vector<ShaderCacheBlob> added; // compiled this run, written by Save
+  uint32_t numHits;
+  uint32_t numMisses;
+};
+
+struct ShaderResult
+{
+  bool ok;
+  bool fromCache;
+  const void* bytecode;
+  size_t size;
+  std::string errors;
+};
+
+// Returns false and leaves the errors in `errors` on failure.
+typedef bool ShaderCompileFunc(const ShaderDesc* desc, std::vector<uint8_t>* bytecode, std::string* errors, void* userData);
+
+// A missing or stale cache file is not an error, the cache just starts empty.
+void ShaderCache_Open(ShaderCache* cache, const char* path, uint64_t compilerSalt);
+void ShaderCache_Close(ShaderCache* cache);
+
+// False if the source file (not an include) can't be read.
+bool ShaderCache_ComputeKey(const ShaderDesc* desc, uint64_t* key);
+bool ShaderCache_Find(const ShaderCache* cache, uint64_t key, const void** bytecode, size_t* size);
+
+// Looks every shader up and compiles the misses on up to numThreads threads
+// (0 = one per core). Bytecode pointers stay valid until Save or Close.
+void ShaderCache_Get(ShaderCache* cache, const ShaderDesc* descs, ShaderResult* results, uint32_t count,
+                     ShaderCompileFunc* compile, void* userData, int numThreads);
+
+// Rewrites the cache file if anything was compiled. Entries that weren't used
+// this run are kept, so switching between configurations stays warm.
+bool ShaderCache_Save(ShaderCache* cache);
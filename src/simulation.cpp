@@ -0,0 +1,247 @@
+#include "simulation.h"
+#include "profiler.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define SIM_TWO_PI 6.28318530718f
+#define SIM_SNAPSHOT_FRESH 4u // set on the shared index while the renderer hasn't taken it
+
+struct SimSnapshot
+{
+    SimState previous;
+    SimState current;
+};
+
+struct Simulation
+{
+    InputQueue* input;
+    double stepSeconds;
+    std::thread thread;
+    std::atomic<bool> quit;
+
+    // Triple buffer: the simulation fills back, swaps it with shared, and the
+    // renderer swaps shared with front when it is marked fresh. Nobody ever
+    // reads a snapshot that is being written.
+    SimSnapshot snapshots[3];
+    uint32_t back;  // simulation thread only
+    uint32_t front; // renderer only
+    std::atomic<uint32_t> shared;
+
+    std::mutex statsMutex;
+    SimulationStats stats;
+    std::vector<double> latencies; // ring, seconds
+    std::vector<double> tickLateness;
+    uint64_t numLatencies;
+};
+
+void Simulation_ApplyEvent(SimState* state, const InputEvent* event)
+{
+    uint32_t bit = 1u << event->key;
+    if(event->type == InputEventType_KeyDown)
+        state->heldKeys |= bit;
+    else
+        state->heldKeys &= ~bit;
+}
+
+void Simulation_Step(SimState* state, double stepSeconds)
+{
+    const float acceleration = 6.0f; // clip space units per second squared
+    const float damping = 4.0f;      // per second
+    const float limit = 0.95f;
+    float dt = (float)stepSeconds;
+
+    float direction[2] = {
+        (float)((state->heldKeys >> InputKey_Right) & 1) - (float)((state->heldKeys >> InputKey_Left) & 1),
+        (float)((state->heldKeys >> InputKey_Up) & 1) - (float)((state->heldKeys >> InputKey_Down) & 1),
+    };
+    for(int i = 0; i < 2; ++i)
+    {
+        state->velocity[i] += direction[i] * acceleration * dt;
+        state->velocity[i] -= state->velocity[i] * std::min(1.0f, damping * dt);
+        state->position[i] += state->velocity[i] * dt;
+        if(state->position[i] < -limit || state->position[i] > limit) {
+            state->position[i] = std::max(-limit, std::min(limit, state->position[i]));
+            state->velocity[i] = 0.0f;
+        }
+    }
+
+    state->phase = fmodf(state->phase + 3.0f * dt, SIM_TWO_PI);
+    state->tick++;
+    state->time += stepSeconds;
+}
+
+static void PublishSnapshot(Simulation* simulation, const SimState* previous, const SimState* current)
+{
+    SimSnapshot* snapshot = &simulation->snapshots[simulation->back];
+    snapshot->previous = *previous;
+    snapshot->current = *current;
+    uint32_t old = simulation->shared.exchange(simulation->back | SIM_SNAPSHOT_FRESH, std::memory_order_acq_rel);
+    simulation->back = old & 3;
+}
+
+static void WaitUntil(const Simulation* simulation, double time)
+{
+    // Sleep most of the way, then yield for the last stretch; sleep wakeups are
+    // only accurate to about a millisecond
+    for(;;)
+    {
+        double remaining = time - GetSeconds();
+        if(remaining <= 0.0 || simulation->quit.load(std::memory_order_relaxed))
+            return;
+        if(remaining > 0.002)
+            std::this_thread::sleep_for(std::chrono::duration<double>(remaining - 0.0015));
+        else
+            std::this_thread::yield();
+    }
+}
+
+static void RecordSample(std::vector<double>* ring, uint64_t index, double value)
+{
+    (*ring)[index % ring->size()] = value;
+}
+
+static void SimulationThreadMain(Simulation* simulation)
+{
+    Profiler_SetThreadName("Simulation");
+    double step = simulation->stepSeconds;
+
+    SimState state = {};
+    state.time = GetSeconds();
+    SimState previous = state;
+    bool hasHeldEvent = false;
+    InputEvent heldEvent;
+
+    while(!simulation->quit.load(std::memory_order_relaxed))
+    {
+        double tickTime = state.time + step;
+        WaitUntil(simulation, tickTime);
+        double now = GetSeconds();
+        uint64_t skipped = 0;
+        if(now - tickTime > SIM_MAX_LAG_SECONDS)
+        {
+            // Too far behind to catch up smoothly, drop the missed ticks
+            skipped = (uint64_t)((now - tickTime) / step);
+            state.time += skipped * step;
+            tickTime = state.time + step;
+        }
+
+        PROFILE_ZONE("SimulationTick");
+        // Events belong to the tick during which they happened; anything newer
+        // waits for the next one
+        std::lock_guard<std::mutex> lock(simulation->statsMutex);
+        for(;;)
+        {
+            if(!hasHeldEvent && !InputQueue_Pop(simulation->input, &heldEvent))
+                break;
+            hasHeldEvent = true;
+            if(heldEvent.timestamp > tickTime)
+                break;
+            Simulation_ApplyEvent(&state, &heldEvent);
+            RecordSample(&simulation->latencies, simulation->numLatencies++, now - heldEvent.timestamp);
+            simulation->stats.numEvents++;
+            hasHeldEvent = false;
+        }
+
+        previous = state;
+        Simulation_Step(&state, step);
+        PublishSnapshot(simulation, &previous, &state);
+
+        RecordSample(&simulation->tickLateness, simulation->stats.numTicks, now - tickTime);
+        simulation->stats.numTicks++;
+        simulation->stats.numSkippedTicks += skipped;
+    }
+}
+
+Simulation* Simulation_Create(InputQueue* input, double ticksPerSecond)
+{
+    Simulation* simulation = new Simulation;
+    simulation->input = input;
+    simulation->stepSeconds = 1.0 / ticksPerSecond;
+    simulation->quit.store(false, std::memory_order_relaxed);
+    memset(simulation->snapshots, 0, sizeof(simulation->snapshots));
+    simulation->back = 0;
+    simulation->front = 1;
+    simulation->shared.store(2, std::memory_order_relaxed);
+    simulation->stats = {};
+    simulation->latencies.resize(SIM_LATENCY_HISTORY);
+    simulation->tickLateness.resize(SIM_LATENCY_HISTORY);
+    simulation->numLatencies = 0;
+    simulation->thread = std::thread(SimulationThreadMain, simulation);
+    return simulation;
+}
+
+void Simulation_Destroy(Simulation* simulation)
+{
+    simulation->quit.store(true, std::memory_order_relaxed);
+    simulation->thread.join();
+    delete simulation;
+}
+
+double Simulation_GetStepSeconds(const Simulation* simulation)
+{
+    return simulation->stepSeconds;
+}
+
+bool Simulation_GetRenderState(Simulation* simulation, double now, SimState* state)
+{
+    if(simulation->shared.load(std::memory_order_relaxed) & SIM_SNAPSHOT_FRESH)
+    {
+        uint32_t old = simulation->shared.exchange(simulation->front, std::memory_order_acq_rel);
+        simulation->front = old & 3;
+    }
+    const SimSnapshot* snapshot = &simulation->snapshots[simulation->front];
+    if(snapshot->current.tick == 0)
+        return false;
+
+    // now is somewhere after current.time; render one step behind it
+    const SimState* a = &snapshot->previous;
+    const SimState* b = &snapshot->current;
+    float alpha = (float)((now - b->time) / simulation->stepSeconds);
+    alpha = std::max(0.0f, std::min(1.0f, alpha));
+
+    *state = *b;
+    state->time = a->time + (b->time - a->time) * alpha;
+    float phaseB = b->phase < a->phase ? b->phase + SIM_TWO_PI : b->phase;
+    state->phase = fmodf(a->phase + (phaseB - a->phase) * alpha, SIM_TWO_PI);
+    for(int i = 0; i < 2; ++i)
+    {
+        state->position[i] = a->position[i] + (b->position[i] - a->position[i]) * alpha;
+        state->velocity[i] = a->velocity[i] + (b->velocity[i] - a->velocity[i]) * alpha;
+    }
+    return true;
+}
+
+static double Percentile(std::vector<double>* sorted, double p)
+{
+    if(sorted->empty())
+        return 0.0;
+    return (*sorted)[std::min(sorted->size() - 1, (size_t)(p * sorted->size()))];
+}
+
+void Simulation_GetStats(Simulation* simulation, SimulationStats* stats)
+{
+    std::vector<double> latencies, lateness;
+    {
+        std::lock_guard<std::mutex> lock(simulation->statsMutex);
+        *stats = simulation->stats;
+        size_t numLatencies = (size_t)std::min<uint64_t>(simulation->numLatencies, SIM_LATENCY_HISTORY);
+        size_t numLateness = (size_t)std::min<uint64_t>(simulation->stats.numTicks, SIM_LATENCY_HISTORY);
+        latencies.assign(simulation->latencies.begin(), simulation->latencies.begin() + numLatencies);
+        lateness.assign(simulation->tickLateness.begin(), simulation->tickLateness.begin() + numLateness);
+    }
+    stats->numDropped = simulation->input->numDropped.load(std::memory_order_relaxed);
+
+    std::sort(latencies.begin(), latencies.end());
+    std::sort(lateness.begin(), lateness.end());
+    stats->latencyP50Ms = Percentile(&latencies, 0.5) * 1000.0;
+    stats->latencyP99Ms = Percentile(&latencies, 0.99) * 1000.0;
+    stats->latencyMaxMs = latencies.empty() ? 0.0 : latencies.back() * 1000.0;
+    stats->tickLateP99Ms = Percentile(&lateness, 0.99) * 1000.0;
+    stats->tickLateMaxMs = lateness.empty() ? 0.0 : lateness.back() * 1000.0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+// Fixed-timestep simulation on its own thread, decoupled from vsync and the
+// message pump. Every tick drains the input events that happened up to the
+// tick's time, advances the state by exactly one step and publishes the last
+// two states. The renderer picks up the newest pair without blocking and
+// interpolates between them, so motion stays smooth at any refresh rate at
+// the cost of one tick of display lag.
+//
+// Ticks are scheduled on absolute times (start + n * step). A late tick runs
+// immediately; if the thread falls more than SIM_MAX_LAG_SECONDS behind, the
+// missed ticks are skipped instead of replayed in a burst.
+
+#include "base.h"
+#include "input_queue.h"
+
+#define SIM_MAX_LAG_SECONDS 0.25
+#define SIM_LATENCY_HISTORY 4096 // events kept for the latency percentiles
+
+struct Simulation;
+
+struct SimState
+{
+  uint64_t tick;
+  double time;       // GetSeconds() time this state represents
+  float phase;       // animation phase, radians
+  float position[2]; // clip space
+  float velocity[2];
+  uint32_t heldKeys; // bit per InputKey
+};
+
+struct SimulationStats
+{
+  uint64_t numTicks;
+  uint64_t numSkippedTicks;
+  uint64_t numEvents;
+  uint32_t numDropped; // lost to a full input queue
+  // Event timestamp to the tick that consumed it
+  double latencyP50Ms;
+  double latencyP99Ms;
+  double latencyMaxMs;
+  // How late ticks started against their schedule
+  double tickLateP99Ms;
+  double tickLateMaxMs;
+};
+
+// Pure simulation rules, usable without the thread (replays, tests).
+void Simulation_ApplyEvent(SimState* state, const InputEvent* event);
+void Simulation_Step(SimState* state, double stepSeconds);
+
+// Starts the simulation thread. input is consumed only by that thread.
+Simulation* Simulation_Create(InputQueue* input, double ticksPerSecond);
+void Simulation_Destroy(Simulation* simulation);
+double Simulation_GetStepSeconds(const Simulation* simulation);
+
+// Renderer side: blends the two newest states for the given GetSeconds() time.
+// Returns false until the first tick was published.
+bool Simulation_GetRenderState(Simulation* simulation, double now, SimState* state);
+void Simulation_GetStats(Simulation* simulation, SimulationStats* stats);
@@ -0,0 +1,10 @@
+#pragma once
+
+// stb_image declarations for modules that decode images. The platform layer
+// owns STB_IMAGE_IMPLEMENTATION; including the vendor header again with it
+// still defined would emit the implementation twice, so this only includes it
+// when the unity build hasn't already.
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+  #include "vendor/stb_image.h"
+#endif
@@ -0,0 +1,809 @@
+#include "sw_renderer.h"
+#include "profiler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Positions are snapped to 1/16th of a pixel. Together with the guard band this
+// keeps every edge function inside a partially covered tile within 32 bits.
+#define SW_SUBPIXEL_BITS 4
+#define SW_SUBPIXEL_ONE (1 << SW_SUBPIXEL_BITS)
+#define SW_SUBPIXEL_HALF (SW_SUBPIXEL_ONE / 2)
+#define SW_GUARD_BAND 4096.0f
+#define SW_SRGB_LUT_SIZE 4096
+#define SW_MAX_CLIP_VERTS 8
+
+struct SwVertex
+{
+    float x, y; // pixels
+    float color[4];
+};
+
+struct SwTriangle
+{
+    int64_t edgeAtOrigin[3]; // edge value at the centre of pixel (0,0), fill-rule bias included
+    int32_t edgeStepX[3];
+    int32_t edgeStepY[3];
+    int32_t minX, minY, maxX, maxY; // inclusive pixel bounds, clamped to viewport and framebuffer
+    float colorAtOrigin[4];
+    float colorStepX[4];
+    float colorStepY[4];
+};
+
+struct SwDraw
+{
+    const uint8_t* vertices;
+    uint32_t stride;
+    uint32_t numTris;
+    uint32_t firstTri; // global triangle index of this draw's first triangle
+    SoftwareViewport viewport;
+};
+
+// Triangles set up by one binner plus, per tile, the indices of those that touch it.
+// Binners own contiguous ranges of the submitted triangles, so walking binners in
+// order while rasterizing a tile preserves API submission order.
+struct SwBinner
+{
+    std::vector<SwTriangle> triangles;
+    std::vector<std::vector<uint32_t>> tileBins;
+    uint32_t firstTri;
+    uint32_t endTri;
+};
+
+typedef void SwTaskFunc(SoftwareRenderer* renderer, uint32_t index);
+
+struct SoftwareRenderer
+{
+    // Framebuffer
+    uint32_t* pixels;
+    int width;
+    int height;
+    int pitch;
+    int tilesX;
+    int tilesY;
+
+    // Frame state
+    bool clearPending;
+    uint32_t clearValue;
+    SoftwareViewport viewport;
+    std::vector<SwDraw> draws;
+    uint32_t numQueuedTris;
+    std::vector<SwBinner> binners;
+
+    bool useAVX2;
+    int32_t srgbLut[SW_SRGB_LUT_SIZE];
+
+    // Worker threads. The calling thread always participates, so a renderer
+    // created with N threads spawns N-1 workers.
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+    uint64_t generation;
+    int busyWorkers;
+    bool quit;
+    SwTaskFunc* task;
+    uint32_t taskCount;
+    std::atomic<uint32_t> nextTaskIndex;
+};
+
+static float SrgbFromLinear(float linear)
+{
+    if(linear <= 0.0031308f)
+        return linear * 12.92f;
+    return 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+}
+
+static uint32_t PackColor(const int32_t* srgbLut, float r, float g, float b, float a)
+{
+    r = fminf(fmaxf(r, 0.0f), 1.0f);
+    g = fminf(fmaxf(g, 0.0f), 1.0f);
+    b = fminf(fmaxf(b, 0.0f), 1.0f);
+    a = fminf(fmaxf(a, 0.0f), 1.0f);
+    uint32_t r8 = (uint32_t)srgbLut[(int)(r * (SW_SRGB_LUT_SIZE - 1) + 0.5f)];
+    uint32_t g8 = (uint32_t)srgbLut[(int)(g * (SW_SRGB_LUT_SIZE - 1) + 0.5f)];
+    uint32_t b8 = (uint32_t)srgbLut[(int)(b * (SW_SRGB_LUT_SIZE - 1) + 0.5f)];
+    uint32_t a8 = (uint32_t)(a * 255.0f + 0.5f);
+    return b8 | (g8 << 8) | (r8 << 16) | (a8 << 24);
+}
+
+////////////////////////////////////////////////////////////////
+// Thread pool
+
+static void RunTasks(SoftwareRenderer* renderer)
+{
+    for(;;)
+    {
+        uint32_t index = renderer->nextTaskIndex.fetch_add(1, std::memory_order_relaxed);
+        if(index >= renderer->taskCount)
+            break;
+        renderer->task(renderer, index);
+    }
+}
+
+static void WorkerThreadMain(SoftwareRenderer* renderer)
+{
+    Profiler_SetThreadName("SwRenderer Worker");
+    uint64_t seenGeneration = 0;
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(renderer->mutex);
+            renderer->wakeCondition.wait(lock, [&] { return renderer->quit || renderer->generation != seenGeneration; });
+            if(renderer->quit)
+                return;
+            seenGeneration = renderer->generation;
+        }
+
+        RunTasks(renderer);
+
+        std::lock_guard<std::mutex> lock(renderer->mutex);
+        if(--renderer->busyWorkers == 0)
+            renderer->doneCondition.notify_one();
+    }
+}
+
+static void ParallelFor(SoftwareRenderer* renderer, SwTaskFunc* task, uint32_t count)
+{
+    if(count == 0)
+        return;
+
+    renderer->task = task;
+    renderer->taskCount = count;
+    renderer->nextTaskIndex.store(0, std::memory_order_relaxed);
+
+    if(!renderer->workers.empty())
+    {
+        std::lock_guard<std::mutex> lock(renderer->mutex);
+        renderer->busyWorkers = (int)renderer->workers.size();
+        renderer->generation++;
+        renderer->wakeCondition.notify_all();
+    }
+
+    RunTasks(renderer);
+
+    if(!renderer->workers.empty())
+    {
+        std::unique_lock<std::mutex> lock(renderer->mutex);
+        renderer->doneCondition.wait(lock, [&] { return renderer->busyWorkers == 0; });
+    }
+}
+
+////////////////////////////////////////////////////////////////
+// Triangle setup and binning
+
+static void SetupTriangle(SoftwareRenderer* renderer, SwBinner* binner, const SwVertex* v, const SoftwareViewport* viewport)
+{
+    int32_t fx[3], fy[3];
+    for(int i = 0; i < 3; ++i)
+    {
+        fx[i] = (int32_t)floorf(v[i].x * SW_SUBPIXEL_ONE + 0.5f);
+        fy[i] = (int32_t)floorf(v[i].y * SW_SUBPIXEL_ONE + 0.5f);
+    }
+
+    // D3D11 default rasterizer state: clockwise is front facing, back faces are culled.
+    // In y-down screen space that means a positive signed area.
+    int64_t area = (int64_t)(fx[1] - fx[0]) * (fy[2] - fy[0]) - (int64_t)(fy[1] - fy[0]) * (fx[2] - fx[0]);
+    if(area <= 0)
+        return;
+
+    // Pixel bounds; a pixel is a candidate if its centre lies inside the snapped bounding box
+    int32_t minFx = fx[0], maxFx = fx[0], minFy = fy[0], maxFy = fy[0];
+    for(int i = 1; i < 3; ++i)
+    {
+        if(fx[i] < minFx) minFx = fx[i];
+        if(fx[i] > maxFx) maxFx = fx[i];
+        if(fy[i] < minFy) minFy = fy[i];
+        if(fy[i] > maxFy) maxFy = fy[i];
+    }
+
+    int32_t clipMinX = (int32_t)ceilf(viewport->x);
+    int32_t clipMinY = (int32_t)ceilf(viewport->y);
+    int32_t clipMaxX = (int32_t)ceilf(viewport->x + viewport->width) - 1;
+    int32_t clipMaxY = (int32_t)ceilf(viewport->y + viewport->height) - 1;
+    if(clipMinX < 0) clipMinX = 0;
+    if(clipMinY < 0) clipMinY = 0;
+    if(clipMaxX > renderer->width - 1) clipMaxX = renderer->width - 1;
+    if(clipMaxY > renderer->height - 1) clipMaxY = renderer->height - 1;
+
+    SwTriangle tri;
+    tri.minX = (minFx - SW_SUBPIXEL_HALF + SW_SUBPIXEL_ONE - 1) >> SW_SUBPIXEL_BITS;
+    tri.minY = (minFy - SW_SUBPIXEL_HALF + SW_SUBPIXEL_ONE - 1) >> SW_SUBPIXEL_BITS;
+    tri.maxX = (maxFx - SW_SUBPIXEL_HALF) >> SW_SUBPIXEL_BITS;
+    tri.maxY = (maxFy - SW_SUBPIXEL_HALF) >> SW_SUBPIXEL_BITS;
+    if(tri.minX < clipMinX) tri.minX = clipMinX;
+    if(tri.minY < clipMinY) tri.minY = clipMinY;
+    if(tri.maxX > clipMaxX) tri.maxX = clipMaxX;
+    if(tri.maxY > clipMaxY) tri.maxY = clipMaxY;
+    if(tri.minX > tri.maxX || tri.minY > tri.maxY)
+        return;
+
+    for(int i = 0; i < 3; ++i)
+    {
+        int a = i;
+        int b = (i + 1) % 3;
+        int32_t edgeA = fy[a] - fy[b];
+        int32_t edgeB = fx[b] - fx[a];
+        // Top-left rule: pixels exactly on an edge belong to the triangle only for top and left edges
+        bool isTopLeft = (edgeA > 0) || (edgeA == 0 && edgeB > 0);
+        tri.edgeAtOrigin[i] = (int64_t)edgeA * (SW_SUBPIXEL_HALF - fx[a]) + (int64_t)edgeB * (SW_SUBPIXEL_HALF - fy[a]) + (isTopLeft ? 0 : -1);
+        tri.edgeStepX[i] = edgeA * SW_SUBPIXEL_ONE;
+        tri.edgeStepY[i] = edgeB * SW_SUBPIXEL_ONE;
+    }
+
+    // Attribute plane equations, evaluated at pixel centres
+    float x0 = (float)fx[0] / SW_SUBPIXEL_ONE, y0 = (float)fy[0] / SW_SUBPIXEL_ONE;
+    float dx1 = (float)(fx[1] - fx[0]) / SW_SUBPIXEL_ONE, dy1 = (float)(fy[1] - fy[0]) / SW_SUBPIXEL_ONE;
+    float dx2 = (float)(fx[2] - fx[0]) / SW_SUBPIXEL_ONE, dy2 = (float)(fy[2] - fy[0]) / SW_SUBPIXEL_ONE;
+    float invArea = 1.0f / (dx1 * dy2 - dy1 * dx2);
+    for(int c = 0; c < 4; ++c)
+    {
+        float dc1 = v[1].color[c] - v[0].color[c];
+        float dc2 = v[2].color[c] - v[0].color[c];
+        float stepX = (dc1 * dy2 - dc2 * dy1) * invArea;
+        float stepY = (dc2 * dx1 - dc1 * dx2) * invArea;
+        tri.colorStepX[c] = stepX;
+        tri.colorStepY[c] = stepY;
+        tri.colorAtOrigin[c] = v[0].color[c] + stepX * (0.5f - x0) + stepY * (0.5f - y0);
+    }
+
+    uint32_t triIndex = (uint32_t)binner->triangles.size();
+    binner->triangles.push_back(tri);
+
+    int tileMinX = tri.minX / SW_TILE_SIZE, tileMaxX = tri.maxX / SW_TILE_SIZE;
+    int tileMinY = tri.minY / SW_TILE_SIZE, tileMaxY = tri.maxY / SW_TILE_SIZE;
+    bool singleTile = (tileMinX == tileMaxX && tileMinY == tileMaxY);
+    for(int ty = tileMinY; ty <= tileMaxY; ++ty)
+    {
+        for(int tx = tileMinX; tx <= tileMaxX; ++tx)
+        {
+            if(!singleTile)
+            {
+                // Skip tiles that lie entirely outside one of the edges
+                int32_t px0 = tx * SW_TILE_SIZE, px1 = px0 + SW_TILE_SIZE - 1;
+                int32_t py0 = ty * SW_TILE_SIZE, py1 = py0 + SW_TILE_SIZE - 1;
+                bool outside = false;
+                for(int i = 0; i < 3 && !outside; ++i)
+                {
+                    int64_t maxEdge = tri.edgeAtOrigin[i]
+                        + (int64_t)tri.edgeStepX[i] * (tri.edgeStepX[i] > 0 ? px1 : px0)
+                        + (int64_t)tri.edgeStepY[i] * (tri.edgeStepY[i] > 0 ? py1 : py0);
+                    outside = maxEdge < 0;
+                }
+                if(outside)
+                    continue;
+            }
+            binner->tileBins[ty * renderer->tilesX + tx].push_back(triIndex);
+        }
+    }
+}
+
+static int ClipPolygonAgainstPlane(const SwVertex* in, int count, SwVertex* out, int axis, float sign, float limit)
+{
+    // Keeps the part of the polygon where sign * (p[axis] - limit) <= 0
+    int outCount = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        const SwVertex* a = &in[i];
+        const SwVertex* b = &in[(i + 1) % count];
+        float da = sign * ((axis == 0 ? a->x : a->y) - limit);
+        float db = sign * ((axis == 0 ? b->x : b->y) - limit);
+        if(da <= 0.0f)
+            out[outCount++] = *a;
+        if((da <= 0.0f) != (db <= 0.0f))
+        {
+            float t = da / (da - db);
+            SwVertex* v = &out[outCount++];
+            v->x = a->x + (b->x - a->x) * t;
+            v->y = a->y + (b->y - a->y) * t;
+            for(int c = 0; c < 4; ++c)
+                v->color[c] = a->color[c] + (b->color[c] - a->color[c]) * t;
+        }
+    }
+    return outCount;
+}
+
+static void BinTriangles(SoftwareRenderer* renderer, uint32_t binnerIndex)
+{
+    PROFILE_ZONE("BinTriangles");
+    SwBinner* binner = &renderer->binners[binnerIndex];
+    if(binner->firstTri >= binner->endTri)
+        return;
+
+    float guardMinX = -SW_GUARD_BAND, guardMaxX = (float)renderer->width + SW_GUARD_BAND;
+    float guardMinY = -SW_GUARD_BAND, guardMaxY = (float)renderer->height + SW_GUARD_BAND;
+
+    size_t drawIndex = 0;
+    while(renderer->draws[drawIndex].firstTri + renderer->draws[drawIndex].numTris <= binner->firstTri)
+        ++drawIndex;
+
+    for(uint32_t globalTri = binner->firstTri; globalTri < binner->endTri; ++globalTri)
+    {
+        while(globalTri >= renderer->draws[drawIndex].firstTri + renderer->draws[drawIndex].numTris)
+            ++drawIndex;
+        const SwDraw* draw = &renderer->draws[drawIndex];
+        const SoftwareViewport* vp = &draw->viewport;
+
+        // Input assembler + vertex shader (basic_vs.hlsl passes position and colour through)
+        // followed by the viewport transform
+        SwVertex v[3];
+        const uint8_t* src = draw->vertices + (size_t)(globalTri - draw->firstTri) * 3 * draw->stride;
+        for(int i = 0; i < 3; ++i)
+        {
+            const float* f = (const float*)(src + i * draw->stride);
+            v[i].x = vp->x + (f[0] + 1.0f) * 0.5f * vp->width;
+            v[i].y = vp->y + (1.0f - f[1]) * 0.5f * vp->height;
+            v[i].color[0] = f[2];
+            v[i].color[1] = f[3];
+            v[i].color[2] = f[4];
+            v[i].color[3] = f[5];
+        }
+
+        // Trivial reject against the framebuffer
+        if((v[0].x < 0.0f && v[1].x < 0.0f && v[2].x < 0.0f) ||
+           (v[0].y < 0.0f && v[1].y < 0.0f && v[2].y < 0.0f) ||
+           (v[0].x > renderer->width && v[1].x > renderer->width && v[2].x > renderer->width) ||
+           (v[0].y > renderer->height && v[1].y > renderer->height && v[2].y > renderer->height))
+            continue;
+
+        bool insideGuardBand = true;
+        for(int i = 0; i < 3; ++i)
+        {
+            if(!(v[i].x >= guardMinX && v[i].x <= guardMaxX && v[i].y >= guardMinY && v[i].y <= guardMaxY))
+                insideGuardBand = false;
+        }
+        if(insideGuardBand)
+        {
+            SetupTriangle(renderer, binner, v, &draw->viewport);
+            continue;
+        }
+
+        // Rare: clip against the guard band and fan-triangulate the result
+        SwVertex polyA[SW_MAX_CLIP_VERTS], polyB[SW_MAX_CLIP_VERTS];
+        int count = 3;
+        memcpy(polyA, v, sizeof(v));
+        count = ClipPolygonAgainstPlane(polyA, count, polyB, 0, -1.0f, guardMinX);
+        count = ClipPolygonAgainstPlane(polyB, count, polyA, 0, 1.0f, guardMaxX);
+        count = ClipPolygonAgainstPlane(polyA, count, polyB, 1, -1.0f, guardMinY);
+        count = ClipPolygonAgainstPlane(polyB, count, polyA, 1, 1.0f, guardMaxY);
+        for(int i = 1; i + 1 < count; ++i)
+        {
+            SwVertex fan[3] = { polyA[0], polyA[i], polyA[i + 1] };
+            SetupTriangle(renderer, binner, fan, &draw->viewport);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////
+// Tile rasterization
+
+// Pixel region of one triangle inside one tile. Edges that are known to be
+// non-negative over the whole region have a zero step and value so they never
+// reject anything; the remaining edges are guaranteed to fit in 32 bits.
+struct SwRegion
+{
+    int32_t minX, minY, maxX, maxY;
+    int32_t edgeAtMin[3]; // at (minX, minY)
+    int32_t edgeStepX[3];
+    int32_t edgeStepY[3];
+};
+
+static bool SetupRegion(const SwTriangle* tri, int tileX, int tileY, SwRegion* region)
+{
+    region->minX = tri->minX > tileX ? tri->minX : tileX;
+    region->minY = tri->minY > tileY ? tri->minY : tileY;
+    region->maxX = tri->maxX < tileX + SW_TILE_SIZE - 1 ? tri->maxX : tileX + SW_TILE_SIZE - 1;
+    region->maxY = tri->maxY < tileY + SW_TILE_SIZE - 1 ? tri->maxY : tileY + SW_TILE_SIZE - 1;
+    if(region->minX > region->maxX || region->minY > region->maxY)
+        return false;
+
+    for(int i = 0; i < 3; ++i)
+    {
+        int64_t stepX = tri->edgeStepX[i];
+        int64_t stepY = tri->edgeStepY[i];
+        int64_t atMin = tri->edgeAtOrigin[i] + stepX * region->minX + stepY * region->minY;
+        int64_t spanX = stepX * (region->maxX - region->minX);
+        int64_t spanY = stepY * (region->maxY - region->minY);
+        int64_t lowest = atMin + (spanX < 0 ? spanX : 0) + (spanY < 0 ? spanY : 0);
+        int64_t highest = atMin + (spanX > 0 ? spanX : 0) + (spanY > 0 ? spanY : 0);
+        if(highest < 0)
+            return false;
+        if(lowest >= 0)
+        {
+            region->edgeAtMin[i] = 0;
+            region->edgeStepX[i] = 0;
+            region->edgeStepY[i] = 0;
+        }
+        else
+        {
+            region->edgeAtMin[i] = (int32_t)atMin;
+            region->edgeStepX[i] = (int32_t)stepX;
+            region->edgeStepY[i] = (int32_t)stepY;
+        }
+    }
+    return true;
+}
+
+#if !ARCH_X64
+static void RasterizeRegion_Scalar(SoftwareRenderer* renderer, const SwTriangle* tri, const SwRegion* region)
+{
+    int32_t edgeRow[3] = { region->edgeAtMin[0], region->edgeAtMin[1], region->edgeAtMin[2] };
+    for(int y = region->minY; y <= region->maxY; ++y)
+    {
+        uint32_t* row = renderer->pixels + (size_t)y * renderer->pitch;
+        int32_t e0 = edgeRow[0], e1 = edgeRow[1], e2 = edgeRow[2];
+        for(int x = region->minX; x <= region->maxX; ++x)
+        {
+            if((e0 | e1 | e2) >= 0)
+            {
+                float c[4];
+                for(int i = 0; i < 4; ++i)
+                    c[i] = (tri->colorAtOrigin[i] + tri->colorStepY[i] * y) + tri->colorStepX[i] * x;
+                row[x] = PackColor(renderer->srgbLut, c[0], c[1], c[2], c[3]);
+            }
+            e0 += region->edgeStepX[0];
+            e1 += region->edgeStepX[1];
+            e2 += region->edgeStepX[2];
+        }
+        for(int i = 0; i < 3; ++i)
+            edgeRow[i] += region->edgeStepY[i];
+    }
+}
+#endif
+
+#if ARCH_X64
+static void RasterizeRegion_SSE2(SoftwareRenderer* renderer, const SwTriangle* tri, const SwRegion* region)
+{
+    // 4 pixels per iteration; the first column is aligned down so rows start on a 16 byte boundary
+    int startX = region->minX & ~3;
+    int32_t leadIn = region->minX - startX;
+
+    __m128i laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i edgeLane[3], edgeStep4[3];
+    for(int i = 0; i < 3; ++i)
+    {
+        int32_t s = region->edgeStepX[i];
+        edgeLane[i] = _mm_setr_epi32(-leadIn * s, (1 - leadIn) * s, (2 - leadIn) * s, (3 - leadIn) * s);
+        edgeStep4[i] = _mm_set1_epi32(4 * s);
+    }
+
+    __m128 colorStepX[4];
+    for(int i = 0; i < 4; ++i)
+        colorStepX[i] = _mm_set1_ps(tri->colorStepX[i]);
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 lutScale = _mm_set1_ps((float)(SW_SRGB_LUT_SIZE - 1));
+    __m128 alphaScale = _mm_set1_ps(255.0f);
+    __m128i minXv = _mm_set1_epi32(region->minX - 1);
+    __m128i maxXv = _mm_set1_epi32(region->maxX + 1);
+
+    int32_t edgeRow[3] = { region->edgeAtMin[0], region->edgeAtMin[1], region->edgeAtMin[2] };
+    for(int y = region->minY; y <= region->maxY; ++y)
+    {
+        uint32_t* row = renderer->pixels + (size_t)y * renderer->pitch;
+        __m128i e0 = _mm_add_epi32(_mm_set1_epi32(edgeRow[0]), edgeLane[0]);
+        __m128i e1 = _mm_add_epi32(_mm_set1_epi32(edgeRow[1]), edgeLane[1]);
+        __m128i e2 = _mm_add_epi32(_mm_set1_epi32(edgeRow[2]), edgeLane[2]);
+
+        __m128 colorRow[4];
+        for(int i = 0; i < 4; ++i)
+            colorRow[i] = _mm_set1_ps(tri->colorAtOrigin[i] + tri->colorStepY[i] * y);
+
+        for(int x = startX; x <= region->maxX; x += 4)
+        {
+            __m128i xs = _mm_add_epi32(_mm_set1_epi32(x), laneIndex);
+            __m128i inSpan = _mm_and_si128(_mm_cmpgt_epi32(xs, minXv), _mm_cmplt_epi32(xs, maxXv));
+            __m128i outside = _mm_srai_epi32(_mm_or_si128(e0, _mm_or_si128(e1, e2)), 31);
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(outside, inSpan)));
+            if(mask)
+            {
+                // Colours are evaluated from the absolute pixel position so every path produces identical output
+                __m128 fx = _mm_cvtepi32_ps(xs);
+                __m128 color[4];
+                for(int i = 0; i < 4; ++i)
+                    color[i] = _mm_add_ps(colorRow[i], _mm_mul_ps(colorStepX[i], fx));
+                __m128i r = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(color[0], zero), one), lutScale));
+                __m128i g = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(color[1], zero), one), lutScale));
+                __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(color[2], zero), one), lutScale));
+                __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(color[3], zero), one), alphaScale));
+                alignas(16) int32_t ri[4], gi[4], bi[4], ai[4];
+                _mm_store_si128((__m128i*)ri, r);
+                _mm_store_si128((__m128i*)gi, g);
+                _mm_store_si128((__m128i*)bi, b);
+                _mm_store_si128((__m128i*)ai, a);
+                for(int lane = 0; lane < 4; ++lane)
+                {
+                    if(mask & (1 << lane))
+                    {
+                        row[x + lane] = (uint32_t)renderer->srgbLut[bi[lane]]
+                                      | ((uint32_t)renderer->srgbLut[gi[lane]] << 8)
+                                      | ((uint32_t)renderer->srgbLut[ri[lane]] << 16)
+                                      | ((uint32_t)ai[lane] << 24);
+                    }
+                }
+            }
+
+            e0 = _mm_add_epi32(e0, edgeStep4[0]);
+            e1 = _mm_add_epi32(e1, edgeStep4[1]);
+            e2 = _mm_add_epi32(e2, edgeStep4[2]);
+        }
+
+        for(int i = 0; i < 3; ++i)
+            edgeRow[i] += region->edgeStepY[i];
+    }
+}
+
+TARGET_AVX2
+static void RasterizeRegion_AVX2(SoftwareRenderer* renderer, const SwTriangle* tri, const SwRegion* region)
+{
+    // 8 pixels per iteration, LUT lookups through gathers and masked stores
+    int startX = region->minX & ~7;
+    int32_t leadIn = region->minX - startX;
+
+    __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i edgeLane[3], edgeStep8[3];
+    for(int i = 0; i < 3; ++i)
+    {
+        __m256i s = _mm256_set1_epi32(region->edgeStepX[i]);
+        edgeLane[i] = _mm256_mullo_epi32(_mm256_sub_epi32(laneIndex, _mm256_set1_epi32(leadIn)), s);
+        edgeStep8[i] = _mm256_set1_epi32(8 * region->edgeStepX[i]);
+    }
+
+    __m256 colorStepX[4];
+    for(int i = 0; i < 4; ++i)
+        colorStepX[i] = _mm256_set1_ps(tri->colorStepX[i]);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 lutScale = _mm256_set1_ps((float)(SW_SRGB_LUT_SIZE - 1));
+    __m256 alphaScale = _mm256_set1_ps(255.0f);
+    __m256i minXv = _mm256_set1_epi32(region->minX - 1);
+    __m256i maxXv = _mm256_set1_epi32(region->maxX + 1);
+
+    int32_t edgeRow[3] = { region->edgeAtMin[0], region->edgeAtMin[1], region->edgeAtMin[2] };
+    for(int y = region->minY; y <= region->maxY; ++y)
+    {
+        uint32_t* row = renderer->pixels + (size_t)y * renderer->pitch;
+        __m256i e0 = _mm256_add_epi32(_mm256_set1_epi32(edgeRow[0]), edgeLane[0]);
+        __m256i e1 = _mm256_add_epi32(_mm256_set1_epi32(edgeRow[1]), edgeLane[1]);
+        __m256i e2 = _mm256_add_epi32(_mm256_set1_epi32(edgeRow[2]), edgeLane[2]);
+
+        __m256 colorRow[4];
+        for(int i = 0; i < 4; ++i)
+            colorRow[i] = _mm256_set1_ps(tri->colorAtOrigin[i] + tri->colorStepY[i] * y);
+
+        for(int x = startX; x <= region->maxX; x += 8)
+        {
+            __m256i xs = _mm256_add_epi32(_mm256_set1_epi32(x), laneIndex);
+            __m256i inSpan = _mm256_and_si256(_mm256_cmpgt_epi32(xs, minXv), _mm256_cmpgt_epi32(maxXv, xs));
+            __m256i outside = _mm256_srai_epi32(_mm256_or_si256(e0, _mm256_or_si256(e1, e2)), 31);
+            __m256i writeMask = _mm256_andnot_si256(outside, inSpan);
+            if(!_mm256_testz_si256(writeMask, writeMask))
+            {
+                __m256 fx = _mm256_cvtepi32_ps(xs);
+                __m256 color[4];
+                for(int i = 0; i < 4; ++i)
+                    color[i] = _mm256_add_ps(colorRow[i], _mm256_mul_ps(colorStepX[i], fx));
+                __m256i r = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(color[0], zero), one), lutScale));
+                __m256i g = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(color[1], zero), one), lutScale));
+                __m256i b = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(color[2], zero), one), lutScale));
+                __m256i a = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(color[3], zero), one), alphaScale));
+                r = _mm256_i32gather_epi32(renderer->srgbLut, r, 4);
+                g = _mm256_i32gather_epi32(renderer->srgbLut, g, 4);
+                b = _mm256_i32gather_epi32(renderer->srgbLut, b, 4);
+                __m256i packed = _mm256_or_si256(_mm256_or_si256(b, _mm256_slli_epi32(g, 8)),
+                                                 _mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_slli_epi32(a, 24)));
+                _mm256_maskstore_epi32((int*)(row + x), writeMask, packed);
+            }
+
+            e0 = _mm256_add_epi32(e0, edgeStep8[0]);
+            e1 = _mm256_add_epi32(e1, edgeStep8[1]);
+            e2 = _mm256_add_epi32(e2, edgeStep8[2]);
+        }
+
+        for(int i = 0; i < 3; ++i)
+            edgeRow[i] += region->edgeStepY[i];
+    }
+}
+#endif
+
+static void RasterizeTile(SoftwareRenderer* renderer, uint32_t tileIndex)
+{
+    PROFILE_ZONE("RasterizeTile");
+    int tileX = (int)(tileIndex % renderer->tilesX) * SW_TILE_SIZE;
+    int tileY = (int)(tileIndex / renderer->tilesX) * SW_TILE_SIZE;
+
+    if(renderer->clearPending)
+    {
+        int endX = tileX + SW_TILE_SIZE < renderer->width ? tileX + SW_TILE_SIZE : renderer->width;
+        int endY = tileY + SW_TILE_SIZE < renderer->height ? tileY + SW_TILE_SIZE : renderer->height;
+        for(int y = tileY; y < endY; ++y)
+        {
+            uint32_t* row = renderer->pixels + (size_t)y * renderer->pitch;
+            for(int x = tileX; x < endX; ++x)
+                row[x] = renderer->clearValue;
+        }
+    }
+
+    for(size_t b = 0; b < renderer->binners.size(); ++b)
+    {
+        SwBinner* binner = &renderer->binners[b];
+        if(binner->firstTri >= binner->endTri)
+            continue;
+        const std::vector<uint32_t>& bin = binner->tileBins[tileIndex];
+        for(size_t i = 0; i < bin.size(); ++i)
+        {
+            const SwTriangle* tri = &binner->triangles[bin[i]];
+            SwRegion region;
+            if(!SetupRegion(tri, tileX, tileY, &region))
+                continue;
+#if ARCH_X64
+            if(renderer->useAVX2)
+                RasterizeRegion_AVX2(renderer, tri, &region);
+            else
+                RasterizeRegion_SSE2(renderer, tri, &region);
+#else
+            RasterizeRegion_Scalar(renderer, tri, &region);
+#endif
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////
+// API
+
+SoftwareRenderer* SoftwareRenderer_Create(int width, int height, int numThreads)
+{
+    SoftwareRenderer* renderer = new SoftwareRenderer();
+    renderer->pixels = nullptr;
+    renderer->width = 0;
+    renderer->height = 0;
+    renderer->clearPending = false;
+    renderer->clearValue = 0;
+    renderer->numQueuedTris = 0;
+    renderer->useAVX2 = CpuSupportsAVX2();
+    renderer->generation = 0;
+    renderer->busyWorkers = 0;
+    renderer->quit = false;
+    renderer->task = nullptr;
+    renderer->taskCount = 0;
+
+    for(int i = 0; i < SW_SRGB_LUT_SIZE; ++i)
+        renderer->srgbLut[i] = (int32_t)(SrgbFromLinear((float)i / (SW_SRGB_LUT_SIZE - 1)) * 255.0f + 0.5f);
+
+    if(numThreads <= 0)
+        numThreads = (int)std::thread::hardware_concurrency();
+    if(numThreads <= 0)
+        numThreads = 1;
+    renderer->binners.resize(numThreads);
+    for(int i = 1; i < numThreads; ++i)
+        renderer->workers.emplace_back(WorkerThreadMain, renderer);
+
+    SoftwareRenderer_Resize(renderer, width, height);
+    return renderer;
+}
+
+void SoftwareRenderer_Destroy(SoftwareRenderer* renderer)
+{
+    {
+        std::lock_guard<std::mutex> lock(renderer->mutex);
+        renderer->quit = true;
+        renderer->wakeCondition.notify_all();
+    }
+    for(size_t i = 0; i < renderer->workers.size(); ++i)
+        renderer->workers[i].join();
+
+    free(renderer->pixels);
+    delete renderer;
+}
+
+void SoftwareRenderer_Resize(SoftwareRenderer* renderer, int width, int height)
+{
+    assert(width > 0 && height > 0);
+    assert(width <= SW_MAX_FRAMEBUFFER_SIZE && height <= SW_MAX_FRAMEBUFFER_SIZE);
+
+    free(renderer->pixels);
+    renderer->width = width;
+    renderer->height = height;
+    // Rows are padded to 8 pixels so the SIMD loops never straddle a row end
+    renderer->pitch = (width + 7) & ~7;
+    size_t bytes = (size_t)renderer->pitch * height * sizeof(uint32_t);
+    renderer->pixels = (uint32_t*)malloc(bytes);
+    memset(renderer->pixels, 0, bytes);
+
+    renderer->tilesX = (width + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+    renderer->tilesY = (height + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+    for(size_t i = 0; i < renderer->binners.size(); ++i)
+    {
+        renderer->binners[i].tileBins.clear();
+        renderer->binners[i].tileBins.resize(renderer->tilesX * renderer->tilesY);
+    }
+
+    renderer->viewport = { 0.0f, 0.0f, (float)width, (float)height };
+    renderer->draws.clear();
+    renderer->numQueuedTris = 0;
+    renderer->clearPending = false;
+}
+
+int SoftwareRenderer_GetThreadCount(SoftwareRenderer* renderer)
+{
+    return (int)renderer->workers.size() + 1;
+}
+
+void SoftwareRenderer_SetUseAVX2(SoftwareRenderer* renderer, bool useAVX2)
+{
+    renderer->useAVX2 = useAVX2 && CpuSupportsAVX2();
+}
+
+void SoftwareRenderer_Clear(SoftwareRenderer* renderer, const float color[4])
+{
+    renderer->clearPending = true;
+    renderer->clearValue = PackColor(renderer->srgbLut, color[0], color[1], color[2], color[3]);
+    renderer->draws.clear();
+    renderer->numQueuedTris = 0;
+}
+
+void SoftwareRenderer_SetViewport(SoftwareRenderer* renderer, SoftwareViewport viewport)
+{
+    renderer->viewport = viewport;
+}
+
+void SoftwareRenderer_Draw(SoftwareRenderer* renderer, const void* vertexData, uint32_t stride, uint32_t numVerts)
+{
+    assert(stride >= 6 * sizeof(float));
+    uint32_t numTris = numVerts / 3;
+    if(numTris == 0)
+        return;
+
+    SwDraw draw;
+    draw.vertices = (const uint8_t*)vertexData;
+    draw.stride = stride;
+    draw.numTris = numTris;
+    draw.firstTri = renderer->numQueuedTris;
+    draw.viewport = renderer->viewport;
+    renderer->draws.push_back(draw);
+    renderer->numQueuedTris += numTris;
+}
+
+void SoftwareRenderer_Flush(SoftwareRenderer* renderer)
+{
+    if(!renderer->clearPending && renderer->draws.empty())
+        return;
+    PROFILE_ZONE("SoftwareRenderer_Flush");
+
+    // Split the submitted triangles into one contiguous range per binner
+    uint32_t numBinners = (uint32_t)renderer->binners.size();
+    for(uint32_t i = 0; i < numBinners; ++i)
+    {
+        SwBinner* binner = &renderer->binners[i];
+        binner->firstTri = (uint32_t)((uint64_t)renderer->numQueuedTris * i / numBinners);
+        binner->endTri = (uint32_t)((uint64_t)renderer->numQueuedTris * (i + 1) / numBinners);
+        binner->triangles.clear();
+        for(size_t t = 0; t < binner->tileBins.size(); ++t)
+            binner->tileBins[t].clear();
+    }
+
+    ParallelFor(renderer, BinTriangles, numBinners);
+    ParallelFor(renderer, RasterizeTile, (uint32_t)(renderer->tilesX * renderer->tilesY));
+
+    renderer->draws.clear();
+    renderer->numQueuedTris = 0;
+    renderer->clearPending = false;
+}
+
+SoftwareFramebuffer SoftwareRenderer_GetFramebuffer(SoftwareRenderer* renderer)
+{
+    SoftwareFramebuffer result;
+    result.pixels = renderer->pixels;
+    result.width = renderer->width;
+    result.height = renderer->height;
+    result.pitch = renderer->pitch;
+    return result;
+}
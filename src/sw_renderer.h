@@ -0,0 +1,53 @@
+#pragma once
+
+// CPU implementation of the triangle pipeline in win32_platform.cpp.
+// Consumes the same vertex stream (x, y, r, g, b, a per vertex, positions in
+// clip space) and reproduces basic_vs.hlsl/basic_ps.hlsl into an offscreen
+// DXGI_FORMAT_B8G8R8A8_UNORM_SRGB framebuffer.
+//
+// Draws are queued and rasterized on Flush: triangles are set up and binned
+// into 64x64 pixel tiles, then every tile is rasterized by exactly one worker
+// thread using SSE2 or AVX2 edge-function evaluation.
+
+#include "base.h"
+
+#define SW_TILE_SIZE 64
+#define SW_MAX_FRAMEBUFFER_SIZE 8192
+
+struct SoftwareRenderer;
+
+struct SoftwareViewport
+{
+  float x, y, width, height;
+};
+
+struct SoftwareFramebuffer
+{
+  uint32_t* pixels; // B8G8R8A8, sRGB encoded
+  int width;
+  int height;
+  int pitch; // in pixels
+};
+
+// numThreads == 0 picks one thread per hardware core.
+SoftwareRenderer* SoftwareRenderer_Create(int width, int height, int numThreads);
+void SoftwareRenderer_Destroy(SoftwareRenderer* renderer);
+
+void SoftwareRenderer_Resize(SoftwareRenderer* renderer, int width, int height);
+int SoftwareRenderer_GetThreadCount(SoftwareRenderer* renderer);
+
+// Forces the scalar/SSE2 path even if the CPU supports AVX2.
+void SoftwareRenderer_SetUseAVX2(SoftwareRenderer* renderer, bool useAVX2);
+
+// Same semantics as ClearRenderTargetView on an sRGB view: the colour is linear
+// and gets encoded on write. Clearing discards all draws queued so far.
+void SoftwareRenderer_Clear(SoftwareRenderer* renderer, const float color[4]);
+void SoftwareRenderer_SetViewport(SoftwareRenderer* renderer, SoftwareViewport viewport);
+
+// Queues a triangle list. vertexData must stay valid until the next Flush.
+void SoftwareRenderer_Draw(SoftwareRenderer* renderer, const void* vertexData, uint32_t stride, uint32_t numVerts);
+
+// Executes pending clear and draws. Blocks until the framebuffer is complete.
+void SoftwareRenderer_Flush(SoftwareRenderer* renderer);
+
+SoftwareFramebuffer SoftwareRenderer_GetFramebuffer(SoftwareRenderer* renderer);
@@ -0,0 +1,327 @@
+// Offline texture baker: decodes source images once with stb_image, builds an
+// sRGB-correct mip chain, optionally BC compresses it and writes a texture pack
+// (see texture_pack.h) that the runtime maps instead of decoding.
+//
+//   texture_baker [--format bgra8|bc1|bc7] out.tpak res/textures/wall.jpg [more images...]
+//   texture_baker --verify out.tpak
+//
+// Textures are named by the path given on the command line, so run it from the
+// directory the game loads assets from.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "memory.cpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "vendor/stb_image.h"
+
+#include "mapped_file.cpp"
+#include "texture_pack.cpp"
+#include "texture_process.cpp"
+
+struct BakedMip
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowPitch;
+    std::vector<uint8_t> payload;
+};
+
+struct BakedTexture
+{
+    std::string name;
+    uint32_t format;
+    std::vector<BakedMip> mips;
+};
+
+struct BakeOptions
+{
+    uint32_t format;
+    MipFilter mipFilter;
+    int numThreads;
+    MemoryArena* decodeArena; // stb_image scratch, reset after every load
+};
+
+struct BakeTotals
+{
+    double decodeSeconds;
+    double mipSeconds;
+    double compressSeconds;
+    uint64_t compressedPixels;
+};
+
+static uint64_t AlignUp(uint64_t value)
+{
+    return (value + TEXTURE_PACK_ALIGNMENT - 1) & ~(uint64_t)(TEXTURE_PACK_ALIGNMENT - 1);
+}
+
+static bool BakeTexture(const char* path, const BakeOptions* options, BakedTexture* texture, BakeTotals* totals)
+{
+    double start = GetSeconds();
+    int width, height, channels;
+    MemoryArena* previousArena = Memory_BindStbiArena(options->decodeArena);
+    uint8_t* rgba = stbi_load(path, &width, &height, &channels, 4);
+    if(!rgba) {
+        fprintf(stderr, "%s: %s\n", path, stbi_failure_reason());
+        Memory_BindStbiArena(previousArena);
+        MemoryArena_Reset(options->decodeArena);
+        return false;
+    }
+    TextureImage top;
+    top.width = (uint32_t)width;
+    top.height = (uint32_t)height;
+    top.pixels.assign(rgba, rgba + (size_t)width * height * 4);
+    stbi_image_free(rgba);
+    Memory_BindStbiArena(previousArena);
+    MemoryArena_Reset(options->decodeArena);
+    totals->decodeSeconds += GetSeconds() - start;
+
+    uint32_t blockSize = 1, bytesPerBlock = 4;
+    TexturePack_GetFormatInfo(options->format, &blockSize, &bytesPerBlock);
+    if(blockSize > 1 && (top.width % blockSize || top.height % blockSize)) {
+        fprintf(stderr, "%s: %ux%u is not a multiple of the %ux%u block size\n", path, top.width, top.height, blockSize, blockSize);
+        return false;
+    }
+
+    start = GetSeconds();
+    std::vector<TextureImage> mips;
+    TextureProcess_GenerateMips(&top, options->mipFilter, TEXTURE_PACK_MAX_MIPS, options->numThreads, &mips);
+    totals->mipSeconds += GetSeconds() - start;
+
+    texture->name = path;
+    texture->format = options->format;
+    texture->mips.resize(mips.size());
+    for(size_t m = 0; m < mips.size(); ++m)
+    {
+        const TextureImage* image = &mips[m];
+        BakedMip* mip = &texture->mips[m];
+        mip->width = image->width;
+        mip->height = image->height;
+        mip->rowPitch = (image->width + blockSize - 1) / blockSize * bytesPerBlock;
+
+        if(options->format == TexturePackFormat_B8G8R8A8_UNORM_SRGB)
+        {
+            // Swizzle RGBA -> BGRA so the payload matches the upload format
+            mip->payload.resize(image->pixels.size());
+            for(size_t i = 0; i < image->pixels.size(); i += 4)
+            {
+                mip->payload[i + 0] = image->pixels[i + 2];
+                mip->payload[i + 1] = image->pixels[i + 1];
+                mip->payload[i + 2] = image->pixels[i + 0];
+                mip->payload[i + 3] = image->pixels[i + 3];
+            }
+            continue;
+        }
+
+        BlockFormat blockFormat = options->format == TexturePackFormat_BC1_UNORM_SRGB ? BlockFormat_BC1 : BlockFormat_BC7;
+        CompressStats stats;
+        TextureProcess_Compress(image, blockFormat, options->numThreads, &mip->payload, &stats);
+        totals->compressSeconds += stats.seconds;
+        totals->compressedPixels += (uint64_t)image->width * image->height;
+        if(m == 0)
+            printf("  %s: %s %.2f dB PSNR, %.2f MPix/s\n", path, blockFormat == BlockFormat_BC1 ? "BC1" : "BC7", stats.psnr, stats.megapixelsPerSecond);
+    }
+    return true;
+}
+
+static bool WritePack(const char* path, std::vector<BakedTexture>* textures)
+{
+    std::sort(textures->begin(), textures->end(), [](const BakedTexture& a, const BakedTexture& b) { return a.name < b.name; });
+
+    uint32_t numMips = 0;
+    for(size_t i = 0; i < textures->size(); ++i)
+        numMips += (uint32_t)(*textures)[i].mips.size();
+
+    TexturePackHeader header = {};
+    header.magic = TEXTURE_PACK_MAGIC;
+    header.version = TEXTURE_PACK_VERSION;
+    header.numTextures = (uint32_t)textures->size();
+    header.numMips = numMips;
+    header.texturesOffset = AlignUp(sizeof(TexturePackHeader));
+    header.mipsOffset = AlignUp(header.texturesOffset + textures->size() * sizeof(TexturePackTexture));
+    header.payloadOffset = AlignUp(header.mipsOffset + numMips * sizeof(TexturePackMip));
+
+    std::vector<TexturePackTexture> textureTable(textures->size());
+    std::vector<TexturePackMip> mipTable;
+    uint64_t offset = header.payloadOffset;
+    for(size_t i = 0; i < textures->size(); ++i)
+    {
+        const BakedTexture* baked = &(*textures)[i];
+        TexturePackTexture* entry = &textureTable[i];
+        memset(entry, 0, sizeof(*entry));
+        if(baked->name.size() >= TEXTURE_PACK_MAX_NAME) {
+            fprintf(stderr, "%s: name longer than %d characters\n", baked->name.c_str(), TEXTURE_PACK_MAX_NAME - 1);
+            return false;
+        }
+        if(i > 0 && baked->name == (*textures)[i - 1].name) {
+            fprintf(stderr, "%s: listed twice\n", baked->name.c_str());
+            return false;
+        }
+        memcpy(entry->name, baked->name.c_str(), baked->name.size());
+        entry->format = baked->format;
+        entry->width = baked->mips[0].width;
+        entry->height = baked->mips[0].height;
+        entry->mipCount = (uint32_t)baked->mips.size();
+        entry->firstMip = (uint32_t)mipTable.size();
+
+        for(size_t m = 0; m < baked->mips.size(); ++m)
+        {
+            const BakedMip* bakedMip = &baked->mips[m];
+            TexturePackMip mip = {};
+            mip.offset = offset;
+            mip.size = (uint32_t)bakedMip->payload.size();
+            mip.rowPitch = bakedMip->rowPitch;
+            mip.width = bakedMip->width;
+            mip.height = bakedMip->height;
+            mip.checksum = TexturePack_Checksum(bakedMip->payload.data(), bakedMip->payload.size());
+            mipTable.push_back(mip);
+            offset = AlignUp(offset + mip.size);
+        }
+    }
+    header.fileSize = offset;
+
+    FILE* file = fopen(path, "wb");
+    if(!file) {
+        fprintf(stderr, "Could not open %s for writing\n", path);
+        return false;
+    }
+
+    // Sections are written in file order, zero padding in between
+    std::vector<uint8_t> image((size_t)header.payloadOffset, 0);
+    memcpy(&image[0], &header, sizeof(header));
+    if(!textureTable.empty())
+        memcpy(&image[(size_t)header.texturesOffset], textureTable.data(), textureTable.size() * sizeof(TexturePackTexture));
+    if(!mipTable.empty())
+        memcpy(&image[(size_t)header.mipsOffset], mipTable.data(), mipTable.size() * sizeof(TexturePackMip));
+    bool ok = fwrite(image.data(), 1, image.size(), file) == image.size();
+
+    uint64_t written = header.payloadOffset;
+    static const uint8_t padding[TEXTURE_PACK_ALIGNMENT] = {};
+    size_t mipIndex = 0;
+    for(size_t i = 0; i < textures->size() && ok; ++i)
+    {
+        const BakedTexture* baked = &(*textures)[i];
+        for(size_t m = 0; m < baked->mips.size() && ok; ++m, ++mipIndex)
+        {
+            const TexturePackMip* mip = &mipTable[mipIndex];
+            ok = fwrite(padding, 1, (size_t)(mip->offset - written), file) == (size_t)(mip->offset - written);
+            ok = ok && fwrite(baked->mips[m].payload.data(), 1, mip->size, file) == mip->size;
+            written = mip->offset + mip->size;
+        }
+    }
+    ok = ok && fwrite(padding, 1, (size_t)(header.fileSize - written), file) == (size_t)(header.fileSize - written);
+    ok = (fclose(file) == 0) && ok;
+    if(!ok)
+        fprintf(stderr, "Failed writing %s\n", path);
+    return ok;
+}
+
+static int VerifyPack(const char* path)
+{
+    double start = GetSeconds();
+    TexturePack pack;
+    if(!TexturePack_Open(&pack, path)) {
+        fprintf(stderr, "%s: not a valid texture pack (version %d)\n", path, TEXTURE_PACK_VERSION);
+        return 1;
+    }
+    double openSeconds = GetSeconds() - start;
+
+    for(uint32_t i = 0; i < pack.header->numTextures; ++i)
+    {
+        const TexturePackTexture* texture = &pack.textures[i];
+        printf("  %s: %ux%u, %u mips, format %u\n", texture->name, texture->width, texture->height, texture->mipCount, texture->format);
+    }
+
+    uint32_t numBad = TexturePack_Verify(&pack);
+    printf("%s: %u textures, %u mips, %llu bytes, opened in %.3f ms, %u bad checksums\n",
+           path, pack.header->numTextures, pack.header->numMips, (unsigned long long)pack.header->fileSize,
+           openSeconds * 1000.0, numBad);
+    TexturePack_Close(&pack);
+    return numBad ? 1 : 0;
+}
+
+static void PrintUsage()
+{
+    printf("usage: texture_baker [--format bgra8|bc1|bc7] [--mip-filter box|kaiser] [--threads N]\n"
+           "                     out.tpak image [image...]\n"
+           "       texture_baker --verify pack.tpak\n");
+}
+
+int main(int argc, char** argv)
+{
+    if(argc == 3 && !strcmp(argv[1], "--verify"))
+        return VerifyPack(argv[2]);
+
+    BakeOptions options = {};
+    options.format = TexturePackFormat_B8G8R8A8_UNORM_SRGB;
+    options.mipFilter = MipFilter_Kaiser;
+    options.numThreads = 0;
+
+    int arg = 1;
+    for(; arg < argc && !strncmp(argv[arg], "--", 2); ++arg)
+    {
+        bool hasValue = arg + 1 < argc;
+        const char* value = hasValue ? argv[arg + 1] : "";
+        if(!strcmp(argv[arg], "--format") && hasValue)
+        {
+            if(!strcmp(value, "bgra8")) options.format = TexturePackFormat_B8G8R8A8_UNORM_SRGB;
+            else if(!strcmp(value, "bc1")) options.format = TexturePackFormat_BC1_UNORM_SRGB;
+            else if(!strcmp(value, "bc7")) options.format = TexturePackFormat_BC7_UNORM_SRGB;
+            else { PrintUsage(); return 1; }
+        }
+        else if(!strcmp(argv[arg], "--mip-filter") && hasValue)
+        {
+            if(!strcmp(value, "box")) options.mipFilter = MipFilter_Box;
+            else if(!strcmp(value, "kaiser")) options.mipFilter = MipFilter_Kaiser;
+            else { PrintUsage(); return 1; }
+        }
+        else if(!strcmp(argv[arg], "--threads") && hasValue)
+            options.numThreads = atoi(value);
+        else {
+            PrintUsage();
+            return 1;
+        }
+        ++arg;
+    }
+
+    if(argc - arg < 2) {
+        PrintUsage();
+        return 1;
+    }
+    const char* outPath = argv[arg++];
+
+    // Large enough for the working set of a 4k RGBA decode, bigger images spill to the heap
+    MemoryArena decodeArena;
+    if(!MemoryArena_Init(&decodeArena, 128 << 20, "Decode Scratch")) {
+        fprintf(stderr, "Could not allocate the decode arena\n");
+        return 1;
+    }
+    options.decodeArena = &decodeArena;
+
+    BakeTotals totals = {};
+    std::vector<BakedTexture> textures(argc - arg);
+    for(int i = arg; i < argc; ++i)
+    {
+        if(!BakeTexture(argv[i], &options, &textures[i - arg], &totals))
+            return 1;
+    }
+
+    if(!WritePack(outPath, &textures))
+        return 1;
+
+    printf("Baked %d textures into %s (decode %.1f ms, mips %.1f ms",
+           argc - arg, outPath, totals.decodeSeconds * 1000.0, totals.mipSeconds * 1000.0);
+    if(totals.compressedPixels)
+        printf(", compress %.1f ms, %.2f MPix/s", totals.compressSeconds * 1000.0, totals.compressedPixels / totals.compressSeconds * 1e-6);
+    printf(")\n");
+    printf("Decode scratch: high water %.1f MB of %.1f MB, %llu allocations, %llu spilled to the heap\n",
+           decodeArena.highWater / (1024.0 * 1024.0), decodeArena.capacity / (1024.0 * 1024.0),
+           (unsigned long long)decodeArena.numAllocs, (unsigned long long)decodeArena.numFailed);
+    MemoryArena_Release(&decodeArena);
+    return VerifyPack(outPath);
+}
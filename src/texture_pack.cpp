@@ -0,0 +1,157 @@
+#include "texture_pack.h"
+
+#include <string.h>
+
+static bool IsAligned(uint64_t value)
+{
+    return (value & (TEXTURE_PACK_ALIGNMENT - 1)) == 0;
+}
+
+uint64_t TexturePack_Checksum(const void* data, size_t size)
+{
+    return Fnv1a64(data, size);
+}
+
+bool TexturePack_GetFormatInfo(uint32_t format, uint32_t* blockSize, uint32_t* bytesPerBlock)
+{
+    switch(format)
+    {
+        case TexturePackFormat_B8G8R8A8_UNORM_SRGB: *blockSize = 1; *bytesPerBlock = 4; return true;
+        case TexturePackFormat_BC1_UNORM_SRGB: *blockSize = 4; *bytesPerBlock = 8; return true;
+        case TexturePackFormat_BC7_UNORM_SRGB: *blockSize = 4; *bytesPerBlock = 16; return true;
+        default: return false;
+    }
+}
+
+static bool ValidateTexture(const TexturePack* pack, const TexturePackTexture* texture)
+{
+    // Mip bounds have been checked already, this only checks they describe a full chain
+    const TexturePackHeader* header = pack->header;
+    if(memchr(texture->name, 0, TEXTURE_PACK_MAX_NAME) == 0)
+        return false;
+    uint32_t blockSize, bytesPerBlock;
+    if(!TexturePack_GetFormatInfo(texture->format, &blockSize, &bytesPerBlock))
+        return false;
+    if(texture->mipCount == 0 || texture->mipCount > TEXTURE_PACK_MAX_MIPS)
+        return false;
+    if((uint64_t)texture->firstMip + texture->mipCount > header->numMips)
+        return false;
+
+    for(uint32_t i = 0; i < texture->mipCount; ++i)
+    {
+        const TexturePackMip* mip = &pack->mips[texture->firstMip + i];
+        uint32_t expectedWidth = texture->width >> i ? texture->width >> i : 1;
+        uint32_t expectedHeight = texture->height >> i ? texture->height >> i : 1;
+        if(mip->width != expectedWidth || mip->height != expectedHeight)
+            return false;
+        uint32_t blocksX = (mip->width + blockSize - 1) / blockSize;
+        uint32_t blocksY = (mip->height + blockSize - 1) / blockSize;
+        if(mip->rowPitch < blocksX * bytesPerBlock || (uint64_t)mip->rowPitch * blocksY != mip->size)
+            return false;
+    }
+    return true;
+}
+
+static bool ValidateMip(const TexturePack* pack, const TexturePackMip* mip)
+{
+    const TexturePackHeader* header = pack->header;
+    return IsAligned(mip->offset) && mip->offset >= header->payloadOffset
+        && mip->offset <= header->fileSize && mip->size <= header->fileSize - mip->offset;
+}
+
+bool TexturePack_Open(TexturePack* pack, const char* path)
+{
+    memset(pack, 0, sizeof(*pack));
+    if(!MappedFile_Open(&pack->file, path))
+        return false;
+
+    const uint8_t* base = pack->file.data;
+    uint64_t fileSize = pack->file.size;
+    const TexturePackHeader* header = (const TexturePackHeader*)base;
+    bool valid = fileSize >= sizeof(TexturePackHeader)
+              && header->magic == TEXTURE_PACK_MAGIC
+              && header->version == TEXTURE_PACK_VERSION
+              && header->fileSize == fileSize
+              && IsAligned(header->texturesOffset) && IsAligned(header->mipsOffset) && IsAligned(header->payloadOffset)
+              && header->payloadOffset <= fileSize
+              && header->mipsOffset <= header->payloadOffset
+              && header->texturesOffset <= header->mipsOffset
+              && (uint64_t)header->numTextures * sizeof(TexturePackTexture) <= header->mipsOffset - header->texturesOffset
+              && (uint64_t)header->numMips * sizeof(TexturePackMip) <= header->payloadOffset - header->mipsOffset;
+    if(!valid) {
+        TexturePack_Close(pack);
+        return false;
+    }
+
+    pack->header = header;
+    pack->textures = (const TexturePackTexture*)(base + header->texturesOffset);
+    pack->mips = (const TexturePackMip*)(base + header->mipsOffset);
+
+    for(uint32_t i = 0; i < header->numMips; ++i)
+    {
+        if(!ValidateMip(pack, &pack->mips[i])) {
+            TexturePack_Close(pack);
+            return false;
+        }
+    }
+    for(uint32_t i = 0; i < header->numTextures; ++i)
+    {
+        // Find() relies on the table being sorted by name
+        if(!ValidateTexture(pack, &pack->textures[i]) || (i > 0 && strcmp(pack->textures[i - 1].name, pack->textures[i].name) >= 0)) {
+            TexturePack_Close(pack);
+            return false;
+        }
+    }
+    return true;
+}
+
+void TexturePack_Close(TexturePack* pack)
+{
+    MappedFile_Close(&pack->file);
+    pack->header = 0;
+    pack->textures = 0;
+    pack->mips = 0;
+}
+
+const TexturePackTexture* TexturePack_Find(const TexturePack* pack, const char* name)
+{
+    // The baker sorts the table by name
+    uint32_t low = 0;
+    uint32_t high = pack->header->numTextures;
+    while(low < high)
+    {
+        uint32_t mid = (low + high) / 2;
+        int cmp = strcmp(pack->textures[mid].name, name);
+        if(cmp == 0)
+            return &pack->textures[mid];
+        if(cmp < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return 0;
+}
+
+const TexturePackMip* TexturePack_GetMip(const TexturePack* pack, const TexturePackTexture* texture, uint32_t mipLevel)
+{
+    if(mipLevel >= texture->mipCount)
+        return 0;
+    return &pack->mips[texture->firstMip + mipLevel];
+}
+
+const void* TexturePack_GetMipData(const TexturePack* pack, const TexturePackMip* mip)
+{
+    return pack->file.data + mip->offset;
+}
+
+uint32_t TexturePack_Verify(const TexturePack* pack)
+{
+    uint32_t numBad = 0;
+    for(uint32_t i = 0; i < pack->header->numMips; ++i)
+    {
+        const TexturePackMip* mip = &pack->mips[i];
+        if(TexturePack_Checksum(TexturePack_GetMipData(pack, mip), mip->size) != mip->checksum)
+            ++numBad;
+    }
+    return numBad;
+}
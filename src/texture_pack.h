@@ -0,0 +1,90 @@
+#pragma once
+
+// Baked texture pack: textures decoded and mipped offline by texture_baker
+// so startup only has to map the file and hand out pointers for upload.
+//
+// Layout (little-endian, every section and payload 64-byte aligned):
+//   TexturePackHeader
+//   TexturePackTexture[numTextures]   sorted by name
+//   TexturePackMip[numMips]           mips of one texture are contiguous, largest first
+//   payload                           pixel data, rows (of pixels or 4x4 blocks) tightly packed at rowPitch
+
+#include "base.h"
+#include "mapped_file.h"
+
+#define TEXTURE_PACK_MAGIC 0x4B415054u // "TPAK"
+#define TEXTURE_PACK_VERSION 1
+#define TEXTURE_PACK_ALIGNMENT 64
+#define TEXTURE_PACK_MAX_NAME 96
+#define TEXTURE_PACK_MAX_MIPS 16
+
+// Values match DXGI_FORMAT so they can be passed straight to D3D11.
+enum TexturePackFormat : uint32_t
+{
+  TexturePackFormat_BC1_UNORM_SRGB = 72,
+  TexturePackFormat_B8G8R8A8_UNORM_SRGB = 91,
+  TexturePackFormat_BC7_UNORM_SRGB = 99,
+};
+
+struct TexturePackHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t numTextures;
+  uint32_t numMips;
+  uint64_t texturesOffset;
+  uint64_t mipsOffset;
+  uint64_t payloadOffset;
+  uint64_t fileSize;
+  uint8_t reserved[16];
+};
+
+struct TexturePackTexture
+{
+  char name[TEXTURE_PACK_MAX_NAME]; // null terminated
+  uint32_t format; // TexturePackFormat
+  uint32_t width;
+  uint32_t height;
+  uint32_t mipCount;
+  uint32_t firstMip; // index into the mip table
+  uint32_t reserved[3];
+};
+
+struct TexturePackMip
+{
+  uint64_t offset; // from the start of the file
+  uint32_t size;
+  uint32_t rowPitch;
+  uint32_t width;
+  uint32_t height;
+  uint64_t checksum; // FNV-1a over the payload
+};
+
+static_assert(sizeof(TexturePackHeader) == 64, "TexturePackHeader layout changed");
+static_assert(sizeof(TexturePackTexture) == 128, "TexturePackTexture layout changed");
+static_assert(sizeof(TexturePackMip) == 32, "TexturePackMip layout changed");
+
+struct TexturePack
+{
+  MappedFile file;
+  const TexturePackHeader* header;
+  const TexturePackTexture* textures;
+  const TexturePackMip* mips;
+};
+
+// Maps the pack and validates header, table bounds and alignment. Pixel data
+// is not touched, so the cost is independent of the pack size.
+bool TexturePack_Open(TexturePack* pack, const char* path);
+void TexturePack_Close(TexturePack* pack);
+
+const TexturePackTexture* TexturePack_Find(const TexturePack* pack, const char* name);
+const TexturePackMip* TexturePack_GetMip(const TexturePack* pack, const TexturePackTexture* texture, uint32_t mipLevel);
+// Zero-copy pointer into the mapping; valid until TexturePack_Close.
+const void* TexturePack_GetMipData(const TexturePack* pack, const TexturePackMip* mip);
+
+// Reads every payload and compares checksums. Returns the number of bad mips.
+uint32_t TexturePack_Verify(const TexturePack* pack);
+
+uint64_t TexturePack_Checksum(const void* data, size_t size);
+// Block size is 1 for uncompressed formats and 4 for BC formats. Returns false for unknown formats.
+bool TexturePack_GetFormatInfo(uint32_t format, uint32_t* blockSize, uint32_t* bytesPerBlock);
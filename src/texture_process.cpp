@@ -0,0 +1,890 @@
+#include "texture_process.h"
+#include "parallel.h"
+
+#include <math.h>
+#include <string.h>
+
+#define SRGB_ENCODE_MIN_BITS (114u << 23) // 2^-13, anything below encodes to 0
+#define SRGB_ENCODE_MAX_BITS 0x3F7FFFFFu  // largest float below 1.0
+#define SRGB_ENCODE_SHIFT 12
+#define SRGB_ENCODE_TABLE_SIZE (((SRGB_ENCODE_MAX_BITS - SRGB_ENCODE_MIN_BITS) >> SRGB_ENCODE_SHIFT) + 1)
+#define KAISER_LOBES 3.0f
+#define KAISER_ALPHA 4.0f
+
+////////////////////////////////////////////////////////////////
+// Helpers
+
+static float SrgbToLinearExact(float srgb)
+{
+    if(srgb <= 0.04045f)
+        return srgb / 12.92f;
+    return powf((srgb + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSrgbExact(float linear)
+{
+    if(linear <= 0.0031308f)
+        return linear * 12.92f;
+    return 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+}
+
+// Decode: 256 colour entries followed by 256 alpha entries (plain /255).
+// Encode: one entry per 4096 ulps of the input float between 2^-13 and 1.0,
+// which keeps the relative bucket width below 2^-11; results are the exactly
+// rounded sRGB byte or one step off at bucket boundaries. Padded so 32 bit
+// gathers may read past the last entry.
+struct SrgbTables
+{
+    float decode[512];
+    uint8_t encode[SRGB_ENCODE_TABLE_SIZE + 3];
+
+    SrgbTables()
+    {
+        for(int i = 0; i < 256; ++i)
+        {
+            decode[i] = SrgbToLinearExact(i / 255.0f);
+            decode[256 + i] = i / 255.0f;
+        }
+        for(uint32_t i = 0; i < SRGB_ENCODE_TABLE_SIZE; ++i)
+        {
+            uint32_t bits = SRGB_ENCODE_MIN_BITS + (i << SRGB_ENCODE_SHIFT) + (1u << (SRGB_ENCODE_SHIFT - 1));
+            float linear;
+            memcpy(&linear, &bits, sizeof(linear));
+            encode[i] = (uint8_t)(LinearToSrgbExact(linear) * 255.0f + 0.5f);
+        }
+        encode[SRGB_ENCODE_TABLE_SIZE] = encode[SRGB_ENCODE_TABLE_SIZE + 1] = encode[SRGB_ENCODE_TABLE_SIZE + 2] = 0;
+    }
+};
+
+static const SrgbTables* GetSrgbTables()
+{
+    static SrgbTables tables;
+    return &tables;
+}
+
+static uint8_t EncodeSrgbScalar(const SrgbTables* tables, float linear)
+{
+    if(!(linear > 0.0f))
+        linear = 0.0f;
+    uint32_t bits;
+    memcpy(&bits, &linear, sizeof(bits));
+    if(bits < SRGB_ENCODE_MIN_BITS) bits = SRGB_ENCODE_MIN_BITS;
+    if(bits > SRGB_ENCODE_MAX_BITS) bits = SRGB_ENCODE_MAX_BITS;
+    return tables->encode[(bits - SRGB_ENCODE_MIN_BITS) >> SRGB_ENCODE_SHIFT];
+}
+
+static uint8_t EncodeAlphaScalar(float alpha)
+{
+    alpha = fminf(fmaxf(alpha, 0.0f), 1.0f);
+    return (uint8_t)(alpha * 255.0f + 0.5f);
+}
+
+////////////////////////////////////////////////////////////////
+// sRGB <-> linear
+
+#if ARCH_X64
+TARGET_AVX2
+static void SrgbToLinear_AVX2(const SrgbTables* tables, const uint8_t* rgba, float* linear, size_t numPixels)
+{
+    // Two pixels per iteration, alpha lanes index the second half of the table
+    __m256i alphaOffset = _mm256_setr_epi32(0, 0, 0, 256, 0, 0, 0, 256);
+    size_t i = 0;
+    for(; i + 2 <= numPixels; i += 2)
+    {
+        __m128i bytes = _mm_loadl_epi64((const __m128i*)(rgba + i * 4));
+        __m256i index = _mm256_add_epi32(_mm256_cvtepu8_epi32(bytes), alphaOffset);
+        _mm256_storeu_ps(linear + i * 4, _mm256_i32gather_ps(tables->decode, index, 4));
+    }
+    for(; i < numPixels; ++i)
+    {
+        for(int c = 0; c < 3; ++c)
+            linear[i * 4 + c] = tables->decode[rgba[i * 4 + c]];
+        linear[i * 4 + 3] = tables->decode[256 + rgba[i * 4 + 3]];
+    }
+}
+
+TARGET_AVX2
+static void LinearToSrgb_AVX2(const SrgbTables* tables, const float* linear, uint8_t* rgba, size_t numPixels)
+{
+    __m256i minBits = _mm256_set1_epi32((int)SRGB_ENCODE_MIN_BITS);
+    __m256i maxBits = _mm256_set1_epi32((int)SRGB_ENCODE_MAX_BITS);
+    __m256i byteMask = _mm256_set1_epi32(0xFF);
+    __m256i alphaLanes = _mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 scale = _mm256_set1_ps(255.0f);
+    __m128i shuffle = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+
+    size_t i = 0;
+    for(; i + 2 <= numPixels; i += 2)
+    {
+        __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(linear + i * 4), zero), one);
+
+        __m256i bits = _mm256_castps_si256(v);
+        bits = _mm256_min_epi32(_mm256_max_epi32(bits, minBits), maxBits);
+        __m256i index = _mm256_srli_epi32(_mm256_sub_epi32(bits, minBits), SRGB_ENCODE_SHIFT);
+        __m256i color = _mm256_and_si256(_mm256_i32gather_epi32((const int*)tables->encode, index, 1), byteMask);
+        __m256i alpha = _mm256_cvtps_epi32(_mm256_mul_ps(v, scale));
+        __m256i result = _mm256_blendv_epi8(color, alpha, alphaLanes);
+
+        __m128i lo = _mm_shuffle_epi8(_mm256_castsi256_si128(result), shuffle);
+        __m128i hi = _mm_shuffle_epi8(_mm256_extracti128_si256(result, 1), shuffle);
+        uint32_t p0 = (uint32_t)_mm_cvtsi128_si32(lo);
+        uint32_t p1 = (uint32_t)_mm_cvtsi128_si32(hi);
+        memcpy(rgba + i * 4, &p0, 4);
+        memcpy(rgba + i * 4 + 4, &p1, 4);
+    }
+    for(; i < numPixels; ++i)
+    {
+        for(int c = 0; c < 3; ++c)
+            rgba[i * 4 + c] = EncodeSrgbScalar(tables, linear[i * 4 + c]);
+        rgba[i * 4 + 3] = EncodeAlphaScalar(linear[i * 4 + 3]);
+    }
+}
+
+static void LinearToSrgb_SSE2(const SrgbTables* tables, const float* linear, uint8_t* rgba, size_t numPixels)
+{
+    // One pixel per iteration; index computation is vectorized, lookups are scalar
+    __m128i minBits = _mm_set1_epi32((int)SRGB_ENCODE_MIN_BITS);
+    __m128i maxBitsFromMin = _mm_set1_epi32((int)(SRGB_ENCODE_MAX_BITS - SRGB_ENCODE_MIN_BITS));
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    for(size_t i = 0; i < numPixels; ++i)
+    {
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(linear + i * 4), zero), one);
+        // Bits of non-negative floats order like integers; SSE2 has no signed min/max
+        // on 32 bit lanes, so clamp via compare and select.
+        __m128i offset = _mm_sub_epi32(_mm_castps_si128(v), minBits);
+        offset = _mm_andnot_si128(_mm_srai_epi32(offset, 31), offset);
+        __m128i over = _mm_cmpgt_epi32(offset, maxBitsFromMin);
+        offset = _mm_or_si128(_mm_and_si128(over, maxBitsFromMin), _mm_andnot_si128(over, offset));
+        __m128i index = _mm_srli_epi32(offset, SRGB_ENCODE_SHIFT);
+
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128((__m128i*)lanes, index);
+        rgba[i * 4 + 0] = tables->encode[lanes[0]];
+        rgba[i * 4 + 1] = tables->encode[lanes[1]];
+        rgba[i * 4 + 2] = tables->encode[lanes[2]];
+        rgba[i * 4 + 3] = EncodeAlphaScalar(linear[i * 4 + 3]);
+    }
+}
+#endif
+
+void TextureProcess_SrgbToLinear(const uint8_t* rgba, float* linear, size_t numPixels)
+{
+    const SrgbTables* tables = GetSrgbTables();
+#if ARCH_X64
+    if(CpuSupportsAVX2()) {
+        SrgbToLinear_AVX2(tables, rgba, linear, numPixels);
+        return;
+    }
+#endif
+    // SSE2 has no gather, a plain table walk is as fast as it gets
+    for(size_t i = 0; i < numPixels; ++i)
+    {
+        for(int c = 0; c < 3; ++c)
+            linear[i * 4 + c] = tables->decode[rgba[i * 4 + c]];
+        linear[i * 4 + 3] = tables->decode[256 + rgba[i * 4 + 3]];
+    }
+}
+
+void TextureProcess_LinearToSrgb(const float* linear, uint8_t* rgba, size_t numPixels)
+{
+    const SrgbTables* tables = GetSrgbTables();
+#if ARCH_X64
+    if(CpuSupportsAVX2())
+        LinearToSrgb_AVX2(tables, linear, rgba, numPixels);
+    else
+        LinearToSrgb_SSE2(tables, linear, rgba, numPixels);
+#else
+    for(size_t i = 0; i < numPixels; ++i)
+    {
+        for(int c = 0; c < 3; ++c)
+            rgba[i * 4 + c] = EncodeSrgbScalar(tables, linear[i * 4 + c]);
+        rgba[i * 4 + 3] = EncodeAlphaScalar(linear[i * 4 + 3]);
+    }
+#endif
+}
+
+////////////////////////////////////////////////////////////////
+// Mip generation
+
+// One RGBA pixel in a register. Filtering is the same code on every target.
+#if ARCH_X64
+typedef __m128 Pixel4;
+static inline Pixel4 Pixel4_Zero() { return _mm_setzero_ps(); }
+static inline Pixel4 Pixel4_Load(const float* p) { return _mm_loadu_ps(p); }
+static inline void Pixel4_Store(float* p, Pixel4 v) { _mm_storeu_ps(p, v); }
+static inline Pixel4 Pixel4_MulAdd(Pixel4 acc, Pixel4 v, float w) { return _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(w))); }
+#else
+struct Pixel4 { float v[4]; };
+static inline Pixel4 Pixel4_Zero() { Pixel4 r = { { 0, 0, 0, 0 } }; return r; }
+static inline Pixel4 Pixel4_Load(const float* p) { Pixel4 r = { { p[0], p[1], p[2], p[3] } }; return r; }
+static inline void Pixel4_Store(float* p, Pixel4 v) { memcpy(p, v.v, sizeof(v.v)); }
+static inline Pixel4 Pixel4_MulAdd(Pixel4 acc, Pixel4 v, float w) { for(int i = 0; i < 4; ++i) acc.v[i] += v.v[i] * w; return acc; }
+#endif
+
+struct FilterTap
+{
+    uint32_t index;
+    float weight;
+};
+
+// Taps for destination sample i are taps[first[i]] .. taps[first[i + 1] - 1]
+struct FilterTable
+{
+    std::vector<uint32_t> first;
+    std::vector<FilterTap> taps;
+};
+
+static double BesselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for(int k = 1; k < 32; ++k)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if(term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+static float KaiserWindowedSinc(float t)
+{
+    // t in destination texels
+    if(fabsf(t) >= KAISER_LOBES)
+        return 0.0f;
+    double pit = 3.14159265358979323846 * t;
+    double sinc = fabs(t) < 1e-6 ? 1.0 : sin(pit) / pit;
+    double r = t / KAISER_LOBES;
+    double window = BesselI0(KAISER_ALPHA * sqrt(1.0 - r * r)) / BesselI0(KAISER_ALPHA);
+    return (float)(sinc * window);
+}
+
+static void BuildFilterTable(uint32_t srcSize, uint32_t dstSize, MipFilter filter, FilterTable* table)
+{
+    float scale = (float)srcSize / (float)dstSize;
+    table->first.resize(dstSize + 1);
+    table->taps.clear();
+    for(uint32_t i = 0; i < dstSize; ++i)
+    {
+        table->first[i] = (uint32_t)table->taps.size();
+        float begin = i * scale;
+        float end = (i + 1) * scale;
+        float center = (begin + end) * 0.5f;
+        float radius = filter == MipFilter_Box ? scale * 0.5f : scale * KAISER_LOBES;
+
+        int32_t j0 = (int32_t)floorf(center - radius);
+        int32_t j1 = (int32_t)ceilf(center + radius);
+        float sum = 0.0f;
+        size_t firstTap = table->taps.size();
+        for(int32_t j = j0; j < j1; ++j)
+        {
+            float weight;
+            if(filter == MipFilter_Box)
+                weight = fmaxf(0.0f, fminf(end, (float)j + 1.0f) - fmaxf(begin, (float)j));
+            else
+                weight = KaiserWindowedSinc(((float)j + 0.5f - center) / scale);
+            if(weight == 0.0f)
+                continue;
+            // Clamp addressing
+            FilterTap tap;
+            tap.index = (uint32_t)(j < 0 ? 0 : (j >= (int32_t)srcSize ? (int32_t)srcSize - 1 : j));
+            tap.weight = weight;
+            table->taps.push_back(tap);
+            sum += weight;
+        }
+        for(size_t t = firstTap; t < table->taps.size(); ++t)
+            table->taps[t].weight /= sum;
+    }
+    table->first[dstSize] = (uint32_t)table->taps.size();
+}
+
+struct LinearImage
+{
+    uint32_t width;
+    uint32_t height;
+    std::vector<float> pixels; // premultiplied linear RGBA
+};
+
+static void DownsampleLinear(const LinearImage* src, LinearImage* dst, MipFilter filter, int numThreads)
+{
+    dst->width = src->width > 1 ? src->width / 2 : 1;
+    dst->height = src->height > 1 ? src->height / 2 : 1;
+    dst->pixels.resize((size_t)dst->width * dst->height * 4);
+
+    FilterTable horizontal, vertical;
+    BuildFilterTable(src->width, dst->width, filter, &horizontal);
+    BuildFilterTable(src->height, dst->height, filter, &vertical);
+
+    // Separable: rows first into a dstWidth x srcHeight temporary, then columns
+    std::vector<float> temp((size_t)dst->width * src->height * 4);
+    ParallelForEach(src->height, numThreads, [&](uint32_t y) {
+        const float* srcRow = &src->pixels[(size_t)y * src->width * 4];
+        float* tempRow = &temp[(size_t)y * dst->width * 4];
+        for(uint32_t x = 0; x < dst->width; ++x)
+        {
+            Pixel4 acc = Pixel4_Zero();
+            for(uint32_t t = horizontal.first[x]; t < horizontal.first[x + 1]; ++t)
+                acc = Pixel4_MulAdd(acc, Pixel4_Load(srcRow + horizontal.taps[t].index * 4), horizontal.taps[t].weight);
+            Pixel4_Store(tempRow + x * 4, acc);
+        }
+    });
+    ParallelForEach(dst->height, numThreads, [&](uint32_t y) {
+        float* dstRow = &dst->pixels[(size_t)y * dst->width * 4];
+        for(uint32_t x = 0; x < dst->width; ++x)
+        {
+            Pixel4 acc = Pixel4_Zero();
+            for(uint32_t t = vertical.first[y]; t < vertical.first[y + 1]; ++t)
+            {
+                const float* p = &temp[((size_t)vertical.taps[t].index * dst->width + x) * 4];
+                acc = Pixel4_MulAdd(acc, Pixel4_Load(p), vertical.taps[t].weight);
+            }
+            Pixel4_Store(dstRow + x * 4, acc);
+        }
+    });
+}
+
+static void EncodeMip(const LinearImage* linear, TextureImage* image, int numThreads)
+{
+    image->width = linear->width;
+    image->height = linear->height;
+    image->pixels.resize((size_t)linear->width * linear->height * 4);
+
+    ParallelForEach(linear->height, numThreads, [&](uint32_t y) {
+        // Undo premultiplication before encoding
+        std::vector<float> row(linear->pixels.begin() + (size_t)y * linear->width * 4,
+                               linear->pixels.begin() + (size_t)(y + 1) * linear->width * 4);
+        for(uint32_t x = 0; x < linear->width; ++x)
+        {
+            float* p = &row[x * 4];
+            float invAlpha = p[3] > 1.0f / 4096.0f ? 1.0f / p[3] : 0.0f;
+            p[0] *= invAlpha;
+            p[1] *= invAlpha;
+            p[2] *= invAlpha;
+        }
+        TextureProcess_LinearToSrgb(row.data(), &image->pixels[(size_t)y * linear->width * 4], linear->width);
+    });
+}
+
+void TextureProcess_GenerateMips(const TextureImage* top, MipFilter filter, uint32_t maxMips, int numThreads, std::vector<TextureImage>* mips)
+{
+    mips->clear();
+    mips->push_back(*top);
+    if(maxMips <= 1)
+        return;
+
+    LinearImage current;
+    current.width = top->width;
+    current.height = top->height;
+    current.pixels.resize((size_t)top->width * top->height * 4);
+    TextureProcess_SrgbToLinear(top->pixels.data(), current.pixels.data(), (size_t)top->width * top->height);
+    for(size_t i = 0; i < current.pixels.size(); i += 4)
+    {
+        current.pixels[i + 0] *= current.pixels[i + 3];
+        current.pixels[i + 1] *= current.pixels[i + 3];
+        current.pixels[i + 2] *= current.pixels[i + 3];
+    }
+
+    while((current.width > 1 || current.height > 1) && mips->size() < maxMips)
+    {
+        LinearImage next;
+        DownsampleLinear(&current, &next, filter, numThreads);
+        mips->emplace_back();
+        EncodeMip(&next, &mips->back(), numThreads);
+        current = std::move(next);
+    }
+}
+
+////////////////////////////////////////////////////////////////
+// Block compression
+
+struct BitWriter
+{
+    uint8_t* bytes;
+    uint32_t bit;
+
+    void Write(uint32_t value, int count)
+    {
+        for(int i = 0; i < count; ++i, ++bit)
+            bytes[bit >> 3] |= (uint8_t)(((value >> i) & 1) << (bit & 7));
+    }
+};
+
+struct BitReader
+{
+    const uint8_t* bytes;
+    uint32_t bit;
+
+    uint32_t Read(int count)
+    {
+        uint32_t value = 0;
+        for(int i = 0; i < count; ++i, ++bit)
+            value |= (uint32_t)((bytes[bit >> 3] >> (bit & 7)) & 1) << i;
+        return value;
+    }
+};
+
+static void FetchBlock(const TextureImage* image, uint32_t blockX, uint32_t blockY, uint8_t block[16][4])
+{
+    // Partial blocks at the image edge repeat the last row/column
+    for(uint32_t y = 0; y < 4; ++y)
+    {
+        uint32_t sy = blockY * 4 + y < image->height ? blockY * 4 + y : image->height - 1;
+        for(uint32_t x = 0; x < 4; ++x)
+        {
+            uint32_t sx = blockX * 4 + x < image->width ? blockX * 4 + x : image->width - 1;
+            memcpy(block[y * 4 + x], &image->pixels[((size_t)sy * image->width + sx) * 4], 4);
+        }
+    }
+}
+
+// Principal axis of the block's colours by power iteration, channels [0, numChannels)
+static void PrincipalAxis(const uint8_t block[16][4], int numChannels, float mean[4], float axis[4])
+{
+    float minValue[4] = { 255, 255, 255, 255 }, maxValue[4] = { 0, 0, 0, 0 };
+    for(int c = 0; c < 4; ++c)
+        mean[c] = 0.0f;
+    for(int i = 0; i < 16; ++i)
+    {
+        for(int c = 0; c < numChannels; ++c)
+        {
+            mean[c] += block[i][c];
+            minValue[c] = fminf(minValue[c], block[i][c]);
+            maxValue[c] = fmaxf(maxValue[c], block[i][c]);
+        }
+    }
+    for(int c = 0; c < numChannels; ++c)
+        mean[c] /= 16.0f;
+
+    float cov[4][4] = {};
+    for(int i = 0; i < 16; ++i)
+    {
+        float d[4];
+        for(int c = 0; c < numChannels; ++c)
+            d[c] = block[i][c] - mean[c];
+        for(int a = 0; a < numChannels; ++a)
+            for(int b = 0; b < numChannels; ++b)
+                cov[a][b] += d[a] * d[b];
+    }
+
+    for(int c = 0; c < 4; ++c)
+        axis[c] = c < numChannels ? maxValue[c] - minValue[c] : 0.0f;
+    for(int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[4] = {};
+        for(int a = 0; a < numChannels; ++a)
+            for(int b = 0; b < numChannels; ++b)
+                next[a] += cov[a][b] * axis[b];
+        float length = 0.0f;
+        for(int c = 0; c < numChannels; ++c)
+            length = fmaxf(length, fabsf(next[c]));
+        if(length < 1e-6f)
+            break;
+        for(int c = 0; c < numChannels; ++c)
+            axis[c] = next[c] / length;
+    }
+    float lengthSq = 0.0f;
+    for(int c = 0; c < numChannels; ++c)
+        lengthSq += axis[c] * axis[c];
+    float invLength = lengthSq > 0.0f ? 1.0f / sqrtf(lengthSq) : 0.0f;
+    for(int c = 0; c < numChannels; ++c)
+        axis[c] *= invLength;
+}
+
+// Least squares endpoints for fixed interpolation weights (weight of endpoint 1 per pixel)
+static bool SolveEndpoints(const uint8_t block[16][4], const float* weights, int numChannels, float e0[4], float e1[4])
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for(int i = 0; i < 16; ++i)
+    {
+        float b = weights[i];
+        float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for(int c = 0; c < numChannels; ++c)
+        {
+            ax[c] += a * block[i][c];
+            bx[c] += b * block[i][c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if(fabsf(det) < 1e-6f)
+        return false;
+    float invDet = 1.0f / det;
+    for(int c = 0; c < numChannels; ++c)
+    {
+        e0[c] = fminf(fmaxf((ax[c] * bb - bx[c] * ab) * invDet, 0.0f), 255.0f);
+        e1[c] = fminf(fmaxf((bx[c] * aa - ax[c] * ab) * invDet, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+static void InitialEndpoints(const uint8_t block[16][4], int numChannels, float e0[4], float e1[4])
+{
+    float mean[4], axis[4];
+    PrincipalAxis(block, numChannels, mean, axis);
+    float tMin = 0.0f, tMax = 0.0f;
+    for(int i = 0; i < 16; ++i)
+    {
+        float t = 0.0f;
+        for(int c = 0; c < numChannels; ++c)
+            t += (block[i][c] - mean[c]) * axis[c];
+        tMin = fminf(tMin, t);
+        tMax = fmaxf(tMax, t);
+    }
+    for(int c = 0; c < 4; ++c)
+    {
+        e0[c] = c < numChannels ? fminf(fmaxf(mean[c] + axis[c] * tMin, 0.0f), 255.0f) : 255.0f;
+        e1[c] = c < numChannels ? fminf(fmaxf(mean[c] + axis[c] * tMax, 0.0f), 255.0f) : 255.0f;
+    }
+}
+
+static uint32_t PickIndices(const uint8_t block[16][4], const int32_t (*palette)[4], int paletteSize, int numChannels, uint8_t indices[16])
+{
+    uint32_t totalError = 0;
+    for(int i = 0; i < 16; ++i)
+    {
+        uint32_t bestError = 0xFFFFFFFFu;
+        for(int p = 0; p < paletteSize; ++p)
+        {
+            uint32_t error = 0;
+            for(int c = 0; c < numChannels; ++c)
+            {
+                int32_t d = (int32_t)block[i][c] - palette[p][c];
+                error += (uint32_t)(d * d);
+            }
+            if(error < bestError)
+            {
+                bestError = error;
+                indices[i] = (uint8_t)p;
+            }
+        }
+        totalError += bestError;
+    }
+    return totalError;
+}
+
+// BC1
+
+static uint16_t Quantize565(const float color[4])
+{
+    uint32_t r = (uint32_t)(color[0] * 31.0f / 255.0f + 0.5f);
+    uint32_t g = (uint32_t)(color[1] * 63.0f / 255.0f + 0.5f);
+    uint32_t b = (uint32_t)(color[2] * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void Expand565(uint16_t packed, int32_t color[4])
+{
+    int32_t r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+    color[3] = 255;
+}
+
+static int BuildPaletteBC1(uint16_t c0, uint16_t c1, int32_t palette[4][4])
+{
+    Expand565(c0, palette[0]);
+    Expand565(c1, palette[1]);
+    if(c0 > c1)
+    {
+        for(int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+        }
+        palette[2][3] = palette[3][3] = 255;
+        return 4;
+    }
+    for(int c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+        palette[3][c] = 0;
+    }
+    palette[2][3] = 255;
+    palette[3][3] = 0;
+    return 3; // index 3 is transparent black, never chosen by the encoder
+}
+
+static void EncodeBC1Block(const uint8_t block[16][4], uint8_t* out)
+{
+    static const float paletteWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+    float e0[4], e1[4];
+    InitialEndpoints(block, 3, e0, e1);
+
+    uint16_t bestC0 = 0, bestC1 = 0;
+    uint8_t bestIndices[16] = {};
+    uint32_t bestError = 0xFFFFFFFFu;
+    for(int iteration = 0; iteration < 3; ++iteration)
+    {
+        uint16_t c0 = Quantize565(e1);
+        uint16_t c1 = Quantize565(e0);
+        if(c0 < c1) {
+            uint16_t t = c0; c0 = c1; c1 = t;
+        }
+        int32_t palette[4][4];
+        int paletteSize = BuildPaletteBC1(c0, c1, palette);
+        uint8_t indices[16];
+        uint32_t error = PickIndices(block, palette, paletteSize, 3, indices);
+        if(error < bestError)
+        {
+            bestError = error;
+            bestC0 = c0;
+            bestC1 = c1;
+            memcpy(bestIndices, indices, sizeof(indices));
+        }
+        if(error == 0 || c0 == c1)
+            break;
+
+        float weights[16];
+        for(int i = 0; i < 16; ++i)
+            weights[i] = 1.0f - paletteWeights[indices[i]]; // weight of palette[0]
+        if(!SolveEndpoints(block, weights, 3, e0, e1))
+            break;
+    }
+
+    uint32_t indexBits = 0;
+    for(int i = 0; i < 16; ++i)
+        indexBits |= (uint32_t)bestIndices[i] << (i * 2);
+    memcpy(out + 0, &bestC0, 2);
+    memcpy(out + 2, &bestC1, 2);
+    memcpy(out + 4, &indexBits, 4);
+}
+
+static void DecodeBC1Block(const uint8_t* in, uint8_t block[16][4])
+{
+    uint16_t c0, c1;
+    uint32_t indexBits;
+    memcpy(&c0, in + 0, 2);
+    memcpy(&c1, in + 2, 2);
+    memcpy(&indexBits, in + 4, 4);
+    int32_t palette[4][4];
+    BuildPaletteBC1(c0, c1, palette);
+    for(int i = 0; i < 16; ++i)
+    {
+        const int32_t* color = palette[(indexBits >> (i * 2)) & 3];
+        for(int c = 0; c < 4; ++c)
+            block[i][c] = (uint8_t)color[c];
+    }
+}
+
+// BC7 mode 6
+
+static const int32_t bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BC7Endpoint
+{
+    uint8_t value[4]; // 7 bit
+    uint8_t pbit;
+};
+
+static BC7Endpoint QuantizeBC7Endpoint(const float color[4])
+{
+    BC7Endpoint best = {};
+    float bestError = 1e30f;
+    for(uint8_t pbit = 0; pbit < 2; ++pbit)
+    {
+        BC7Endpoint candidate;
+        candidate.pbit = pbit;
+        float error = 0.0f;
+        for(int c = 0; c < 4; ++c)
+        {
+            float q = floorf((color[c] - pbit) * 0.5f + 0.5f);
+            q = fminf(fmaxf(q, 0.0f), 127.0f);
+            candidate.value[c] = (uint8_t)q;
+            float d = (q * 2.0f + pbit) - color[c];
+            error += d * d;
+        }
+        if(error < bestError)
+        {
+            bestError = error;
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+static void BuildPaletteBC7(const BC7Endpoint* e0, const BC7Endpoint* e1, int32_t palette[16][4])
+{
+    for(int c = 0; c < 4; ++c)
+    {
+        int32_t a = (e0->value[c] << 1) | e0->pbit;
+        int32_t b = (e1->value[c] << 1) | e1->pbit;
+        for(int i = 0; i < 16; ++i)
+            palette[i][c] = ((64 - bc7Weights4[i]) * a + bc7Weights4[i] * b + 32) >> 6;
+    }
+}
+
+static void EncodeBC7Block(const uint8_t block[16][4], uint8_t* out)
+{
+    float e0[4], e1[4];
+    InitialEndpoints(block, 4, e0, e1);
+
+    BC7Endpoint best0 = {}, best1 = {};
+    uint8_t bestIndices[16] = {};
+    uint32_t bestError = 0xFFFFFFFFu;
+    for(int iteration = 0; iteration < 3; ++iteration)
+    {
+        BC7Endpoint q0 = QuantizeBC7Endpoint(e0);
+        BC7Endpoint q1 = QuantizeBC7Endpoint(e1);
+        int32_t palette[16][4];
+        BuildPaletteBC7(&q0, &q1, palette);
+        uint8_t indices[16];
+        uint32_t error = PickIndices(block, palette, 16, 4, indices);
+        if(error < bestError)
+        {
+            bestError = error;
+            best0 = q0;
+            best1 = q1;
+            memcpy(bestIndices, indices, sizeof(indices));
+        }
+        if(error == 0)
+            break;
+
+        float weights[16];
+        for(int i = 0; i < 16; ++i)
+            weights[i] = bc7Weights4[indices[i]] / 64.0f;
+        if(!SolveEndpoints(block, weights, 4, e0, e1))
+            break;
+    }
+
+    // The anchor index is stored with an implicit zero high bit
+    if(bestIndices[0] & 8)
+    {
+        BC7Endpoint t = best0; best0 = best1; best1 = t;
+        for(int i = 0; i < 16; ++i)
+            bestIndices[i] = (uint8_t)(15 - bestIndices[i]);
+    }
+
+    memset(out, 0, 16);
+    BitWriter writer = { out, 0 };
+    writer.Write(1 << 6, 7); // mode 6
+    for(int c = 0; c < 4; ++c)
+    {
+        writer.Write(best0.value[c], 7);
+        writer.Write(best1.value[c], 7);
+    }
+    writer.Write(best0.pbit, 1);
+    writer.Write(best1.pbit, 1);
+    writer.Write(bestIndices[0], 3);
+    for(int i = 1; i < 16; ++i)
+        writer.Write(bestIndices[i], 4);
+}
+
+static void DecodeBC7Block(const uint8_t* in, uint8_t block[16][4])
+{
+    BitReader reader = { in, 0 };
+    if(reader.Read(7) != (1 << 6))
+    {
+        // Only mode 6 is produced by this encoder
+        memset(block, 0, 16 * 4);
+        return;
+    }
+    BC7Endpoint e0, e1;
+    for(int c = 0; c < 4; ++c)
+    {
+        e0.value[c] = (uint8_t)reader.Read(7);
+        e1.value[c] = (uint8_t)reader.Read(7);
+    }
+    e0.pbit = (uint8_t)reader.Read(1);
+    e1.pbit = (uint8_t)reader.Read(1);
+    int32_t palette[16][4];
+    BuildPaletteBC7(&e0, &e1, palette);
+    for(int i = 0; i < 16; ++i)
+    {
+        uint32_t index = reader.Read(i == 0 ? 3 : 4);
+        for(int c = 0; c < 4; ++c)
+            block[i][c] = (uint8_t)palette[index][c];
+    }
+}
+
+uint32_t TextureProcess_BlockBytes(BlockFormat format)
+{
+    return format == BlockFormat_BC1 ? 8 : 16;
+}
+
+void TextureProcess_Compress(const TextureImage* image, BlockFormat format, int numThreads, std::vector<uint8_t>* blocks, CompressStats* stats)
+{
+    uint32_t blocksX = (image->width + 3) / 4;
+    uint32_t blocksY = (image->height + 3) / 4;
+    uint32_t blockBytes = TextureProcess_BlockBytes(format);
+    blocks->resize((size_t)blocksX * blocksY * blockBytes);
+
+    double start = GetSeconds();
+    ParallelForEach(blocksY, numThreads, [&](uint32_t by) {
+        uint8_t* out = &(*blocks)[(size_t)by * blocksX * blockBytes];
+        for(uint32_t bx = 0; bx < blocksX; ++bx, out += blockBytes)
+        {
+            uint8_t block[16][4];
+            FetchBlock(image, bx, by, block);
+            if(format == BlockFormat_BC1)
+                EncodeBC1Block(block, out);
+            else
+                EncodeBC7Block(block, out);
+        }
+    });
+    double seconds = GetSeconds() - start;
+
+    if(stats)
+    {
+        stats->seconds = seconds;
+        stats->megapixelsPerSecond = seconds > 0.0 ? (double)image->width * image->height / seconds * 1e-6 : 0.0;
+        TextureImage decoded;
+        TextureProcess_Decompress(blocks->data(), format, image->width, image->height, &decoded);
+        stats->psnr = TextureProcess_PSNR(image, &decoded, format == BlockFormat_BC1 ? 3 : 4);
+    }
+}
+
+void TextureProcess_Decompress(const uint8_t* blocks, BlockFormat format, uint32_t width, uint32_t height, TextureImage* image)
+{
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    uint32_t blockBytes = TextureProcess_BlockBytes(format);
+    image->width = width;
+    image->height = height;
+    image->pixels.resize((size_t)width * height * 4);
+
+    for(uint32_t by = 0; by < blocksY; ++by)
+    {
+        for(uint32_t bx = 0; bx < blocksX; ++bx)
+        {
+            uint8_t block[16][4];
+            const uint8_t* in = blocks + ((size_t)by * blocksX + bx) * blockBytes;
+            if(format == BlockFormat_BC1)
+                DecodeBC1Block(in, block);
+            else
+                DecodeBC7Block(in, block);
+            for(uint32_t y = 0; y < 4 && by * 4 + y < height; ++y)
+            {
+                for(uint32_t x = 0; x < 4 && bx * 4 + x < width; ++x)
+                    memcpy(&image->pixels[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4], block[y * 4 + x], 4);
+            }
+        }
+    }
+}
+
+double TextureProcess_PSNR(const TextureImage* a, const TextureImage* b, int numChannels)
+{
+    if(a->width != b->width || a->height != b->height)
+        return 0.0;
+    double sum = 0.0;
+    size_t numPixels = (size_t)a->width * a->height;
+    for(size_t i = 0; i < numPixels; ++i)
+    {
+        for(int c = 0; c < numChannels; ++c)
+        {
+            double d = (double)a->pixels[i * 4 + c] - (double)b->pixels[i * 4 + c];
+            sum += d * d;
+        }
+    }
+    double mse = sum / ((double)numPixels * numChannels);
+    if(mse <= 0.0)
+        return 99.0;
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
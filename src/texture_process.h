@@ -0,0 +1,57 @@
+#pragma once
+
+// CPU texture processing for the asset pipeline: sRGB-correct mip chains and
+// BC1/BC7 block compression of stb_image RGBA8 output.
+//
+// Mips are filtered in linear space with premultiplied alpha and every level is
+// derived from the previous float level, so quantization error doesn't compound.
+// sRGB<->linear conversion runs 4 (SSE2) or 8 (AVX2) values at a time.
+//
+// The block encoders work directly on the sRGB bytes, matching the
+// BC1_UNORM_SRGB / BC7_UNORM_SRGB formats. BC7 uses mode 6 only (single subset,
+// RGBA 7.7.7.7 + p-bit endpoints, 4 bit indices), which is the usual quality vs
+// speed sweet spot for opaque and smooth-alpha content.
+
+#include "base.h"
+
+#include <vector>
+
+struct TextureImage
+{
+  uint32_t width;
+  uint32_t height;
+  std::vector<uint8_t> pixels; // RGBA8, sRGB colour, linear alpha, tightly packed
+};
+
+enum MipFilter
+{
+  MipFilter_Box,
+  MipFilter_Kaiser,
+};
+
+enum BlockFormat
+{
+  BlockFormat_BC1, // 8 bytes per 4x4 block, alpha ignored
+  BlockFormat_BC7, // 16 bytes per 4x4 block
+};
+
+struct CompressStats
+{
+  double seconds;
+  double megapixelsPerSecond;
+  double psnr; // dB, RGB for BC1, RGBA for BC7
+};
+
+void TextureProcess_SrgbToLinear(const uint8_t* rgba, float* linear, size_t numPixels);
+void TextureProcess_LinearToSrgb(const float* linear, uint8_t* rgba, size_t numPixels);
+
+// mips[0] receives a copy of top. Stops at 1x1 or after maxMips levels.
+void TextureProcess_GenerateMips(const TextureImage* top, MipFilter filter, uint32_t maxMips, int numThreads, std::vector<TextureImage>* mips);
+
+uint32_t TextureProcess_BlockBytes(BlockFormat format);
+// Encodes the image split across numThreads workers by rows of 4x4 blocks.
+// stats may be null; filling it also decodes the result to measure PSNR.
+void TextureProcess_Compress(const TextureImage* image, BlockFormat format, int numThreads, std::vector<uint8_t>* blocks, CompressStats* stats);
+void TextureProcess_Decompress(const uint8_t* blocks, BlockFormat format, uint32_t width, uint32_t height, TextureImage* image);
+
+double TextureProcess_PSNR(const TextureImage* a, const TextureImage* b, int numChannels);
@@ -0,0 +1,393 @@
+#include "texture_streamer.h"
+#include "memory.h"
+#include "profiler.h"
+#include "stb_image_decl.h"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TEXTURE_STREAMER_SCRATCH_SIZE (64 << 20) // per worker, stb_image working set of a 4k decode
+
+struct TextureStreamRequest
+{
+    uint32_t texture;
+    uint32_t firstMip; // finest mip wanted, coarser ones come along for free
+    std::string path;
+};
+
+struct TextureStreamResult
+{
+    TextureStreamResult* next; // completion queue link
+    uint32_t texture;
+    uint32_t firstMip;
+    bool failed;
+    TextureStreamInfo info;
+    std::vector<TextureImage> mips; // indexed by level, empty below firstMip
+
+    // Upload progress, main thread only
+    bool started;
+    bool droppedMips;
+    uint32_t nextMip;
+};
+
+struct StreamedTexture
+{
+    std::string path;
+    TextureStreamInfo info;
+    uint32_t firstResidentMip;
+    uint32_t firstValidMip;
+    uint32_t lastSampled[TEXTURE_STREAMER_MAX_MIPS]; // frame index
+    uint32_t retryFrame;
+    bool loading;
+    bool failed;
+};
+
+struct TextureStreamer
+{
+    TextureStreamerDesc desc;
+    std::vector<StreamedTexture> textures;
+    uint32_t frameIndex;
+    TextureStreamerStats stats;
+
+    std::vector<std::thread> workers;
+    std::mutex requestMutex;
+    std::condition_variable requestCondition;
+    std::deque<TextureStreamRequest> requests;
+    bool quit;
+
+    // Workers push finished results here without taking a lock; the main thread
+    // takes the whole list at once and keeps it in pending, oldest first.
+    std::atomic<TextureStreamResult*> completed;
+    std::deque<TextureStreamResult*> pending;
+};
+
+static void PushCompleted(TextureStreamer* streamer, TextureStreamResult* result)
+{
+    result->next = streamer->completed.load(std::memory_order_relaxed);
+    while(!streamer->completed.compare_exchange_weak(result->next, result, std::memory_order_release, std::memory_order_relaxed))
+        ;
+}
+
+static void TakeCompleted(TextureStreamer* streamer)
+{
+    // The list comes out newest first
+    TextureStreamResult* list = streamer->completed.exchange(nullptr, std::memory_order_acquire);
+    TextureStreamResult* reversed = nullptr;
+    while(list)
+    {
+        TextureStreamResult* next = list->next;
+        list->next = reversed;
+        reversed = list;
+        list = next;
+    }
+    for(TextureStreamResult* result = reversed; result; result = result->next)
+        streamer->pending.push_back(result);
+}
+
+static void LoadTexture(const TextureStreamRequest* request, MipFilter mipFilter, MemoryArena* scratch, TextureStreamResult* result)
+{
+    PROFILE_FUNCTION();
+    int width, height, channels;
+    uint8_t* rgba = stbi_load(request->path.c_str(), &width, &height, &channels, 4);
+    if(!rgba) {
+        result->failed = true;
+        MemoryArena_Reset(scratch);
+        return;
+    }
+    TextureImage top;
+    top.width = (uint32_t)width;
+    top.height = (uint32_t)height;
+    top.pixels.assign(rgba, rgba + (size_t)width * height * 4);
+    stbi_image_free(rgba);
+    MemoryArena_Reset(scratch);
+
+    // Each worker is one thread of the pool, so mipping stays single threaded
+    TextureProcess_GenerateMips(&top, mipFilter, TEXTURE_STREAMER_MAX_MIPS, 1, &result->mips);
+    result->info = { top.width, top.height, (uint32_t)result->mips.size() };
+    result->firstMip = std::min(request->firstMip, result->info.numMips - 1);
+    for(uint32_t mip = 0; mip < result->firstMip; ++mip)
+        result->mips[mip] = TextureImage();
+}
+
+static void TextureStreamerWorkerMain(TextureStreamer* streamer)
+{
+    Profiler_SetThreadName("Texture Streamer");
+    MemoryArena scratch;
+    bool hasScratch = MemoryArena_Init(&scratch, TEXTURE_STREAMER_SCRATCH_SIZE, "Texture Decode");
+    Memory_BindStbiArena(hasScratch ? &scratch : nullptr);
+
+    for(;;)
+    {
+        TextureStreamRequest request;
+        {
+            std::unique_lock<std::mutex> lock(streamer->requestMutex);
+            streamer->requestCondition.wait(lock, [&] { return streamer->quit || !streamer->requests.empty(); });
+            if(streamer->quit)
+                break;
+            request = std::move(streamer->requests.front());
+            streamer->requests.pop_front();
+        }
+
+        TextureStreamResult* result = new TextureStreamResult();
+        result->texture = request.texture;
+        result->firstMip = request.firstMip;
+        LoadTexture(&request, streamer->desc.mipFilter, &scratch, result);
+        PushCompleted(streamer, result);
+    }
+
+    Memory_BindStbiArena(nullptr);
+    if(hasScratch)
+        MemoryArena_Release(&scratch);
+}
+
+static void QueueLoad(TextureStreamer* streamer, uint32_t texture, uint32_t firstMip)
+{
+    StreamedTexture* streamed = &streamer->textures[texture];
+    streamed->loading = true;
+    streamer->stats.numRequests++;
+    {
+        std::lock_guard<std::mutex> lock(streamer->requestMutex);
+        streamer->requests.push_back({ texture, firstMip, streamed->path });
+    }
+    streamer->requestCondition.notify_one();
+}
+
+// Evicts least recently sampled mips of other textures until needed bytes fit
+// in the budget or nothing evictable is left, and returns the free bytes.
+// Mips sampled this frame are never evicted.
+static uint64_t MakeRoom(TextureStreamer* streamer, uint64_t needed, uint32_t exclude)
+{
+    uint64_t budget = streamer->desc.memoryBudget;
+    std::vector<std::pair<uint32_t, uint32_t>> resized; // texture, first resident mip before eviction
+    while(budget - std::min(budget, streamer->stats.residentBytes) < needed)
+    {
+        uint32_t victim = TEXTURE_STREAMER_INVALID;
+        uint32_t victimFrame = 0xFFFFFFFFu;
+        for(uint32_t i = 0; i < (uint32_t)streamer->textures.size(); ++i)
+        {
+            const StreamedTexture* texture = &streamer->textures[i];
+            uint32_t mip = texture->firstResidentMip;
+            if(i == exclude || texture->info.numMips == 0 || mip + 1 >= texture->info.numMips)
+                continue;
+            if(texture->lastSampled[mip] >= streamer->frameIndex || texture->lastSampled[mip] >= victimFrame)
+                continue;
+            victim = i;
+            victimFrame = texture->lastSampled[mip];
+        }
+        if(victim == TEXTURE_STREAMER_INVALID)
+            break;
+
+        StreamedTexture* texture = &streamer->textures[victim];
+        uint32_t mip = texture->firstResidentMip;
+        auto it = std::find_if(resized.begin(), resized.end(), [&](const std::pair<uint32_t, uint32_t>& entry) { return entry.first == victim; });
+        if(it == resized.end())
+            resized.push_back({ victim, mip });
+        texture->firstResidentMip = mip + 1;
+        texture->firstValidMip = std::max(texture->firstValidMip, mip + 1);
+        streamer->stats.residentBytes -= TextureStreamer_MipBytes(&texture->info, mip);
+        streamer->stats.numMipsEvicted++;
+    }
+
+    // One resize per texture no matter how many of its mips went
+    const TextureStreamBackend* backend = &streamer->desc.backend;
+    for(size_t i = 0; i < resized.size(); ++i)
+    {
+        const StreamedTexture* texture = &streamer->textures[resized[i].first];
+        backend->resize(resized[i].first, &texture->info, texture->firstResidentMip, resized[i].second, backend->userData);
+    }
+    return budget - std::min(budget, streamer->stats.residentBytes);
+}
+
+static void FinishResult(TextureStreamer* streamer)
+{
+    TextureStreamResult* result = streamer->pending.front();
+    StreamedTexture* texture = &streamer->textures[result->texture];
+    texture->loading = false;
+    if(result->droppedMips)
+        texture->retryFrame = streamer->frameIndex + TEXTURE_STREAMER_RETRY_FRAMES;
+    if(result->failed) {
+        texture->failed = true;
+        streamer->stats.numFailed++;
+    }
+    else
+        streamer->stats.numLoaded++;
+    streamer->pending.pop_front();
+    delete result;
+}
+
+TextureStreamer* TextureStreamer_Create(const TextureStreamerDesc* desc)
+{
+    TextureStreamer* streamer = new TextureStreamer;
+    streamer->desc = *desc;
+    streamer->frameIndex = 1;
+    streamer->stats = {};
+    streamer->quit = false;
+    streamer->completed.store(nullptr, std::memory_order_relaxed);
+
+    int numThreads = desc->numThreads;
+    if(numThreads <= 0)
+        numThreads = (int)std::thread::hardware_concurrency() - 1;
+    if(numThreads <= 0)
+        numThreads = 1;
+    for(int i = 0; i < numThreads; ++i)
+        streamer->workers.emplace_back(TextureStreamerWorkerMain, streamer);
+    return streamer;
+}
+
+void TextureStreamer_Destroy(TextureStreamer* streamer)
+{
+    {
+        std::lock_guard<std::mutex> lock(streamer->requestMutex);
+        streamer->quit = true;
+    }
+    streamer->requestCondition.notify_all();
+    for(size_t i = 0; i < streamer->workers.size(); ++i)
+        streamer->workers[i].join();
+
+    TakeCompleted(streamer);
+    for(size_t i = 0; i < streamer->pending.size(); ++i)
+        delete streamer->pending[i];
+    delete streamer;
+}
+
+uint32_t TextureStreamer_Request(TextureStreamer* streamer, const char* path)
+{
+    uint32_t texture = (uint32_t)streamer->textures.size();
+    streamer->textures.emplace_back();
+    StreamedTexture* streamed = &streamer->textures.back();
+    streamed->path = path;
+    streamed->info = {};
+    streamed->firstResidentMip = 0;
+    streamed->firstValidMip = 0;
+    memset(streamed->lastSampled, 0, sizeof(streamed->lastSampled));
+    streamed->retryFrame = 0;
+    streamed->failed = false;
+    QueueLoad(streamer, texture, 0);
+    return texture;
+}
+
+void TextureStreamer_MarkSampled(TextureStreamer* streamer, uint32_t texture, uint32_t mip)
+{
+    if(texture >= streamer->textures.size())
+        return;
+    StreamedTexture* streamed = &streamer->textures[texture];
+    if(streamed->info.numMips == 0)
+        return;
+
+    // Coarser mips count as sampled too, see the header
+    mip = std::min(mip, streamed->info.numMips - 1);
+    for(uint32_t m = mip; m < streamed->info.numMips; ++m)
+        streamed->lastSampled[m] = streamer->frameIndex;
+
+    if(mip < streamed->firstValidMip && !streamed->loading && !streamed->failed && streamer->frameIndex >= streamed->retryFrame)
+        QueueLoad(streamer, texture, mip);
+}
+
+void TextureStreamer_Update(TextureStreamer* streamer, double timeBudgetSeconds)
+{
+    PROFILE_FUNCTION();
+    double start = GetSeconds();
+    const TextureStreamBackend* backend = &streamer->desc.backend;
+    TakeCompleted(streamer);
+
+    bool uploadedAny = false;
+    while(!streamer->pending.empty())
+    {
+        if(uploadedAny && GetSeconds() - start >= timeBudgetSeconds)
+            break;
+
+        TextureStreamResult* result = streamer->pending.front();
+        StreamedTexture* texture = &streamer->textures[result->texture];
+        if(result->failed) {
+            FinishResult(streamer);
+            continue;
+        }
+        if(!result->started)
+        {
+            if(texture->info.numMips == 0)
+            {
+                texture->info = result->info;
+                texture->firstResidentMip = texture->info.numMips;
+                texture->firstValidMip = texture->info.numMips;
+            }
+            result->started = true;
+            result->nextMip = result->info.numMips - 1;
+        }
+
+        // Coarse to fine; levels that are already valid are skipped
+        uint32_t mip = result->nextMip;
+        if(mip < texture->firstValidMip)
+        {
+            if(mip < texture->firstResidentMip)
+            {
+                // Storage for as much of the rest of this load as fits, in one resize
+                uint64_t needed = 0;
+                for(uint32_t m = result->firstMip; m <= mip; ++m)
+                    needed += TextureStreamer_MipBytes(&texture->info, m);
+                uint64_t available = MakeRoom(streamer, needed, result->texture);
+                uint32_t firstMip = result->firstMip;
+                while(firstMip <= mip && needed > available)
+                    needed -= TextureStreamer_MipBytes(&texture->info, firstMip++);
+                streamer->stats.numMipsDropped += firstMip - result->firstMip;
+                result->droppedMips = firstMip > result->firstMip;
+                if(firstMip > mip) {
+                    FinishResult(streamer);
+                    continue;
+                }
+
+                uint32_t previousFirstMip = texture->firstResidentMip;
+                texture->firstResidentMip = firstMip;
+                result->firstMip = firstMip;
+                streamer->stats.residentBytes += needed;
+                streamer->stats.peakResidentBytes = std::max(streamer->stats.peakResidentBytes, streamer->stats.residentBytes);
+                backend->resize(result->texture, &texture->info, firstMip, previousFirstMip, backend->userData);
+            }
+
+            const TextureImage* image = &result->mips[mip];
+            backend->upload(result->texture, mip, image->width, image->height, image->pixels.data(), backend->userData);
+            streamer->stats.bytesUploaded += (uint64_t)image->width * image->height * 4;
+            result->mips[mip] = TextureImage();
+            texture->firstValidMip = mip;
+            // A fresh upload counts as used now so the next load doesn't evict it straight away
+            for(uint32_t m = mip; m < texture->info.numMips; ++m)
+                texture->lastSampled[m] = std::max(texture->lastSampled[m], streamer->frameIndex);
+            streamer->stats.numMipsUploaded++;
+            uploadedAny = true;
+        }
+
+        if(mip == result->firstMip)
+            FinishResult(streamer);
+        else
+            result->nextMip--;
+    }
+
+    streamer->stats.numPendingResults = (uint32_t)streamer->pending.size();
+    streamer->frameIndex++;
+}
+
+void TextureStreamer_GetResidency(const TextureStreamer* streamer, uint32_t texture, TextureStreamResidency* residency)
+{
+    *residency = {};
+    if(texture >= streamer->textures.size()) {
+        residency->failed = true;
+        return;
+    }
+    const StreamedTexture* streamed = &streamer->textures[texture];
+    residency->info = streamed->info;
+    residency->firstResidentMip = streamed->firstResidentMip;
+    residency->firstValidMip = streamed->firstValidMip;
+    residency->loading = streamed->loading;
+    residency->failed = streamed->failed;
+}
+
+void TextureStreamer_GetStats(const TextureStreamer* streamer, TextureStreamerStats* stats)
+{
+    *stats = streamer->stats;
+}
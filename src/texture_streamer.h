@@ -0,0 +1,106 @@
+#pragma once
+
+// Asynchronous texture streaming. Requests are decoded with stb_image and
+// mipped on a pool of worker threads; finished textures come back through a
+// lock-free completion queue that the main thread drains in TextureStreamer_Update
+// under a per-frame time budget, handing mips to a TextureStreamBackend
+// (D3D11, or a fake target for headless runs) coarsest first so a texture is
+// usable long before its top mip arrives.
+//
+// Resident mips are held to a memory budget. The renderer reports the finest
+// mip it sampled from each texture every frame; when an upload needs room, the
+// least recently sampled mips are evicted. Sampling a mip marks all coarser
+// mips too, so the least recently sampled mip is always the finest resident mip
+// of its texture and eviction never leaves holes in a chain. The coarsest mip
+// of a loaded texture is never evicted.
+//
+// All functions except the worker internals must be called from one thread.
+
+#include "base.h"
+#include "texture_process.h"
+
+#define TEXTURE_STREAMER_MAX_MIPS 16
+#define TEXTURE_STREAMER_RETRY_FRAMES 30 // after a load lost mips to the budget, wait before asking again
+#define TEXTURE_STREAMER_INVALID 0xFFFFFFFFu
+
+struct TextureStreamer;
+
+// Full chain of a streamed texture. Pixels are RGBA8, sRGB colour.
+struct TextureStreamInfo
+{
+  uint32_t width;
+  uint32_t height;
+  uint32_t numMips;
+};
+
+// resize: give texture storage for mips [firstMip, numMips), keeping the
+// contents of the previously resident mips [previousFirstMip, numMips).
+// previousFirstMip == numMips means nothing was resident. Called before finer
+// mips are uploaded and after mips are evicted.
+// upload: pixels for one resident mip, tightly packed rows. Mips of one load
+// arrive coarse to fine.
+typedef void TextureStreamResizeFunc(uint32_t texture, const TextureStreamInfo* info, uint32_t firstMip, uint32_t previousFirstMip, void* userData);
+typedef void TextureStreamUploadFunc(uint32_t texture, uint32_t mip, uint32_t width, uint32_t height, const uint8_t* pixels, void* userData);
+
+struct TextureStreamBackend
+{
+  TextureStreamResizeFunc* resize;
+  TextureStreamUploadFunc* upload;
+  void* userData;
+};
+
+struct TextureStreamerDesc
+{
+  int numThreads;         // decode workers, 0 = one per hardware core minus one
+  uint64_t memoryBudget;  // bytes of resident mips
+  MipFilter mipFilter;
+  TextureStreamBackend backend;
+};
+
+struct TextureStreamResidency
+{
+  TextureStreamInfo info; // zero until the first load finished
+  uint32_t firstResidentMip; // storage exists for [firstResidentMip, numMips)
+  uint32_t firstValidMip;    // uploaded, safe to sample; numMips while nothing is
+  bool loading;
+  bool failed;
+};
+
+struct TextureStreamerStats
+{
+  uint64_t residentBytes;
+  uint64_t peakResidentBytes;
+  uint64_t bytesUploaded;
+  uint32_t numRequests;    // loads queued, including re-streams of evicted mips
+  uint32_t numLoaded;
+  uint32_t numFailed;
+  uint32_t numMipsUploaded;
+  uint32_t numMipsEvicted;
+  uint32_t numMipsDropped; // decoded but not uploaded because the budget was full of mips in use
+  uint32_t numPendingResults;
+};
+
+TextureStreamer* TextureStreamer_Create(const TextureStreamerDesc* desc);
+void TextureStreamer_Destroy(TextureStreamer* streamer);
+
+// Returns a texture handle right away; the load runs in the background.
+uint32_t TextureStreamer_Request(TextureStreamer* streamer, const char* path);
+
+// Called by the renderer for every texture it draws with, with the finest mip
+// it needs. Requests a re-stream if that mip isn't resident.
+void TextureStreamer_MarkSampled(TextureStreamer* streamer, uint32_t texture, uint32_t mip);
+
+// Once per frame, after the frame's MarkSampled calls: takes finished loads
+// off the completion queue and uploads them until timeBudgetSeconds is spent
+// (at least one mip per call so loads always progress), evicting as needed.
+void TextureStreamer_Update(TextureStreamer* streamer, double timeBudgetSeconds);
+
+void TextureStreamer_GetResidency(const TextureStreamer* streamer, uint32_t texture, TextureStreamResidency* residency);
+void TextureStreamer_GetStats(const TextureStreamer* streamer, TextureStreamerStats* stats);
+
+static inline uint64_t TextureStreamer_MipBytes(const TextureStreamInfo* info, uint32_t mip)
+{
+  uint32_t width = info->width >> mip ? info->width >> mip : 1;
+  uint32_t height = info->height >> mip ? info->height >> mip : 1;
+  return (uint64_t)width * height * 4;
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+// Compile-time vertex format descriptors. A format is a list of attributes;
+// stride, offsets and the element table are computed by the compiler, so the
+// C++ vertex struct, the input layout and the pack routines all derive from
+// one declaration:
+//
+//   typedef VertexFormat<VertexAttrib<VertexSemantic_Position, VertexAttribFormat_Float16x2>,
+//                        VertexAttrib<VertexSemantic_Color, VertexAttribFormat_Unorm8x4>> PackedVertexFormat;
+//   VERTEX_FORMAT_CHECK_MEMBER(PackedVertex, PackedVertexFormat, 0, position);
+//
+// Formats use DXGI_FORMAT values but nothing here depends on D3D headers.
+
+#include "base.h"
+
+#include <utility>
+
+enum VertexSemantic : uint32_t
+{
+  VertexSemantic_Position,
+  VertexSemantic_Color,
+  VertexSemantic_Normal,
+  VertexSemantic_Texcoord,
+  VertexSemantic_Rect,
+};
+
+// Every format is a multiple of 4 bytes, so offsets always meet D3D11's alignment rule
+enum VertexAttribFormat : uint32_t
+{
+  VertexAttribFormat_Float32x2,
+  VertexAttribFormat_Float32x3,
+  VertexAttribFormat_Float32x4,
+  VertexAttribFormat_Float16x2,
+  VertexAttribFormat_Float16x4,
+  VertexAttribFormat_Unorm8x4,
+  VertexAttribFormat_Snorm8x4,
+};
+
+constexpr const char* VertexSemantic_Name(VertexSemantic semantic)
+{
+  return semantic == VertexSemantic_Position ? "POSITION"
+       : semantic == VertexSemantic_Color ? "COLOR"
+       : semantic == VertexSemantic_Normal ? "NORMAL"
+       : semantic == VertexSemantic_Texcoord ? "TEXCOORD"
+       : "RECT";
+}
+
+constexpr uint32_t VertexAttribFormat_Size(VertexAttribFormat format)
+{
+  return format == VertexAttribFormat_Float32x2 ? 8
+       : format == VertexAttribFormat_Float32x3 ? 12
+       : format == VertexAttribFormat_Float32x4 ? 16
+       : format == VertexAttribFormat_Float16x4 ? 8
+       : 4;
+}
+
+constexpr uint32_t VertexAttribFormat_Components(VertexAttribFormat format)
+{
+  return format == VertexAttribFormat_Float32x2 || format == VertexAttribFormat_Float16x2 ? 2
+       : format == VertexAttribFormat_Float32x3 ? 3
+       : 4;
+}
+
+constexpr bool VertexAttribFormat_IsFloat32(VertexAttribFormat format)
+{
+  return format == VertexAttribFormat_Float32x2 || format == VertexAttribFormat_Float32x3 || format == VertexAttribFormat_Float32x4;
+}
+
+// DXGI_FORMAT value
+constexpr uint32_t VertexAttribFormat_Dxgi(VertexAttribFormat format)
+{
+  return format == VertexAttribFormat_Float32x2 ? 16  // R32G32_FLOAT
+       : format == VertexAttribFormat_Float32x3 ? 6   // R32G32B32_FLOAT
+       : format == VertexAttribFormat_Float32x4 ? 2   // R32G32B32A32_FLOAT
+       : format == VertexAttribFormat_Float16x2 ? 34  // R16G16_FLOAT
+       : format == VertexAttribFormat_Float16x4 ? 10  // R16G16B16A16_FLOAT
+       : format == VertexAttribFormat_Unorm8x4 ? 28   // R8G8B8A8_UNORM
+       : 31;                                          // R8G8B8A8_SNORM
+}
+
+struct VertexElementDesc
+{
+  VertexSemantic semantic;
+  uint32_t semanticIndex;
+  VertexAttribFormat format;
+  uint32_t offset;
+};
+
+template<VertexSemantic Semantic, VertexAttribFormat Format, uint32_t SemanticIndex = 0>
+struct VertexAttrib
+{
+  static constexpr VertexSemantic semantic = Semantic;
+  static constexpr VertexAttribFormat format = Format;
+  static constexpr uint32_t semanticIndex = SemanticIndex;
+  static constexpr uint32_t size = VertexAttribFormat_Size(Format);
+};
+
+template<typename... Attribs>
+struct VertexSizeSum
+{
+  static constexpr uint32_t value = 0;
+};
+
+template<typename First, typename... Rest>
+struct VertexSizeSum<First, Rest...>
+{
+  static constexpr uint32_t value = First::size + VertexSizeSum<Rest...>::value;
+};
+
+// Offset of attribute N = size of the N attributes before it
+template<size_t N, typename... Attribs>
+struct VertexOffsetOf;
+
+template<typename First, typename... Rest>
+struct VertexOffsetOf<0, First, Rest...>
+{
+  static constexpr uint32_t value = 0;
+};
+
+template<size_t N, typename First, typename... Rest>
+struct VertexOffsetOf<N, First, Rest...>
+{
+  static constexpr uint32_t value = First::size + VertexOffsetOf<N - 1, Rest...>::value;
+};
+
+template<typename IndexSequence, typename... Attribs>
+struct VertexFormatImpl;
+
+template<size_t... I, typename... Attribs>
+struct VertexFormatImpl<std::index_sequence<I...>, Attribs...>
+{
+  static constexpr uint32_t numElements = sizeof...(Attribs);
+  static constexpr uint32_t stride = VertexSizeSum<Attribs...>::value;
+  static constexpr VertexElementDesc elements[sizeof...(Attribs)] = {
+    { Attribs::semantic, Attribs::semanticIndex, Attribs::format, VertexOffsetOf<I, Attribs...>::value }...
+  };
+};
+
+template<size_t... I, typename... Attribs>
+constexpr VertexElementDesc VertexFormatImpl<std::index_sequence<I...>, Attribs...>::elements[sizeof...(Attribs)];
+
+template<typename... Attribs>
+struct VertexFormat : VertexFormatImpl<std::make_index_sequence<sizeof...(Attribs)>, Attribs...>
+{
+  static_assert(sizeof...(Attribs) > 0, "A vertex format needs at least one attribute");
+};
+
+// Index of the element with the given semantic, or -1
+template<typename Format>
+constexpr int VertexFormat_Find(VertexSemantic semantic, uint32_t semanticIndex)
+{
+  for(uint32_t i = 0; i < Format::numElements; ++i)
+  {
+    if(Format::elements[i].semantic == semantic && Format::elements[i].semanticIndex == semanticIndex)
+      return (int)i;
+  }
+  return -1;
+}
+
+// True if every attribute of Dst has a Float32 attribute with the same semantic
+// in Src. Used to reject impossible conversions at compile time.
+template<typename Src, typename Dst>
+constexpr bool VertexFormat_CanConvert()
+{
+  for(uint32_t i = 0; i < Dst::numElements; ++i)
+  {
+    int src = VertexFormat_Find<Src>(Dst::elements[i].semantic, Dst::elements[i].semanticIndex);
+    if(src < 0 || !VertexAttribFormat_IsFloat32(Src::elements[src].format))
+      return false;
+  }
+  return true;
+}
+
+// Ties a C++ vertex struct to its format: same stride, and each member at the
+// element's offset with the element's size.
+#define VERTEX_FORMAT_CHECK_STRIDE(Struct, Format) \
+  static_assert(sizeof(Struct) == Format::stride, #Struct " doesn't match the stride of " #Format)
+#define VERTEX_FORMAT_CHECK_MEMBER(Struct, Format, element, member) \
+  static_assert(offsetof(Struct, member) == Format::elements[element].offset \
+                && sizeof(((Struct*)0)->member) == VertexAttribFormat_Size(Format::elements[element].format), \
+                #Struct "::" #member " doesn't match element " #element " of " #Format)
+
+////////////////////////////////////////////////////////////////
+// Formats used by the renderers
+
+// Full float layout, what the software rasterizer consumes
+struct BasicVertex
+{
+  float position[2];
+  float color[4];
+};
+
+typedef VertexFormat<VertexAttrib<VertexSemantic_Position, VertexAttribFormat_Float32x2>,
+                     VertexAttrib<VertexSemantic_Color, VertexAttribFormat_Float32x4>> BasicVertexFormat;
+
+VERTEX_FORMAT_CHECK_STRIDE(BasicVertex, BasicVertexFormat);
+VERTEX_FORMAT_CHECK_MEMBER(BasicVertex, BasicVertexFormat, 0, position);
+VERTEX_FORMAT_CHECK_MEMBER(BasicVertex, BasicVertexFormat, 1, color);
+
+// 8 bytes instead of 24; the input assembler expands it back to float4 so the
+// basic shaders work unchanged
+struct PackedVertex
+{
+  uint16_t position[2]; // half
+  uint8_t color[4];     // UNORM
+};
+
+typedef VertexFormat<VertexAttrib<VertexSemantic_Position, VertexAttribFormat_Float16x2>,
+                     VertexAttrib<VertexSemantic_Color, VertexAttribFormat_Unorm8x4>> PackedVertexFormat;
+
+VERTEX_FORMAT_CHECK_STRIDE(PackedVertex, PackedVertexFormat);
+VERTEX_FORMAT_CHECK_MEMBER(PackedVertex, PackedVertexFormat, 0, position);
+VERTEX_FORMAT_CHECK_MEMBER(PackedVertex, PackedVertexFormat, 1, color);
+static_assert(VertexFormat_CanConvert<BasicVertexFormat, PackedVertexFormat>(), "PackedVertex can't be built from BasicVertex");
@@ -0,0 +1,364 @@
+#include "vertex_pack.h"
+
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+#define HALF_OVERFLOW_BITS ((127u + 16u) << 23) // 65536.0f, rounds to inf
+#define HALF_MIN_NORMAL_BITS (113u << 23)       // 2^-14
+#define HALF_DENORM_MAGIC_BITS (126u << 23)     // 0.5f, lines the mantissa up with 2^-24
+#define HALF_REBIAS (((uint32_t)(15 - 127) << 23) + 0xFFFu)
+#define VERTEX_PACK_BLOCK 256
+
+static VertexPackPath global_vertexPackPath = VertexPackPath_AVX2;
+static bool global_vertexPackPathChecked = false;
+
+VertexPackPath VertexPack_SetPath(VertexPackPath path)
+{
+    VertexPackPath best = !ARCH_X64 ? VertexPackPath_Scalar : CpuSupportsAVX2() ? VertexPackPath_AVX2 : VertexPackPath_SSE2;
+    global_vertexPackPath = path < best ? path : best;
+    global_vertexPackPathChecked = true;
+    return global_vertexPackPath;
+}
+
+static VertexPackPath GetVertexPackPath()
+{
+    if(!global_vertexPackPathChecked)
+        VertexPack_SetPath(VertexPackPath_AVX2);
+    return global_vertexPackPath;
+}
+
+////////////////////////////////////////////////////////////////
+// Scalar
+
+static uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint32_t result;
+    if(bits >= HALF_OVERFLOW_BITS)
+        result = bits > 0x7F800000u ? 0x7E00 : 0x7C00;
+    else if(bits < HALF_MIN_NORMAL_BITS)
+    {
+        // The float add does the round to nearest even for us
+        float magic;
+        uint32_t magicBits = HALF_DENORM_MAGIC_BITS;
+        memcpy(&magic, &magicBits, sizeof(magic));
+        float shifted;
+        memcpy(&shifted, &bits, sizeof(shifted));
+        shifted += magic;
+        memcpy(&result, &shifted, sizeof(result));
+        result -= HALF_DENORM_MAGIC_BITS;
+    }
+    else
+    {
+        uint32_t mantissaOdd = (bits >> 13) & 1;
+        result = (bits + HALF_REBIAS + mantissaOdd) >> 13;
+    }
+    return (uint16_t)(result | (sign >> 16));
+}
+
+// Same operation order as _mm_max_ps / _mm_min_ps so NaN ends up as the lower bound
+static float ClampForPack(float value, float low, float high)
+{
+    value = value > low ? value : low;
+    return value < high ? value : high;
+}
+
+static uint8_t FloatToUnorm8(float value)
+{
+    return (uint8_t)lrintf(ClampForPack(value, 0.0f, 1.0f) * 255.0f);
+}
+
+static int8_t FloatToSnorm8(float value)
+{
+    return (int8_t)lrintf(ClampForPack(value, -1.0f, 1.0f) * 127.0f);
+}
+
+float VertexPack_HalfToFloat(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+    float result;
+    if(exponent == 0)
+        result = ldexpf((float)mantissa, -24);
+    else if(exponent == 31)
+        result = mantissa ? NAN : INFINITY;
+    else {
+        uint32_t bits = ((exponent + 112) << 23) | (mantissa << 13);
+        memcpy(&result, &bits, sizeof(result));
+    }
+    uint32_t bits;
+    memcpy(&bits, &result, sizeof(bits));
+    bits |= sign;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+////////////////////////////////////////////////////////////////
+// SSE2 / AVX2
+
+#if ARCH_X64
+static inline __m128i SelectSSE2(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// 4 floats to 4 halves in the low 16 bits of each lane, same steps as FloatToHalf
+static inline __m128i FloatToHalf4_SSE2(__m128 value)
+{
+    __m128i bits = _mm_castps_si128(value);
+    __m128i sign = _mm_and_si128(bits, _mm_set1_epi32((int)0x80000000u));
+    bits = _mm_xor_si128(bits, sign);
+
+    __m128i isInfNan = _mm_cmpgt_epi32(bits, _mm_set1_epi32((int)HALF_OVERFLOW_BITS - 1));
+    __m128i isNan = _mm_cmpgt_epi32(bits, _mm_set1_epi32(0x7F800000));
+    __m128i infNan = _mm_or_si128(_mm_set1_epi32(0x7C00), _mm_and_si128(isNan, _mm_set1_epi32(0x200)));
+
+    __m128i isDenorm = _mm_cmpgt_epi32(_mm_set1_epi32((int)HALF_MIN_NORMAL_BITS), bits);
+    __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((int)HALF_DENORM_MAGIC_BITS));
+    __m128i denorm = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(bits), magic)), _mm_castps_si128(magic));
+
+    __m128i mantissaOdd = _mm_and_si128(_mm_srli_epi32(bits, 13), _mm_set1_epi32(1));
+    __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(bits, _mm_set1_epi32((int)HALF_REBIAS)), mantissaOdd), 13);
+
+    __m128i result = SelectSSE2(isInfNan, infNan, SelectSSE2(isDenorm, denorm, normal));
+    result = _mm_or_si128(result, _mm_srli_epi32(sign, 16));
+    // Sign extend so the signed saturating pack keeps the bit pattern
+    return _mm_srai_epi32(_mm_slli_epi32(result, 16), 16);
+}
+
+static size_t FloatToHalf_SSE2(const float* in, uint16_t* out, size_t count)
+{
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i lo = FloatToHalf4_SSE2(_mm_loadu_ps(in + i));
+        __m128i hi = FloatToHalf4_SSE2(_mm_loadu_ps(in + i + 4));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(lo, hi));
+    }
+    return i;
+}
+
+static size_t FloatToUnorm8_SSE2(const float* in, uint8_t* out, size_t count)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m128i v[4];
+        for(int j = 0; j < 4; ++j)
+            v[j] = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + j * 4), zero), one), scale));
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+        _mm_storeu_si128((__m128i*)(out + i), packed);
+    }
+    return i;
+}
+
+static size_t FloatToSnorm8_SSE2(const float* in, int8_t* out, size_t count)
+{
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(127.0f);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m128i v[4];
+        for(int j = 0; j < 4; ++j)
+            v[j] = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + j * 4), minusOne), one), scale));
+        __m128i packed = _mm_packs_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+        _mm_storeu_si128((__m128i*)(out + i), packed);
+    }
+    return i;
+}
+
+TARGET_AVX2
+static inline __m256i SelectAVX2(__m256i mask, __m256i a, __m256i b)
+{
+    return _mm256_blendv_epi8(b, a, mask);
+}
+
+TARGET_AVX2
+static inline __m256i FloatToHalf8_AVX2(__m256 value)
+{
+    __m256i bits = _mm256_castps_si256(value);
+    __m256i sign = _mm256_and_si256(bits, _mm256_set1_epi32((int)0x80000000u));
+    bits = _mm256_xor_si256(bits, sign);
+
+    __m256i isInfNan = _mm256_cmpgt_epi32(bits, _mm256_set1_epi32((int)HALF_OVERFLOW_BITS - 1));
+    __m256i isNan = _mm256_cmpgt_epi32(bits, _mm256_set1_epi32(0x7F800000));
+    __m256i infNan = _mm256_or_si256(_mm256_set1_epi32(0x7C00), _mm256_and_si256(isNan, _mm256_set1_epi32(0x200)));
+
+    __m256i isDenorm = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)HALF_MIN_NORMAL_BITS), bits);
+    __m256 magic = _mm256_castsi256_ps(_mm256_set1_epi32((int)HALF_DENORM_MAGIC_BITS));
+    __m256i denorm = _mm256_sub_epi32(_mm256_castps_si256(_mm256_add_ps(_mm256_castsi256_ps(bits), magic)), _mm256_castps_si256(magic));
+
+    __m256i mantissaOdd = _mm256_and_si256(_mm256_srli_epi32(bits, 13), _mm256_set1_epi32(1));
+    __m256i normal = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(bits, _mm256_set1_epi32((int)HALF_REBIAS)), mantissaOdd), 13);
+
+    __m256i result = SelectAVX2(isInfNan, infNan, SelectAVX2(isDenorm, denorm, normal));
+    result = _mm256_or_si256(result, _mm256_srli_epi32(sign, 16));
+    return _mm256_srai_epi32(_mm256_slli_epi32(result, 16), 16);
+}
+
+TARGET_AVX2
+static size_t FloatToHalf_AVX2(const float* in, uint16_t* out, size_t count)
+{
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m256i lo = FloatToHalf8_AVX2(_mm256_loadu_ps(in + i));
+        __m256i hi = FloatToHalf8_AVX2(_mm256_loadu_ps(in + i + 8));
+        // packs works per 128 bit lane, put the 64 bit groups back in order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256((__m256i*)(out + i), packed);
+    }
+    return i;
+}
+
+TARGET_AVX2
+static size_t FloatToUnorm8_AVX2(const float* in, uint8_t* out, size_t count)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 scale = _mm256_set1_ps(255.0f);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for(; i + 32 <= count; i += 32)
+    {
+        __m256i v[4];
+        for(int j = 0; j < 4; ++j)
+            v[j] = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i + j * 8), zero), one), scale));
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(v[0], v[1]), _mm256_packs_epi32(v[2], v[3]));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    return i;
+}
+
+TARGET_AVX2
+static size_t FloatToSnorm8_AVX2(const float* in, int8_t* out, size_t count)
+{
+    const __m256 minusOne = _mm256_set1_ps(-1.0f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 scale = _mm256_set1_ps(127.0f);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for(; i + 32 <= count; i += 32)
+    {
+        __m256i v[4];
+        for(int j = 0; j < 4; ++j)
+            v[j] = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i + j * 8), minusOne), one), scale));
+        __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(v[0], v[1]), _mm256_packs_epi32(v[2], v[3]));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    return i;
+}
+#endif
+
+void VertexPack_FloatToHalf(const float* in, uint16_t* out, size_t count)
+{
+    size_t i = 0;
+#if ARCH_X64
+    VertexPackPath path = GetVertexPackPath();
+    if(path == VertexPackPath_AVX2)
+        i = FloatToHalf_AVX2(in, out, count);
+    if(path >= VertexPackPath_SSE2)
+        i += FloatToHalf_SSE2(in + i, out + i, count - i);
+#endif
+    for(; i < count; ++i)
+        out[i] = FloatToHalf(in[i]);
+}
+
+void VertexPack_FloatToUnorm8(const float* in, uint8_t* out, size_t count)
+{
+    size_t i = 0;
+#if ARCH_X64
+    VertexPackPath path = GetVertexPackPath();
+    if(path == VertexPackPath_AVX2)
+        i = FloatToUnorm8_AVX2(in, out, count);
+    if(path >= VertexPackPath_SSE2)
+        i += FloatToUnorm8_SSE2(in + i, out + i, count - i);
+#endif
+    for(; i < count; ++i)
+        out[i] = FloatToUnorm8(in[i]);
+}
+
+void VertexPack_FloatToSnorm8(const float* in, int8_t* out, size_t count)
+{
+    size_t i = 0;
+#if ARCH_X64
+    VertexPackPath path = GetVertexPackPath();
+    if(path == VertexPackPath_AVX2)
+        i = FloatToSnorm8_AVX2(in, out, count);
+    if(path >= VertexPackPath_SSE2)
+        i += FloatToSnorm8_SSE2(in + i, out + i, count - i);
+#endif
+    for(; i < count; ++i)
+        out[i] = FloatToSnorm8(in[i]);
+}
+
+////////////////////////////////////////////////////////////////
+// Layout conversion
+
+void VertexPack_Convert(const VertexElementDesc* srcElements, uint32_t numSrcElements, uint32_t srcStride, const void* src,
+                        const VertexElementDesc* dstElements, uint32_t numDstElements, uint32_t dstStride, void* dst, size_t count)
+{
+    // Interleaved in, interleaved out: gather a block of one attribute into a
+    // contiguous float array, run the kernel over it, scatter the result
+    float gathered[VERTEX_PACK_BLOCK * 4];
+    uint8_t packed[VERTEX_PACK_BLOCK * 16];
+    for(uint32_t e = 0; e < numDstElements; ++e)
+    {
+        const VertexElementDesc* dstElement = &dstElements[e];
+        const VertexElementDesc* srcElement = 0;
+        for(uint32_t s = 0; s < numSrcElements && !srcElement; ++s)
+        {
+            if(srcElements[s].semantic == dstElement->semantic && srcElements[s].semanticIndex == dstElement->semanticIndex)
+                srcElement = &srcElements[s];
+        }
+        assert(srcElement && VertexAttribFormat_IsFloat32(srcElement->format));
+        uint32_t numComponents = VertexAttribFormat_Components(dstElement->format);
+        uint32_t numSrcComponents = VertexAttribFormat_Components(srcElement->format);
+        if(numSrcComponents > numComponents)
+            numSrcComponents = numComponents;
+        uint32_t dstSize = VertexAttribFormat_Size(dstElement->format);
+
+        for(size_t first = 0; first < count; first += VERTEX_PACK_BLOCK)
+        {
+            size_t blockCount = count - first < VERTEX_PACK_BLOCK ? count - first : VERTEX_PACK_BLOCK;
+            const uint8_t* srcBytes = (const uint8_t*)src + first * srcStride + srcElement->offset;
+            if(numSrcComponents < numComponents)
+                memset(gathered, 0, blockCount * numComponents * sizeof(float));
+            for(size_t v = 0; v < blockCount; ++v)
+                memcpy(&gathered[v * numComponents], srcBytes + v * srcStride, numSrcComponents * sizeof(float));
+
+            size_t numValues = blockCount * numComponents;
+            switch(dstElement->format)
+            {
+                case VertexAttribFormat_Float16x2:
+                case VertexAttribFormat_Float16x4:
+                    VertexPack_FloatToHalf(gathered, (uint16_t*)packed, numValues);
+                    break;
+                case VertexAttribFormat_Unorm8x4:
+                    VertexPack_FloatToUnorm8(gathered, packed, numValues);
+                    break;
+                case VertexAttribFormat_Snorm8x4:
+                    VertexPack_FloatToSnorm8(gathered, (int8_t*)packed, numValues);
+                    break;
+                default:
+                    memcpy(packed, gathered, numValues * sizeof(float));
+                    break;
+            }
+
+            uint8_t* dstBytes = (uint8_t*)dst + first * dstStride + dstElement->offset;
+            for(size_t v = 0; v < blockCount; ++v)
+                memcpy(dstBytes + v * dstStride, packed + v * dstSize, dstSize);
+        }
+    }
+}
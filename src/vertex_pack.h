@@ -0,0 +1,38 @@
+#pragma once
+
+// Quantization kernels for building packed vertex buffers: float to half
+// (round to nearest even, with denormals, inf and NaN), and float to UNORM8 /
+// SNORM8 with D3D's conversion rules. Scalar, SSE2 and AVX2 versions produce
+// identical bytes; the widest one the CPU supports is used unless restricted.
+
+#include "base.h"
+#include "vertex_format.h"
+
+enum VertexPackPath
+{
+  VertexPackPath_Scalar,
+  VertexPackPath_SSE2,
+  VertexPackPath_AVX2,
+};
+
+// Caps the kernels at path (clamped to what the CPU supports) and returns the path now in use.
+VertexPackPath VertexPack_SetPath(VertexPackPath path);
+
+void VertexPack_FloatToHalf(const float* in, uint16_t* out, size_t count);
+void VertexPack_FloatToUnorm8(const float* in, uint8_t* out, size_t count);
+void VertexPack_FloatToSnorm8(const float* in, int8_t* out, size_t count);
+float VertexPack_HalfToFloat(uint16_t half);
+
+// Converts count vertices between two layouts, matching elements by semantic.
+// Every destination element needs a Float32 source element; components the
+// source doesn't have are written as 0 (e.g. float3 normals into SNORM8x4).
+void VertexPack_Convert(const VertexElementDesc* srcElements, uint32_t numSrcElements, uint32_t srcStride, const void* src,
+                        const VertexElementDesc* dstElements, uint32_t numDstElements, uint32_t dstStride, void* dst, size_t count);
+
+template<typename SrcFormat, typename DstFormat>
+void VertexPack_Convert(const void* src, void* dst, size_t count)
+{
+  static_assert(VertexFormat_CanConvert<SrcFormat, DstFormat>(), "Destination format has attributes the source can't provide");
+  VertexPack_Convert(SrcFormat::elements, SrcFormat::numElements, SrcFormat::stride, src,
+                     DstFormat::elements, DstFormat::numElements, DstFormat::stride, dst, count);
+}
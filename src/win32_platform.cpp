@@ -6,10 +6,109 @@
 #pragma comment(lib, "d3d11.lib")
 #include <d3dcompiler.h>
 #pragma comment(lib, "d3dcompiler.lib")
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
 
 #include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "mapped_file.cpp"
+#include "shader_cache.cpp"
+#include "profiler.cpp"
+#include "memory.cpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "vendor/stb_image.h"
+
+#include "quad_batch.cpp"
+#include "job_system.cpp"
+#include "command_buffer.cpp"
+#include "vertex_pack.cpp"
+#include "texture_process.cpp"
+#include "texture_streamer.cpp"
+#include "input_queue.cpp"
+#include "simulation.cpp"
+#include "frame_capture.cpp"
 
 static bool global_windowDidResize = false;
+static bool global_dumpProfile = false;
+static bool global_useDeferredContexts = false;
+// Filled by WndProc, drained by the simulation thread
+static InputQueue global_inputQueue;
+
+// ShaderCompileFunc for ShaderCache_Get; may run on several threads at once
+static bool CompileShaderD3D(const ShaderDesc* desc, std::vector<uint8_t>* bytecode, std::string* errors, void* /*userData*/)
+{
+    wchar_t widePath[MAX_PATH];
+    if(!MultiByteToWideChar(CP_UTF8, 0, desc->path, -1, widePath, MAX_PATH)) {
+        *errors = "Could not compile shader; path too long";
+        return false;
+    }
+
+    std::vector<D3D_SHADER_MACRO> macros(desc->numDefines + 1);
+    for(uint32_t i = 0; i < desc->numDefines; ++i)
+    {
+        macros[i].Name = desc->defines[i].name;
+        macros[i].Definition = desc->defines[i].value;
+    }
+    macros[desc->numDefines] = {};
+
+    ID3DBlob* shaderBlob = nullptr;
+    ID3DBlob* shaderCompileErrorsBlob = nullptr;
+    HRESULT hResult = D3DCompileFromFile(widePath, macros.data(), D3D_COMPILE_STANDARD_FILE_INCLUDE, desc->entryPoint, desc->profile, desc->flags, 0, &shaderBlob, &shaderCompileErrorsBlob);
+    if(FAILED(hResult))
+    {
+        if(hResult == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND))
+            *errors = "Could not compile shader; file not found";
+        else if(shaderCompileErrorsBlob)
+            *errors = (const char*)shaderCompileErrorsBlob->GetBufferPointer();
+        else
+            *errors = "Could not compile shader";
+        if(shaderCompileErrorsBlob)
+            shaderCompileErrorsBlob->Release();
+        return false;
+    }
+    if(shaderCompileErrorsBlob)
+        shaderCompileErrorsBlob->Release();
+
+    const uint8_t* data = (const uint8_t*)shaderBlob->GetBufferPointer();
+    bytecode->assign(data, data + shaderBlob->GetBufferSize());
+    shaderBlob->Release();
+    return true;
+}
+
+// Input layout table straight from a compile-time vertex format. Buffer slot 0,
+// instanceStepRate 0 means per-vertex data.
+template<typename Format>
+static void BuildInputElementDescs(D3D11_INPUT_ELEMENT_DESC (&descs)[Format::numElements], UINT instanceStepRate)
+{
+    for(uint32_t i = 0; i < Format::numElements; ++i)
+    {
+        const VertexElementDesc& element = Format::elements[i];
+        descs[i].SemanticName = VertexSemantic_Name(element.semantic);
+        descs[i].SemanticIndex = element.semanticIndex;
+        descs[i].Format = (DXGI_FORMAT)VertexAttribFormat_Dxgi(element.format);
+        descs[i].InputSlot = 0;
+        descs[i].AlignedByteOffset = element.offset;
+        descs[i].InputSlotClass = instanceStepRate ? D3D11_INPUT_PER_INSTANCE_DATA : D3D11_INPUT_PER_VERTEX_DATA;
+        descs[i].InstanceDataStepRate = instanceStepRate;
+    }
+}
+
+static bool Win32MapKey(WPARAM wparam, InputKey* key)
+{
+    switch(wparam)
+    {
+        case VK_LEFT:  case 'A': *key = InputKey_Left; return true;
+        case VK_RIGHT: case 'D': *key = InputKey_Right; return true;
+        case VK_UP:    case 'W': *key = InputKey_Up; return true;
+        case VK_DOWN:  case 'S': *key = InputKey_Down; return true;
+    }
+    return false;
+}
 
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 {
@@ -17,9 +116,25 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
     switch(msg)
     {
         case WM_KEYDOWN:
+        case WM_KEYUP:
         {
+            // Bit 30 is set on auto-repeat, the simulation only wants transitions
+            InputKey key;
+            bool isRepeat = msg == WM_KEYDOWN && (lparam & (1 << 30));
+            if(Win32MapKey(wparam, &key) && !isRepeat)
+            {
+                InputEvent event = { GetSeconds(), msg == WM_KEYDOWN ? InputEventType_KeyDown : InputEventType_KeyUp, key };
+                InputQueue_Push(&global_inputQueue, &event);
+            }
+            if(msg == WM_KEYUP)
+                break;
+
             if(wparam == VK_ESCAPE)
                 DestroyWindow(hwnd);
+            else if(wparam == VK_F9)
+                global_dumpProfile = true;
+            else if(wparam == VK_F8)
+                global_useDeferredContexts = !global_useDeferredContexts;
             break;
         }
         case WM_DESTROY:
@@ -38,8 +153,287 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
     return result;
 }
 
+struct Win32QuadTarget
+{
+    ID3D11DeviceContext1* deviceContext;
+    ID3D11Buffer* instanceBuffer;
+};
+
+static void* Win32QuadMap(QuadMapMode mode, void* userData)
+{
+    Win32QuadTarget* target = (Win32QuadTarget*)userData;
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    D3D11_MAP mapType = mode == QuadMapMode_Discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+    HRESULT hResult = target->deviceContext->Map(target->instanceBuffer, 0, mapType, 0, &mapped);
+    assert(SUCCEEDED(hResult));
+    return mapped.pData;
+}
+
+static void Win32QuadUnmap(void* userData)
+{
+    Win32QuadTarget* target = (Win32QuadTarget*)userData;
+    target->deviceContext->Unmap(target->instanceBuffer, 0);
+}
+
+static void Win32QuadDraw(uint64_t /*sortKey*/, uint32_t firstInstance, uint32_t instanceCount, void* userData)
+{
+    // Only one quad shader and texture so far, so there is no state to switch per key
+    Win32QuadTarget* target = (Win32QuadTarget*)userData;
+    target->deviceContext->DrawInstanced(4, instanceCount, 0, firstInstance);
+}
+
+// Streamed textures. D3D11 can't release single mips of a texture, so a
+// residency change recreates the texture at the new size and copies the mips
+// both versions hold on the GPU. Mips that are allocated but not uploaded yet
+// are hidden with SetResourceMinLOD.
+struct Win32StreamTexture
+{
+    ID3D11Texture2D* texture;
+    ID3D11ShaderResourceView* view;
+    uint32_t firstMip;
+};
+
+struct Win32StreamTarget
+{
+    ID3D11Device1* device;
+    ID3D11DeviceContext1* deviceContext;
+    std::vector<Win32StreamTexture> textures;
+};
+
+static void Win32StreamResize(uint32_t texture, const TextureStreamInfo* info, uint32_t firstMip, uint32_t previousFirstMip, void* userData)
+{
+    Win32StreamTarget* target = (Win32StreamTarget*)userData;
+    if(texture >= target->textures.size())
+        target->textures.resize(texture + 1, {});
+    Win32StreamTexture* streamed = &target->textures[texture];
+
+    D3D11_TEXTURE2D_DESC textureDesc = {};
+    textureDesc.Width = info->width >> firstMip ? info->width >> firstMip : 1;
+    textureDesc.Height = info->height >> firstMip ? info->height >> firstMip : 1;
+    textureDesc.MipLevels = info->numMips - firstMip;
+    textureDesc.ArraySize = 1;
+    textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+    textureDesc.SampleDesc.Count = 1;
+    textureDesc.Usage = D3D11_USAGE_DEFAULT;
+    textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    ID3D11Texture2D* newTexture;
+    HRESULT hResult = target->device->CreateTexture2D(&textureDesc, nullptr, &newTexture);
+    assert(SUCCEEDED(hResult));
+    ID3D11ShaderResourceView* newView;
+    hResult = target->device->CreateShaderResourceView(newTexture, nullptr, &newView);
+    assert(SUCCEEDED(hResult));
+
+    uint32_t firstKept = firstMip > previousFirstMip ? firstMip : previousFirstMip;
+    for(uint32_t mip = firstKept; mip < info->numMips; ++mip)
+        target->deviceContext->CopySubresourceRegion(newTexture, mip - firstMip, 0, 0, 0, streamed->texture, mip - previousFirstMip, nullptr);
+    if(firstKept > firstMip && firstKept < info->numMips)
+        target->deviceContext->SetResourceMinLOD(newTexture, (float)(firstKept - firstMip));
+
+    if(streamed->texture) {
+        streamed->view->Release();
+        streamed->texture->Release();
+    }
+    streamed->texture = newTexture;
+    streamed->view = newView;
+    streamed->firstMip = firstMip;
+}
+
+static void Win32StreamUpload(uint32_t texture, uint32_t mip, uint32_t width, uint32_t /*height*/, const uint8_t* pixels, void* userData)
+{
+    Win32StreamTarget* target = (Win32StreamTarget*)userData;
+    Win32StreamTexture* streamed = &target->textures[texture];
+    UINT subresource = mip - streamed->firstMip;
+    target->deviceContext->UpdateSubresource(streamed->texture, subresource, nullptr, pixels, width * 4, 0);
+    // Mips arrive coarse to fine, so this one is now the finest valid mip
+    target->deviceContext->SetResourceMinLOD(streamed->texture, (float)subresource);
+}
+
+// Resolves command buffer handles to D3D11 objects. Handles index straight into these tables.
+struct D3D11CommandTarget
+{
+    ID3D11DeviceContext* context;
+    ID3D11RenderTargetView* renderTarget;
+    ID3D11VertexShader* vertexShaders[1];
+    ID3D11PixelShader* pixelShaders[1];
+    ID3D11InputLayout* inputLayouts[1];
+    ID3D11Buffer* vertexBuffers[1];
+};
+
+static void D3D11CommandClear(const float* color, void* userData)
+{
+    D3D11CommandTarget* target = (D3D11CommandTarget*)userData;
+    target->context->ClearRenderTargetView(target->renderTarget, color);
+}
+
+static void D3D11CommandSetViewport(float x, float y, float width, float height, void* userData)
+{
+    D3D11CommandTarget* target = (D3D11CommandTarget*)userData;
+    D3D11_VIEWPORT viewport = { x, y, width, height, 0.0f, 1.0f };
+    target->context->RSSetViewports(1, &viewport);
+}
+
+static void D3D11CommandSetShader(uint32_t shader, void* userData)
+{
+    D3D11CommandTarget* target = (D3D11CommandTarget*)userData;
+    target->context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    target->context->IASetInputLayout(target->inputLayouts[shader]);
+    target->context->VSSetShader(target->vertexShaders[shader], nullptr, 0);
+    target->context->PSSetShader(target->pixelShaders[shader], nullptr, 0);
+}
+
+static void D3D11CommandSetVertexBuffer(uint32_t buffer, uint32_t stride, uint32_t offset, void* userData)
+{
+    D3D11CommandTarget* target = (D3D11CommandTarget*)userData;
+    target->context->IASetVertexBuffers(0, 1, &target->vertexBuffers[buffer], &stride, &offset);
+}
+
+static void D3D11CommandDraw(uint32_t vertexCount, uint32_t startVertex, void* userData)
+{
+    D3D11CommandTarget* target = (D3D11CommandTarget*)userData;
+    target->context->Draw(vertexCount, startVertex);
+}
+
+static void D3D11CommandReplay(const CommandBuffer* buffer, D3D11CommandTarget* target)
+{
+    CommandBackend backend = { D3D11CommandClear, D3D11CommandSetViewport, D3D11CommandSetShader, D3D11CommandSetVertexBuffer, D3D11CommandDraw, target };
+    target->context->OMSetRenderTargets(1, &target->renderTarget, nullptr);
+    CommandBuffer_Replay(buffer, &backend);
+}
+
+// Offscreen render target for -capture runs. Each frame is copied into a ring
+// of staging textures and only mapped when its slot comes around again, so the
+// CPU reads frames the GPU finished long ago instead of stalling on the
+// current one.
+#define WIN32_CAPTURE_LATENCY 2
+
+struct Win32Capture
+{
+    ID3D11Texture2D* texture;
+    ID3D11RenderTargetView* view;
+    ID3D11Texture2D* staging[WIN32_CAPTURE_LATENCY];
+    int stagedFrames[WIN32_CAPTURE_LATENCY]; // frame number in each staging texture, -1 if none
+    int width;
+    int height;
+    const char* directory;
+    const char* extension;
+    FrameImage image;
+    bool failed;
+};
+
+static void Win32WriteCapture(ID3D11DeviceContext1* context, Win32Capture* capture, int slot)
+{
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT hResult = context->Map(capture->staging[slot], 0, D3D11_MAP_READ, 0, &mapped);
+    if(FAILED(hResult)) {
+        capture->failed = true;
+        return;
+    }
+    FrameCapture_CopyRows(&capture->image, mapped.pData, capture->width, capture->height, mapped.RowPitch);
+    context->Unmap(capture->staging[slot], 0);
+
+    char path[MAX_PATH];
+    sprintf_s(path, "%s/frame_%04d.%s", capture->directory, capture->stagedFrames[slot], capture->extension);
+    if(!FrameCapture_Write(&capture->image, path)) {
+        OutputDebugStringA("Could not write ");
+        OutputDebugStringA(path);
+        OutputDebugStringA("\n");
+        capture->failed = true;
+    }
+    capture->stagedFrames[slot] = -1;
+}
+
+static void Win32CaptureFrame(ID3D11DeviceContext1* context, Win32Capture* capture, int frame)
+{
+    int slot = frame % WIN32_CAPTURE_LATENCY;
+    if(capture->stagedFrames[slot] >= 0)
+        Win32WriteCapture(context, capture, slot);
+    context->CopyResource(capture->staging[slot], capture->texture);
+    capture->stagedFrames[slot] = frame;
+}
+
+// Writes the frames still in flight, oldest first
+static void Win32FlushCaptures(ID3D11DeviceContext1* context, Win32Capture* capture, int numFrames)
+{
+    for(int frame = numFrames - WIN32_CAPTURE_LATENCY; frame < numFrames; ++frame)
+    {
+        int slot = frame % WIN32_CAPTURE_LATENCY;
+        if(frame >= 0 && capture->stagedFrames[slot] == frame)
+            Win32WriteCapture(context, capture, slot);
+    }
+}
+
+// The scene is recorded as independent passes, one job each, replayed in pass order
+enum ScenePass
+{
+    ScenePass_Setup,
+    ScenePass_Triangle,
+    ScenePass_Count,
+};
+
+struct SceneRecord
+{
+    CommandBuffer commands[ScenePass_Count];
+    float width;
+    float height;
+    UINT numVerts;
+    UINT stride;
+
+    // Deferred replay
+    D3D11CommandTarget target;
+    ID3D11DeviceContext* deferredContexts[ScenePass_Count];
+    ID3D11CommandList* commandLists[ScenePass_Count];
+};
+
+static void RecordScenePass(void* data, uint32_t pass)
+{
+    SceneRecord* scene = (SceneRecord*)data;
+    CommandBuffer* commands = &scene->commands[pass];
+    CommandBuffer_Reset(commands);
+    if(pass == ScenePass_Setup)
+    {
+        float backgroundColor[4] = { 0.1f, 0.2f, 0.6f, 1.0f };
+        CommandBuffer_Clear(commands, backgroundColor);
+        CommandBuffer_SetViewport(commands, 0.0f, 0.0f, scene->width, scene->height);
+    }
+    else if(pass == ScenePass_Triangle)
+    {
+        CommandBuffer_SetShader(commands, 0);
+        CommandBuffer_SetVertexBuffer(commands, 0, scene->stride, 0);
+        CommandBuffer_Draw(commands, scene->numVerts, 0);
+    }
+}
+
+static void ReplaySceneDeferred(void* data, uint32_t pass)
+{
+    SceneRecord* scene = (SceneRecord*)data;
+    D3D11CommandTarget target = scene->target;
+    target.context = scene->deferredContexts[pass];
+    // Deferred contexts start from default state, so every pass sets its own viewport
+    if(pass != ScenePass_Setup)
+        D3D11CommandSetViewport(0.0f, 0.0f, scene->width, scene->height, &target);
+    D3D11CommandReplay(&scene->commands[pass], &target);
+    HRESULT hResult = target.context->FinishCommandList(FALSE, &scene->commandLists[pass]);
+    assert(SUCCEEDED(hResult));
+}
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPSTR /*lpCmdLine*/, int /*nShowCmd*/)
 {
+    // -capture DIR renders offscreen with the window hidden, writes every frame
+    // to DIR/frame_NNNN.png (.raw with -capture-raw) and exits after
+    // -capture-frames frames. Animation runs on a fixed step, so two runs
+    // produce the same frames for golden-image comparison.
+    const char* captureDirectory = nullptr;
+    int numCaptureFrames = 60;
+    bool captureRaw = false;
+    for(int i = 1; i < __argc; ++i)
+    {
+        bool hasValue = i + 1 < __argc;
+        if(!strcmp(__argv[i], "-capture") && hasValue) captureDirectory = __argv[++i];
+        else if(!strcmp(__argv[i], "-capture-frames") && hasValue) numCaptureFrames = atoi(__argv[++i]);
+        else if(!strcmp(__argv[i], "-capture-raw")) captureRaw = true;
+    }
+
     // Open a window
     HWND hwnd;
     {
@@ -66,7 +460,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPSTR /*lpC
         hwnd = CreateWindowExW(WS_EX_OVERLAPPEDWINDOW,
                                 winClass.lpszClassName,
                                 L"02. Drawing a Triangle",
-                                WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+                                WS_OVERLAPPEDWINDOW | (captureDirectory ? 0 : WS_VISIBLE),
                                 CW_USEDEFAULT, CW_USEDEFAULT,
                                 initialWidth,
                                 initialHeight,
@@ -184,65 +578,76 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPSTR /*lpC
         d3d11FrameBuffer->Release();
     }
 
-    // Create Vertex Shader
-    ID3DBlob* vsBlob;
+    // Load Shaders
+    ShaderCache shaderCache;
     ID3D11VertexShader* vertexShader;
+    ID3D11PixelShader* pixelShader;
+    ID3D11VertexShader* quadVertexShader;
+    ID3D11PixelShader* quadPixelShader;
+    ShaderResult shaderResults[4];
     {
-        ID3DBlob* shaderCompileErrorsBlob;
-        HRESULT hResult = D3DCompileFromFile(L"res/shaders/basic_vs.hlsl", nullptr, nullptr, "VSMain", "vs_5_0", 0, 0, &vsBlob, &shaderCompileErrorsBlob);
-        if(FAILED(hResult))
+        ShaderCache_Open(&shaderCache, "shader_cache.bin", D3D_COMPILER_VERSION);
+
+        ShaderDesc shaderDescs[4] = {};
+        shaderDescs[0].path = "res/shaders/basic_vs.hlsl";
+        shaderDescs[0].entryPoint = "VSMain";
+        shaderDescs[0].profile = "vs_5_0";
+        shaderDescs[1].path = "res/shaders/basic_ps.hlsl";
+        shaderDescs[1].entryPoint = "PSMain";
+        shaderDescs[1].profile = "ps_5_0";
+        shaderDescs[2].path = "res/shaders/quad_vs.hlsl";
+        shaderDescs[2].entryPoint = "VSMain";
+        shaderDescs[2].profile = "vs_5_0";
+        shaderDescs[3].path = "res/shaders/quad_ps.hlsl";
+        shaderDescs[3].entryPoint = "PSMain";
+        shaderDescs[3].profile = "ps_5_0";
+        ShaderCache_Get(&shaderCache, shaderDescs, shaderResults, ArrayCount(shaderDescs), &CompileShaderD3D, 0, 0);
+
+        for(uint32_t i = 0; i < ArrayCount(shaderResults); ++i)
         {
-            const char* errorString = NULL;
-            if(hResult == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND))
-                errorString = "Could not compile shader; file not found";
-            else if(shaderCompileErrorsBlob){
-                errorString = (const char*)shaderCompileErrorsBlob->GetBufferPointer();
-                shaderCompileErrorsBlob->Release();
+            if(!shaderResults[i].ok) {
+                MessageBoxA(0, shaderResults[i].errors.c_str(), "Shader Compiler Error", MB_ICONERROR | MB_OK);
+                return 1;
             }
-            MessageBoxA(0, errorString, "Shader Compiler Error", MB_ICONERROR | MB_OK);
-            return 1;
         }
 
-        hResult = d3d11Device->CreateVertexShader(vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(), nullptr, &vertexShader);
+        HRESULT hResult = d3d11Device->CreateVertexShader(shaderResults[0].bytecode, shaderResults[0].size, nullptr, &vertexShader);
         assert(SUCCEEDED(hResult));
-    }
 
-    // Create Pixel Shader
-    ID3D11PixelShader* pixelShader;
-    {
-        ID3DBlob* psBlob;
-        ID3DBlob* shaderCompileErrorsBlob;
-        HRESULT hResult = D3DCompileFromFile(L"res/shaders/basic_ps.hlsl", nullptr, nullptr, "PSMain", "ps_5_0", 0, 0, &psBlob, &shaderCompileErrorsBlob);
-        if(FAILED(hResult))
-        {
-            const char* errorString = NULL;
-            if(hResult == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND))
-                errorString = "Could not compile shader; file not found";
-            else if(shaderCompileErrorsBlob){
-                errorString = (const char*)shaderCompileErrorsBlob->GetBufferPointer();
-                shaderCompileErrorsBlob->Release();
-            }
-            MessageBoxA(0, errorString, "Shader Compiler Error", MB_ICONERROR | MB_OK);
-            return 1;
-        }
+        hResult = d3d11Device->CreatePixelShader(shaderResults[1].bytecode, shaderResults[1].size, nullptr, &pixelShader);
+        assert(SUCCEEDED(hResult));
+
+        hResult = d3d11Device->CreateVertexShader(shaderResults[2].bytecode, shaderResults[2].size, nullptr, &quadVertexShader);
+        assert(SUCCEEDED(hResult));
 
-        hResult = d3d11Device->CreatePixelShader(psBlob->GetBufferPointer(), psBlob->GetBufferSize(), nullptr, &pixelShader);
+        hResult = d3d11Device->CreatePixelShader(shaderResults[3].bytecode, shaderResults[3].size, nullptr, &quadPixelShader);
         assert(SUCCEEDED(hResult));
-        psBlob->Release();
     }
 
-    // Create Input Layout
+    // Create Input Layouts
     ID3D11InputLayout* inputLayout;
+    ID3D11InputLayout* quadInputLayout;
     {
-        D3D11_INPUT_ELEMENT_DESC inputElementDesc[] =
-        {
-            { "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-            { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 }
-        };
+        // The IA expands the half/UNORM attributes, so basic_vs still sees float2/float4
+        D3D11_INPUT_ELEMENT_DESC inputElementDesc[PackedVertexFormat::numElements];
+        BuildInputElementDescs<PackedVertexFormat>(inputElementDesc, 0);
+
+        HRESULT hResult = d3d11Device->CreateInputLayout(inputElementDesc, ARRAYSIZE(inputElementDesc), shaderResults[0].bytecode, shaderResults[0].size, &inputLayout);
+        assert(SUCCEEDED(hResult));
+
+        // Matches QuadInstance; the corner comes from SV_VertexID
+        D3D11_INPUT_ELEMENT_DESC quadInputElementDesc[QuadInstanceFormat::numElements];
+        BuildInputElementDescs<QuadInstanceFormat>(quadInputElementDesc, 1);
 
-        HRESULT hResult = d3d11Device->CreateInputLayout(inputElementDesc, ARRAYSIZE(inputElementDesc), vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(), &inputLayout);
+        hResult = d3d11Device->CreateInputLayout(quadInputElementDesc, ARRAYSIZE(quadInputElementDesc), shaderResults[2].bytecode, shaderResults[2].size, &quadInputLayout);
         assert(SUCCEEDED(hResult));
-        vsBlob->Release();
+
+        // Bytecode pointers are invalidated by Save, so it has to come after the last use
+        char shaderCacheMessage[128];
+        sprintf_s(shaderCacheMessage, "Shader cache: %u hits, %u misses\n", shaderCache.numHits, shaderCache.numMisses);
+        OutputDebugStringA(shaderCacheMessage);
+        ShaderCache_Save(&shaderCache);
+        ShaderCache_Close(&shaderCache);
     }
 
     // Create Vertex Buffer
@@ -251,13 +656,15 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPSTR /*lpC
     UINT stride;
     UINT offset;
     {
-        float vertexData[] = { // x, y, r, g, b, a
-            0.0f,  0.5f, 0.f, 1.f, 0.f, 1.f,
-            0.5f, -0.5f, 1.f, 0.f, 0.f, 1.f,
-            -0.5f, -0.5f, 0.f, 0.f, 1.f, 1.f
+        BasicVertex sourceVertices[] = { // x, y, r, g, b, a
+            { { 0.0f,  0.5f}, {0.f, 1.f, 0.f, 1.f} },
+            { { 0.5f, -0.5f}, {1.f, 0.f, 0.f, 1.f} },
+            { {-0.5f, -0.5f}, {0.f, 0.f, 1.f, 1.f} }
         };
-        stride = 6 * sizeof(float);
-        numVerts = sizeof(vertexData) / stride;
+        PackedVertex vertexData[ArrayCount(sourceVertices)];
+        VertexPack_Convert<BasicVertexFormat, PackedVertexFormat>(sourceVertices, vertexData, ArrayCount(sourceVertices));
+        stride = PackedVertexFormat::stride;
+        numVerts = ArrayCount(vertexData);
         offset = 0;
 
         D3D11_BUFFER_DESC vertexBufferDesc = {};
@@ -271,21 +678,194 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPSTR /*lpC
         assert(SUCCEEDED(hResult));
     }
 
+    // Create Quad Instance Buffer
+    QuadBatch quadBatch;
+    Win32QuadTarget quadTarget;
+    QuadBackend quadBackend;
+    {
+        const UINT quadRingCapacity = 64 * 1024;
+
+        D3D11_BUFFER_DESC instanceBufferDesc = {};
+        instanceBufferDesc.ByteWidth = quadRingCapacity * sizeof(QuadInstance);
+        instanceBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+        instanceBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        instanceBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+        HRESULT hResult = d3d11Device->CreateBuffer(&instanceBufferDesc, nullptr, &quadTarget.instanceBuffer);
+        assert(SUCCEEDED(hResult));
+
+        quadTarget.deviceContext = d3d11DeviceContext;
+        quadBackend = { Win32QuadMap, Win32QuadUnmap, Win32QuadDraw, &quadTarget };
+        QuadBatch_Init(&quadBatch, quadRingCapacity);
+    }
+
+    // Create Texture Streamer
+    // Quads sample a 1x1 white texture until the first mips of the streamed one arrive
+    ID3D11ShaderResourceView* whiteTextureView;
+    ID3D11SamplerState* quadSamplerState;
+    Win32StreamTarget streamTarget;
+    TextureStreamer* textureStreamer;
+    uint32_t wallTexture;
+    {
+        D3D11_TEXTURE2D_DESC whiteTextureDesc = {};
+        whiteTextureDesc.Width = 1;
+        whiteTextureDesc.Height = 1;
+        whiteTextureDesc.MipLevels = 1;
+        whiteTextureDesc.ArraySize = 1;
+        whiteTextureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+        whiteTextureDesc.SampleDesc.Count = 1;
+        whiteTextureDesc.Usage = D3D11_USAGE_IMMUTABLE;
+        whiteTextureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+        uint32_t whitePixel = 0xFFFFFFFF;
+        D3D11_SUBRESOURCE_DATA whiteSubresourceData = { &whitePixel, sizeof(whitePixel), 0 };
+        ID3D11Texture2D* whiteTexture;
+        HRESULT hResult = d3d11Device->CreateTexture2D(&whiteTextureDesc, &whiteSubresourceData, &whiteTexture);
+        assert(SUCCEEDED(hResult));
+        hResult = d3d11Device->CreateShaderResourceView(whiteTexture, nullptr, &whiteTextureView);
+        assert(SUCCEEDED(hResult));
+        whiteTexture->Release();
+
+        D3D11_SAMPLER_DESC samplerDesc = {};
+        samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+        samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+        samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+        samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+        samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+        samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+        hResult = d3d11Device->CreateSamplerState(&samplerDesc, &quadSamplerState);
+        assert(SUCCEEDED(hResult));
+
+        streamTarget.device = d3d11Device;
+        streamTarget.deviceContext = d3d11DeviceContext;
+
+        TextureStreamerDesc streamerDesc = {};
+        streamerDesc.numThreads = 0;
+        streamerDesc.memoryBudget = 64 << 20;
+        streamerDesc.mipFilter = MipFilter_Kaiser;
+        streamerDesc.backend = { Win32StreamResize, Win32StreamUpload, &streamTarget };
+        textureStreamer = TextureStreamer_Create(&streamerDesc);
+        wallTexture = TextureStreamer_Request(textureStreamer, "res/textures/wall.jpg");
+    }
+
+    // Create Frame Arena
+    // Per-frame transient data, reset at the top of every frame
+    MemoryArena frameArena;
+    {
+        bool arenaCreated = MemoryArena_Init(&frameArena, 4 << 20, "Frame");
+        assert(arenaCreated);
+    }
+
+    // Create Job System and Command Recording
+    JobSystem* jobSystem = JobSystem_Create(0);
+    SceneRecord sceneRecord = {};
+    {
+        for(int i = 0; i < ScenePass_Count; ++i)
+        {
+            CommandBuffer_Reset(&sceneRecord.commands[i]);
+            HRESULT hResult = d3d11Device->CreateDeferredContext(0, &sceneRecord.deferredContexts[i]);
+            assert(SUCCEEDED(hResult));
+        }
+        sceneRecord.numVerts = numVerts;
+        sceneRecord.stride = stride;
+        sceneRecord.target.vertexShaders[0] = vertexShader;
+        sceneRecord.target.pixelShaders[0] = pixelShader;
+        sceneRecord.target.inputLayouts[0] = inputLayout;
+        sceneRecord.target.vertexBuffers[0] = vertexBuffer;
+    }
+
+    // Create Offscreen Capture Target
+    // Same format and size as the window's back buffer
+    Win32Capture capture = {};
+    if(captureDirectory)
+    {
+        capture.width = 1024;
+        capture.height = 768;
+        capture.directory = captureDirectory;
+        capture.extension = captureRaw ? "raw" : "png";
+
+        D3D11_TEXTURE2D_DESC captureDesc = {};
+        captureDesc.Width = capture.width;
+        captureDesc.Height = capture.height;
+        captureDesc.MipLevels = 1;
+        captureDesc.ArraySize = 1;
+        captureDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+        captureDesc.SampleDesc.Count = 1;
+        captureDesc.Usage = D3D11_USAGE_DEFAULT;
+        captureDesc.BindFlags = D3D11_BIND_RENDER_TARGET;
+        HRESULT hResult = d3d11Device->CreateTexture2D(&captureDesc, nullptr, &capture.texture);
+        assert(SUCCEEDED(hResult));
+        hResult = d3d11Device->CreateRenderTargetView(capture.texture, nullptr, &capture.view);
+        assert(SUCCEEDED(hResult));
+
+        captureDesc.Usage = D3D11_USAGE_STAGING;
+        captureDesc.BindFlags = 0;
+        captureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        for(int i = 0; i < WIN32_CAPTURE_LATENCY; ++i)
+        {
+            hResult = d3d11Device->CreateTexture2D(&captureDesc, nullptr, &capture.staging[i]);
+            assert(SUCCEEDED(hResult));
+            capture.stagedFrames[i] = -1;
+        }
+
+        // Frames have to be reproducible, so wait for the whole texture instead
+        // of letting it stream in over the first frames
+        TextureStreamResidency residency;
+        do
+        {
+            Sleep(1);
+            TextureStreamer_Update(textureStreamer, 1.0);
+            TextureStreamer_GetResidency(textureStreamer, wallTexture, &residency);
+        } while(!residency.failed && !(residency.info.numMips && residency.firstValidMip == 0));
+    }
+
     // Main Loop
+    Profiler_Init();
+    Profiler_SetThreadName("Main");
+    // 1 ms timer resolution so the simulation's sleeps don't overshoot a tick
+    timeBeginPeriod(1);
+    InputQueue_Init(&global_inputQueue);
+    Simulation* simulation = Simulation_Create(&global_inputQueue, 120.0);
+    SimState captureState = {};
+    int frameNumber = 0;
     bool isRunning = true;
     while(isRunning)
     {
-        MSG msg = {};
-        while(PeekMessageW(&msg, 0, 0, 0, PM_REMOVE))
+        MemoryArena_Reset(&frameArena);
+
         {
-            if(msg.message == WM_QUIT)
-                isRunning = false;
-            TranslateMessage(&msg);
-            DispatchMessageW(&msg);
+            PROFILE_ZONE("PumpMessages");
+            MSG msg = {};
+            while(PeekMessageW(&msg, 0, 0, 0, PM_REMOVE))
+            {
+                if(msg.message == WM_QUIT)
+                    isRunning = false;
+                TranslateMessage(&msg);
+                DispatchMessageW(&msg);
+            }
+        }
+
+        if(global_dumpProfile)
+        {
+            // F9 writes everything still in the rings, open with chrome://tracing or ui.perfetto.dev
+            ProfilerFrameStats frameStats;
+            Profiler_GetFrameStats(&frameStats);
+            char profileMessage[256];
+            sprintf_s(profileMessage, "Frame time over last %u: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+                      frameStats.numFrames, frameStats.p50Ms, frameStats.p95Ms, frameStats.p99Ms, frameStats.maxMs);
+            OutputDebugStringA(profileMessage);
+            sprintf_s(profileMessage, "Frame arena: high water %zu of %zu bytes, %llu allocations in %u frames, %llu failed\n",
+                      frameArena.highWater, frameArena.capacity, (unsigned long long)frameArena.numAllocs,
+                      frameArena.numResets, (unsigned long long)frameArena.numFailed);
+            OutputDebugStringA(profileMessage);
+            if(!Profiler_WriteChromeTrace("profile_trace.json") || !Profiler_WriteCSV("profile_zones.csv"))
+                OutputDebugStringA("Could not write profile_trace.json / profile_zones.csv\n");
+            global_dumpProfile = false;
         }
 
         if(global_windowDidResize)
         {
+            PROFILE_ZONE("ResizeBuffers");
             d3d11DeviceContext->OMSetRenderTargets(0, 0, 0);
             d3d11FrameBufferView->Release();
 
@@ -304,28 +884,148 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPSTR /*lpC
             global_windowDidResize = false;
         }
 
-        FLOAT backgroundColor[4] = { 0.1f, 0.2f, 0.6f, 1.0f };
-        d3d11DeviceContext->ClearRenderTargetView(d3d11FrameBufferView, backgroundColor);
+        {
+            PROFILE_ZONE("Submit");
+            RECT winRect;
+            GetClientRect(hwnd, &winRect);
+            sceneRecord.width = (float)(winRect.right - winRect.left);
+            sceneRecord.height = (float)(winRect.bottom - winRect.top);
+            ID3D11RenderTargetView* frameTargetView = d3d11FrameBufferView;
+            if(captureDirectory)
+            {
+                sceneRecord.width = (float)capture.width;
+                sceneRecord.height = (float)capture.height;
+                frameTargetView = capture.view;
+            }
+            sceneRecord.target.renderTarget = frameTargetView;
+
+            // F8 switches between replaying on the immediate context and
+            // replaying each pass into its own deferred context in parallel
+            JobSystem_ParallelFor(jobSystem, RecordScenePass, &sceneRecord, ScenePass_Count, &frameArena);
+            if(global_useDeferredContexts)
+            {
+                JobSystem_ParallelFor(jobSystem, ReplaySceneDeferred, &sceneRecord, ScenePass_Count, &frameArena);
+                for(int i = 0; i < ScenePass_Count; ++i)
+                {
+                    d3d11DeviceContext->ExecuteCommandList(sceneRecord.commandLists[i], FALSE);
+                    sceneRecord.commandLists[i]->Release();
+                }
+            }
+            else
+            {
+                D3D11CommandTarget target = sceneRecord.target;
+                target.context = d3d11DeviceContext;
+                for(int i = 0; i < ScenePass_Count; ++i)
+                    D3D11CommandReplay(&sceneRecord.commands[i], &target);
+            }
+
+            // ExecuteCommandList leaves the immediate context in default state
+            D3D11_VIEWPORT viewport = { 0.0f, 0.0f, sceneRecord.width, sceneRecord.height, 0.0f, 1.0f };
+            d3d11DeviceContext->RSSetViewports(1, &viewport);
+            d3d11DeviceContext->OMSetRenderTargets(1, &frameTargetView, nullptr);
 
-        RECT winRect;
-        GetClientRect(hwnd, &winRect);
-        D3D11_VIEWPORT viewport = { 0.0f, 0.0f, (FLOAT)(winRect.right - winRect.left), (FLOAT)(winRect.bottom - winRect.top), 0.0f, 1.0f };
-        d3d11DeviceContext->RSSetViewports(1, &viewport);
+            // Animation and the arrow key controlled quad come from the
+            // simulation thread, blended between its last two ticks
+            SimState simState;
+            if(captureDirectory)
+            {
+                // Captures step their own copy at 60 Hz and ignore input
+                Simulation_Step(&captureState, 1.0 / 60.0);
+                simState = captureState;
+            }
+            else if(!Simulation_GetRenderState(simulation, GetSeconds(), &simState))
+                simState = {};
 
-        d3d11DeviceContext->OMSetRenderTargets(1, &d3d11FrameBufferView, nullptr);
+            // A grid of pulsing quads on top of the triangle, streamed through the batcher
+            const int quadsPerRow = 64;
+            for(int y = 0; y < quadsPerRow; ++y)
+            {
+                for(int x = 0; x < quadsPerRow; ++x)
+                {
+                    float phase = simState.phase + (float)(x + y) * 0.2f;
+                    float size = (1.5f / quadsPerRow) * (0.5f + 0.5f * sinf(phase));
+                    float rect[4] = { -0.95f + x * (1.9f / quadsPerRow), -0.95f + y * (1.9f / quadsPerRow), size, size };
+                    float uvRect[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+                    uint32_t color = 0xFF000000u | ((uint32_t)(y * 4) << 8) | (uint32_t)(x * 4);
+                    QuadBatch_Add(&quadBatch, QuadBatch_MakeKey(0, 0, 0), rect, uvRect, color);
+                }
+            }
+            {
+                const float playerSize = 0.1f;
+                float rect[4] = { simState.position[0] - playerSize * 0.5f, simState.position[1] - playerSize * 0.5f, playerSize, playerSize };
+                float uvRect[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+                QuadBatch_Add(&quadBatch, QuadBatch_MakeKey(1, 0, 0), rect, uvRect, 0xFFFFFFFFu);
+            }
 
-        d3d11DeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        d3d11DeviceContext->IASetInputLayout(inputLayout);
+            // Ask for the mip that matches the largest quad's size on screen
+            TextureStreamResidency wallResidency;
+            TextureStreamer_GetResidency(textureStreamer, wallTexture, &wallResidency);
+            if(wallResidency.info.numMips)
+            {
+                float quadPixels = (1.5f / quadsPerRow) * 0.5f * sceneRecord.width;
+                float mipScale = (float)wallResidency.info.width / (quadPixels > 1.0f ? quadPixels : 1.0f);
+                uint32_t wantedMip = mipScale > 1.0f ? (uint32_t)log2f(mipScale) : 0;
+                TextureStreamer_MarkSampled(textureStreamer, wallTexture, wantedMip);
+            }
+            ID3D11ShaderResourceView* quadTextureView = whiteTextureView;
+            if(wallResidency.firstValidMip < wallResidency.info.numMips)
+                quadTextureView = streamTarget.textures[wallTexture].view;
 
-        d3d11DeviceContext->VSSetShader(vertexShader, nullptr, 0);
-        d3d11DeviceContext->PSSetShader(pixelShader, nullptr, 0);
+            d3d11DeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+            d3d11DeviceContext->IASetInputLayout(quadInputLayout);
+            d3d11DeviceContext->VSSetShader(quadVertexShader, nullptr, 0);
+            d3d11DeviceContext->PSSetShader(quadPixelShader, nullptr, 0);
+            d3d11DeviceContext->PSSetShaderResources(0, 1, &quadTextureView);
+            d3d11DeviceContext->PSSetSamplers(0, 1, &quadSamplerState);
+            UINT instanceStride = QuadInstanceFormat::stride;
+            UINT instanceOffset = 0;
+            d3d11DeviceContext->IASetVertexBuffers(0, 1, &quadTarget.instanceBuffer, &instanceStride, &instanceOffset);
+            QuadBatch_Flush(&quadBatch, &quadBackend, nullptr);
+        }
 
-        d3d11DeviceContext->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+        // Finished loads become visible next frame; 2 ms keeps uploads from causing a hitch
+        TextureStreamer_Update(textureStreamer, 0.002);
 
-        d3d11DeviceContext->Draw(numVerts, 0);
+        if(captureDirectory)
+        {
+            PROFILE_ZONE("Capture");
+            Win32CaptureFrame(d3d11DeviceContext, &capture, frameNumber);
+            if(frameNumber + 1 >= numCaptureFrames) {
+                Win32FlushCaptures(d3d11DeviceContext, &capture, numCaptureFrames);
+                isRunning = false;
+            }
+        }
+        else
+        {
+            // Includes the vsync wait
+            PROFILE_ZONE("Present");
+            d3d11SwapChain->Present(1, 0);
+        }
+        frameNumber++;
+        Profiler_FrameMark();
+    }
 
-        d3d11SwapChain->Present(1, 0);
+    Simulation_Destroy(simulation);
+    timeEndPeriod(1);
+    JobSystem_Destroy(jobSystem);
+    for(int i = 0; i < ScenePass_Count; ++i)
+        sceneRecord.deferredContexts[i]->Release();
+    MemoryArena_Release(&frameArena);
+    TextureStreamer_Destroy(textureStreamer);
+    for(size_t i = 0; i < streamTarget.textures.size(); ++i)
+    {
+        if(streamTarget.textures[i].texture) {
+            streamTarget.textures[i].view->Release();
+            streamTarget.textures[i].texture->Release();
+        }
+    }
+    if(captureDirectory)
+    {
+        for(int i = 0; i < WIN32_CAPTURE_LATENCY; ++i)
+            capture.staging[i]->Release();
+        capture.view->Release();
+        capture.texture->Release();
     }
 
-    return 0;
+    return capture.failed ? 1 : 0;
 }